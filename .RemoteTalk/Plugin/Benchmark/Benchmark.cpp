@@ -0,0 +1,139 @@
+#include "pch.h"
+#include "Benchmark.h"
+#include "RemoteTalk/RemoteTalk.h"
+#include "RemoteTalk/picojson/picojson.h"
+
+// usage: Benchmark [case names...] [warmup=3] [reps=20] [out=benchmark.json]
+// all cases run if no names are given. results are written to out as JSON.
+
+const void * volatile g_sink;
+
+static int g_warmup = 3;
+static int g_repetitions = 20;
+static std::string g_current;
+static picojson::array g_results;
+
+nanosec Now()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void PrintImpl(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    fflush(stdout);
+}
+
+int GetWarmup() { return g_warmup; }
+int GetRepetitions() { return g_repetitions; }
+
+void ReportImpl(const char *name, size_t items, size_t bytes, std::vector<nanosec>& times)
+{
+    if (times.empty())
+        return;
+    std::sort(times.begin(), times.end());
+    auto percentile = [&](double p) {
+        auto i = (size_t)std::ceil(p / 100.0 * times.size());
+        return (double)times[std::min(std::max<size_t>(i, 1), times.size()) - 1];
+    };
+    double mean = 0.0;
+    for (auto t : times)
+        mean += (double)t;
+    mean /= times.size();
+    double median = percentile(50.0);
+
+    Print("    %-40s median %10.0fns  p90 %10.0fns", name, median, percentile(90.0));
+    if (items > 0)
+        Print("  %7.3f ns/sample", median / items);
+    if (bytes > 0)
+        Print("  %7.3f GB/s", (double)bytes / median);
+    Print("\n");
+
+    using namespace picojson;
+    object r;
+    r["case"] = value(g_current);
+    r["name"] = value(name);
+    r["repetitions"] = rt::to_json((uint64_t)times.size());
+    r["items"] = rt::to_json((uint64_t)items);
+    r["bytes"] = rt::to_json((uint64_t)bytes);
+    r["min_ns"] = rt::to_json(times.front());
+    r["median_ns"] = rt::to_json(median);
+    r["mean_ns"] = rt::to_json(mean);
+    r["p90_ns"] = rt::to_json(percentile(90.0));
+    r["p99_ns"] = rt::to_json(percentile(99.0));
+    r["max_ns"] = rt::to_json(times.back());
+    if (items > 0)
+        r["ns_per_sample"] = rt::to_json(median / items);
+    if (bytes > 0)
+        r["gb_per_sec"] = rt::to_json((double)bytes / median);
+    g_results.push_back(value(std::move(r)));
+}
+
+
+struct BenchmarkEntry
+{
+    std::string name;
+    std::function<void()> body;
+};
+
+static std::vector<BenchmarkEntry>& GetBenchmarks()
+{
+    static std::vector<BenchmarkEntry> s_instance;
+    return s_instance;
+}
+
+void RegisterBenchmarkEntryImpl(const char *name, const std::function<void()>& body)
+{
+    GetBenchmarks().push_back({ name, body });
+}
+
+static void RunBenchmarkImpl(const BenchmarkEntry& v)
+{
+    Print("%s\n", v.name.c_str());
+    g_current = v.name;
+    v.body();
+    Print("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    std::string out = "benchmark.json";
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; ++i) {
+        if (char *sep = std::strstr(argv[i], "=")) {
+            *(sep++) = '\0';
+            if (std::strcmp(argv[i], "warmup") == 0)
+                g_warmup = std::max(std::atoi(sep), 0);
+            else if (std::strcmp(argv[i], "reps") == 0)
+                g_repetitions = std::max(std::atoi(sep), 1);
+            else if (std::strcmp(argv[i], "out") == 0)
+                out = sep;
+        }
+        else {
+            names.push_back(argv[i]);
+        }
+    }
+
+    for (auto& entry : GetBenchmarks()) {
+        if (names.empty() || std::find(names.begin(), names.end(), entry.name) != names.end())
+            RunBenchmarkImpl(entry);
+    }
+
+    using namespace picojson;
+    object ret;
+    ret["warmup"] = value((float)g_warmup);
+    ret["repetitions"] = value((float)g_repetitions);
+    ret["results"] = value(std::move(g_results));
+
+    std::ofstream fo(out);
+    if (!fo) {
+        Print("failed to open %s\n", out.c_str());
+        return 1;
+    }
+    fo << value(std::move(ret)).serialize(true);
+    return 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+using nanosec = uint64_t;
+nanosec Now();
+
+void RegisterBenchmarkEntryImpl(const char *name, const std::function<void()>& body);
+void PrintImpl(const char *format, ...);
+void ReportImpl(const char *name, size_t items, size_t bytes, std::vector<nanosec>& times);
+int GetWarmup();
+int GetRepetitions();
+
+// escapes v and the memory it points to (e.g. the contents of a vector) so that the compiler can't optimize away
+// results or the work that produced them. storing the address alone lets it drop writes to the heap buffer.
+extern const void * volatile g_sink;
+template<class T> inline void KeepAlive(const T& v)
+{
+    g_sink = &v;
+#ifdef _MSC_VER
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "r"(&v) : "memory");
+#endif
+}
+
+
+#define Print(...) PrintImpl(__VA_ARGS__)
+
+#define RegisterBenchmarkEntry(Name)\
+    struct Register##Name {\
+        Register##Name() { RegisterBenchmarkEntryImpl(#Name, Name); }\
+    } g_Register##Name;
+
+#define BenchmarkCase(Name) void Name(); RegisterBenchmarkEntry(Name); void Name()
+
+// runs setup (not measured) and body (measured) GetWarmup() + GetRepetitions() times.
+// items: samples processed by one run (reported as ns/item). bytes: bytes processed by one run (reported as GB/s).
+template<class Setup, class Body>
+inline void Measure(const char *name, size_t items, size_t bytes, const Setup& setup, const Body& body)
+{
+    for (int i = 0; i < GetWarmup(); ++i) {
+        setup();
+        body();
+    }
+
+    std::vector<nanosec> times;
+    int reps = GetRepetitions();
+    times.reserve(reps);
+    for (int i = 0; i < reps; ++i) {
+        setup();
+        auto begin = Now();
+        body();
+        times.push_back(Now() - begin);
+    }
+    ReportImpl(name, items, bytes, times);
+}
+
+template<class Body>
+inline void Measure(const char *name, size_t items, size_t bytes, const Body& body)
+{
+    Measure(name, items, bytes, []() {}, body);
+}
@@ -0,0 +1,365 @@
+#include "pch.h"
+#include "Benchmark.h"
+#include "RemoteTalk/RemoteTalk.h"
+
+// chunk sizes in frames at 48kHz: 10ms (typical hook update), 40ms (network frame), 1s (whole utterance)
+static const int Frequency = 48000;
+static const int Channels = 2;
+static const int ChunkSizes[] = { 480, 1920, 48000 };
+
+static const rt::AudioFormat Formats[] = {
+    rt::AudioFormat::U8,
+    rt::AudioFormat::S16,
+    rt::AudioFormat::S24,
+    rt::AudioFormat::S32,
+    rt::AudioFormat::F32,
+};
+
+static const char* GetFormatName(rt::AudioFormat f)
+{
+    switch (f) {
+    case rt::AudioFormat::U8: return "U8";
+    case rt::AudioFormat::S16: return "S16";
+    case rt::AudioFormat::S24: return "S24";
+    case rt::AudioFormat::S32: return "S32";
+    case rt::AudioFormat::F32: return "F32";
+    default: return "Unknown";
+    }
+}
+
+static rt::AudioData MakeSine(rt::AudioFormat format, int frames, int channels = Channels, int frequency = Frequency)
+{
+    rt::AudioData tmp;
+    tmp.format = rt::AudioFormat::F32;
+    tmp.frequency = frequency;
+    tmp.channels = channels;
+    tmp.allocateSample(frames * channels);
+    auto *samples = tmp.get<float>();
+    for (int i = 0; i < frames; ++i) {
+        float v = std::sin(2.0f * rt::PI * 440.0f * (float)i / (float)frequency) * 0.5f;
+        for (int c = 0; c < channels; ++c)
+            *samples++ = v;
+    }
+
+    rt::AudioData ret;
+    tmp.convertFormat(ret, format);
+    return ret;
+}
+
+
+BenchmarkCase(AudioData_Convert)
+{
+    char name[128];
+    for (int frames : ChunkSizes) {
+        for (auto src_format : Formats) {
+            auto src = MakeSine(src_format, frames);
+            for (auto dst_format : Formats) {
+                rt::AudioData dst;
+                sprintf(name, "%s -> %s %d", GetFormatName(src_format), GetFormatName(dst_format), frames);
+                Measure(name, src.getSampleLength(), src.data.size(), [&]() {
+                    src.convertFormat(dst, dst_format);
+                    KeepAlive(dst);
+                });
+            }
+        }
+    }
+}
+
+BenchmarkCase(AudioData_Resample)
+{
+    char name[128];
+    for (int frames : ChunkSizes) {
+        for (auto format : { rt::AudioFormat::S16, rt::AudioFormat::F32 }) {
+            auto src = MakeSine(format, frames, Channels, 44100);
+            rt::AudioData dst;
+            int dst_len = (int)((int64_t)frames * Frequency / 44100) * Channels;
+            sprintf(name, "%s 44100 -> 48000 %d", GetFormatName(format), frames);
+            Measure(name, dst_len, 0, [&]() {
+                src.resample(dst, Frequency, dst_len);
+                KeepAlive(dst);
+            });
+        }
+    }
+}
+
+BenchmarkCase(AudioData_ToFloat)
+{
+    char name[128];
+    for (int frames : ChunkSizes) {
+        for (auto format : Formats) {
+            auto src = MakeSine(format, frames);
+            std::vector<float> dst(src.getSampleLength());
+            sprintf(name, "%s %d", GetFormatName(format), frames);
+            Measure(name, dst.size(), 0, [&]() {
+                src.toFloat(dst.data());
+                KeepAlive(dst);
+            });
+        }
+    }
+}
+
+BenchmarkCase(AudioData_ConvertToMono)
+{
+    char name[128];
+    for (int frames : ChunkSizes) {
+        for (auto format : Formats) {
+            auto src = MakeSine(format, frames);
+            rt::AudioData work;
+            sprintf(name, "%s %d", GetFormatName(format), frames);
+            Measure(name, src.getSampleLength(), src.data.size(),
+                [&]() { work = src; },
+                [&]() {
+                    work.convertToMono();
+                    KeepAlive(work);
+                });
+        }
+    }
+}
+
+BenchmarkCase(AudioData_Append)
+{
+    char name[128];
+    for (int frames : ChunkSizes) {
+        // same format is a plain copy. different format converts every sample.
+        for (auto src_format : { rt::AudioFormat::F32, rt::AudioFormat::S16 }) {
+            auto src = MakeSine(src_format, frames);
+            rt::AudioData dst;
+            dst.format = rt::AudioFormat::F32;
+            dst.frequency = Frequency;
+            dst.channels = Channels;
+            sprintf(name, "F32 += %s %d", GetFormatName(src_format), frames);
+            Measure(name, src.getSampleLength(), src.data.size(),
+                [&]() { dst.data.clear(); },
+                [&]() {
+                    dst += src;
+                    KeepAlive(dst);
+                });
+        }
+    }
+
+    // accumulating a whole utterance chunk by chunk, as clients do while receiving
+    {
+        const int NumChunks = 300; // 3 sec
+        auto chunk = MakeSine(rt::AudioFormat::S16, 480);
+        rt::AudioData dst;
+        Measure("S16 += S16 480 x 300 (growth)", chunk.getSampleLength() * NumChunks, chunk.data.size() * NumChunks,
+            [&]() { dst = rt::AudioData(); },
+            [&]() {
+                for (int i = 0; i < NumChunks; ++i)
+                    dst += chunk;
+                KeepAlive(dst);
+            });
+    }
+}
+
+BenchmarkCase(AudioData_Serialize)
+{
+    char name[128];
+    for (int frames : ChunkSizes) {
+        auto src = MakeSine(rt::AudioFormat::S16, frames);
+        std::string serialized;
+        {
+            std::ostringstream os;
+            src.serialize(os);
+            serialized = os.str();
+        }
+
+        std::ostringstream os;
+        sprintf(name, "serialize S16 %d", frames);
+        Measure(name, src.getSampleLength(), src.data.size(),
+            [&]() { os.str(""); },
+            [&]() {
+                src.serialize(os);
+                KeepAlive(os);
+            });
+
+        std::istringstream is;
+        rt::AudioData dst;
+        sprintf(name, "deserialize S16 %d", frames);
+        Measure(name, src.getSampleLength(), src.data.size(),
+            [&]() { is.str(serialized); is.clear(); },
+            [&]() {
+                dst.deserialize(is);
+                KeepAlive(dst);
+            });
+    }
+}
+
+BenchmarkCase(AudioFile_Export)
+{
+    auto src = MakeSine(rt::AudioFormat::S16, Frequency * 3); // 3 sec
+    std::ostringstream os;
+    Measure("ExportWave S16 3sec", src.getSampleLength(), src.data.size(),
+        [&]() { os.str(""); },
+        [&]() {
+            rt::ExportWave(src, os);
+            KeepAlive(os);
+        });
+#ifdef rtEnableOgg
+    Measure("ExportOgg S16 3sec", src.getSampleLength(), src.data.size(),
+        [&]() { os.str(""); },
+        [&]() {
+            rt::ExportOgg(src, os);
+            KeepAlive(os);
+        });
+#endif
+}
+
+BenchmarkCase(RawVector_Growth)
+{
+    const size_t N = 1024 * 1024;
+    Measure("RawVector<int>::push_back 1M", N, N * sizeof(int), [&]() {
+        rt::RawVector<int> v;
+        for (size_t i = 0; i < N; ++i)
+            v.push_back((int)i);
+        KeepAlive(v);
+    });
+    Measure("std::vector<int>::push_back 1M", N, N * sizeof(int), [&]() {
+        std::vector<int> v;
+        for (size_t i = 0; i < N; ++i)
+            v.push_back((int)i);
+        KeepAlive(v);
+    });
+
+    // appending chunks, as the capture buffer and clients do
+    const size_t ChunkSize = 1920 * Channels * sizeof(int16_t);
+    const int NumChunks = 500;
+    std::vector<char> chunk(ChunkSize);
+    Measure("RawVector<char>::insert 7680B x 500", 0, ChunkSize * NumChunks, [&]() {
+        rt::RawVector<char> v;
+        for (int i = 0; i < NumChunks; ++i)
+            v.insert(v.end(), chunk.data(), chunk.data() + chunk.size());
+        KeepAlive(v);
+    });
+    Measure("std::vector<char>::insert 7680B x 500", 0, ChunkSize * NumChunks, [&]() {
+        std::vector<char> v;
+        for (int i = 0; i < NumChunks; ++i)
+            v.insert(v.end(), chunk.begin(), chunk.end());
+        KeepAlive(v);
+    });
+
+    // allocator policies
+    Measure("RawVector<char, Aligned64>::insert 7680B x 500", 0, ChunkSize * NumChunks, [&]() {
+        rt::RawVector<char, rt::Aligned64Allocator> v;
+        for (int i = 0; i < NumChunks; ++i)
+            v.insert(v.end(), chunk.data(), chunk.data() + chunk.size());
+        KeepAlive(v);
+    });
+    Measure("RawVector<char, Pool> 7680B chunk x 500", 0, ChunkSize * NumChunks, [&]() {
+        for (int i = 0; i < NumChunks; ++i) {
+            rt::RawVector<char, rt::PoolAllocator> v;
+            v.assign(chunk.data(), chunk.data() + chunk.size());
+            KeepAlive(v);
+        }
+    });
+    Measure("RawVector<char, Malloc> 7680B chunk x 500", 0, ChunkSize * NumChunks, [&]() {
+        for (int i = 0; i < NumChunks; ++i) {
+            rt::RawVector<char> v;
+            v.assign(chunk.data(), chunk.data() + chunk.size());
+            KeepAlive(v);
+        }
+    });
+    Measure("RawVector<char, Arena>::insert 7680B x 500", 0, ChunkSize * NumChunks, [&]() {
+        rt::Arena arena(ChunkSize * NumChunks * 2);
+        rt::RawVector<char, rt::ArenaAllocator> v;
+        for (int i = 0; i < NumChunks; ++i)
+            v.insert(v.end(), chunk.data(), chunk.data() + chunk.size());
+        KeepAlive(v);
+    });
+}
+
+BenchmarkCase(RingBuffer)
+{
+    // a DirectSound buffer of 1 sec and 10ms updates that wrap around its end, as the capture hooks do
+    const size_t BufferSize = Frequency * Channels * sizeof(int16_t);
+    const size_t UpdateSize = BufferSize / 100;
+    const size_t Pos = BufferSize - UpdateSize / 2;
+    rt::RingBuffer<char> ring(BufferSize);
+    rt::RawVector<char> raw(BufferSize);
+    // the whole update as the hooks do it. the server holds the last few chunks until they are sent,
+    // so the hook's buffer is always shared and a new one is needed unless chunks are recycled.
+    const size_t InFlight = 4;
+    std::deque<rt::AudioDataPtr> server_queue;
+    auto hand = [&](rt::AudioDataPtr chunk) {
+        server_queue.push_back(std::move(chunk));
+        if (server_queue.size() > InFlight)
+            server_queue.pop_front(); // sent
+    };
+    rt::AudioData dst;
+    Measure("hook update: assign + insert, new AudioData", 0, UpdateSize, [&]() {
+        dst.data.assign(&raw[Pos], raw.end());
+        dst.data.insert(dst.data.end(), raw.begin(), &raw[UpdateSize / 2]);
+        hand(std::make_shared<rt::AudioData>(dst));
+    });
+    server_queue.clear();
+    Measure("hook update: RingBuffer::view, new AudioData", 0, UpdateSize, [&]() {
+        auto range = ring.view(Pos, UpdateSize);
+        dst.data.resize_discard(range.size());
+        range.copy_to(dst.data.data());
+        hand(std::make_shared<rt::AudioData>(dst));
+    });
+    server_queue.clear();
+    rt::AudioDataPool pool;
+    Measure("hook update: RingBuffer::view, AudioDataPool", 0, UpdateSize, [&]() {
+        auto range = ring.view(Pos, UpdateSize);
+        auto chunk = pool.get();
+        chunk->data.resize_discard(range.size());
+        range.copy_to(chunk->data.data());
+        hand(chunk);
+    });
+    server_queue.clear();
+
+    // producer and consumer threads passing 10ms chunks
+    const size_t ChunkSize = 480 * Channels;
+    const size_t Total = ChunkSize * 1000;
+    std::vector<int16_t> chunk(ChunkSize);
+    Measure("SPSC RingBuffer<int16_t> 10ms chunks x 1000", Total, Total * sizeof(int16_t), [&]() {
+        rt::RingBuffer<int16_t> q(ChunkSize * 8);
+        std::thread producer([&]() {
+            for (size_t sent = 0; sent < Total;) {
+                size_t n = q.write(chunk.data(), std::min(ChunkSize, Total - sent));
+                if (n == 0)
+                    std::this_thread::yield();
+                sent += n;
+            }
+        });
+        rt::RawVector<int16_t> tmp;
+        for (size_t received = 0; received < Total;) {
+            size_t n = q.read_chunk(tmp, ChunkSize);
+            if (n == 0)
+                std::this_thread::yield();
+            received += n;
+        }
+        producer.join();
+        KeepAlive(tmp);
+    });
+    Measure("mutex RingBuffer<int16_t> 10ms chunks x 1000", Total, Total * sizeof(int16_t), [&]() {
+        rt::RingBuffer<int16_t> q(ChunkSize * 8);
+        std::mutex mutex;
+        std::thread producer([&]() {
+            for (size_t sent = 0; sent < Total;) {
+                size_t n;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    n = q.write(chunk.data(), std::min(ChunkSize, Total - sent));
+                }
+                if (n == 0)
+                    std::this_thread::yield();
+                sent += n;
+            }
+        });
+        rt::RawVector<int16_t> tmp;
+        for (size_t received = 0; received < Total;) {
+            size_t n;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                n = q.read_chunk(tmp, ChunkSize);
+            }
+            if (n == 0)
+                std::this_thread::yield();
+            received += n;
+        }
+        producer.join();
+        KeepAlive(tmp);
+    });
+}
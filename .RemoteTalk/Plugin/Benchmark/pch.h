@@ -0,0 +1,25 @@
+#pragma once
+
+#ifdef _WIN32
+#pragma warning(disable:4996)
+#define NOMINMAX
+#include <windows.h>
+#include <intrin.h>
+#endif
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <codecvt>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <functional>
+#include <memory>
+#include <chrono>
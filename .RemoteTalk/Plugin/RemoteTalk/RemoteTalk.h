@@ -7,8 +7,18 @@
 #include "rtHookDSound.h"
 
 #include "rtNorm.h"
+#include "rtAllocator.h"
 #include "rtAudioData.h"
 #include "rtAudioFile.h"
+#include "rtAudioCoalescer.h"
+#include "rtPlaybackBuffer.h"
+#include "rtAudioSink.h"
+#include "rtHistogram.h"
+#include "rtMetrics.h"
+#include "rtTrace.h"
+#include "rtThreadPool.h"
+#include "rtTrafficLog.h"
+#include "rtTalkCache.h"
 
 #include "rtTalkInterface.h"
 #include "rtSerialization.h"
@@ -4,3 +4,8 @@
 #include "rtTalkServer.h"
 #include "rtTalkReceiver.h"
 #include "rtTalkClient.h"
+#include "rtTalkChannel.h"
+#include "rtTalkAsync.h"
+#include "rtRenderQueue.h"
+#include "rtTalkProxy.h"
+#include "rtSharedRing.h"
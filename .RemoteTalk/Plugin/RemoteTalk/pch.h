@@ -26,6 +26,9 @@
 #include <functional>
 #include <future>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
 
 #define POCO_STATIC
@@ -36,6 +39,7 @@
 #include "Poco/Timestamp.h"
 #include "Poco/URI.h"
 #include "Poco/StreamCopier.h"
+#include "Poco/Buffer.h"
 #include "Poco/Net/TCPServer.h"
 #include "Poco/Net/TCPServerParams.h"
 #include "Poco/Net/HTTPServer.h"
@@ -43,6 +47,7 @@
 #include "Poco/Net/HTTPRequestHandlerFactory.h"
 #include "Poco/Net/HTTPServerParams.h"
 #include "Poco/Net/HTTPServerRequest.h"
+#include "Poco/Net/HTTPServerRequestImpl.h"
 #include "Poco/Net/HTTPServerResponse.h"
 #include "Poco/Net/HTTPServerParams.h"
 #include "Poco/Net/HTTPClientSession.h"
@@ -55,3 +60,5 @@
 #include "Poco/Net/StreamSocket.h"
 #include "Poco/Net/SocketStream.h"
 #include "Poco/Net/SocketAddress.h"
+#include "Poco/Net/WebSocket.h"
+#include "Poco/Net/NetException.h"
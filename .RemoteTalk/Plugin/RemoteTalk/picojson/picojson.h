@@ -74,6 +74,10 @@ extern "C" {
 #endif
 
 // experimental support for int64_t (see README.mkdn for detail)
+// RemoteTalk: numbers are float. counters and nanoseconds need int64_t to be exact.
+#ifndef PICOJSON_USE_INT64
+#define PICOJSON_USE_INT64
+#endif
 #ifdef PICOJSON_USE_INT64
 #define __STDC_FORMAT_MACROS
 #include <errno.h>
@@ -0,0 +1,287 @@
+#include "pch.h"
+#include "rtAllocator.h"
+
+namespace rt {
+
+void* AlignedMalloc(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void *ret = nullptr;
+    if (posix_memalign(&ret, std::max(alignment, sizeof(void*)), size) != 0)
+        return nullptr;
+    return ret;
+#endif
+}
+
+void AlignedFree(void *addr)
+{
+#ifdef _WIN32
+    _aligned_free(addr);
+#else
+    free(addr);
+#endif
+}
+
+void* AlignedRealloc(void *addr, size_t new_size, size_t alignment)
+{
+#ifdef _WIN32
+    return _aligned_realloc(addr, new_size, alignment);
+#else
+    // realloc() doesn't keep the alignment
+    (void)addr; (void)new_size; (void)alignment;
+    return nullptr;
+#endif
+}
+
+
+namespace {
+
+class BlockPool
+{
+public:
+    static const int NumClasses = 15; // 64B - 1MB
+
+    static BlockPool& getInstance()
+    {
+        // never destroyed. blocks may be freed by static destructors of other modules.
+        static auto *s_instance = new BlockPool();
+        return *s_instance;
+    }
+
+    static int getClass(size_t size)
+    {
+        int ret = 0;
+        size_t s = PoolAllocator::MinBlockSize;
+        while (s < size) {
+            s <<= 1;
+            ++ret;
+        }
+        return ret;
+    }
+
+    static size_t getClassSize(int c)
+    {
+        return PoolAllocator::MinBlockSize << c;
+    }
+
+    void* allocate(int c)
+    {
+        {
+            lock_t lock(m_mutex);
+            auto& blocks = m_blocks[c];
+            if (!blocks.empty()) {
+                auto ret = blocks.back();
+                blocks.pop_back();
+                return ret;
+            }
+        }
+        return AlignedMalloc(getClassSize(c), 64);
+    }
+
+    void deallocate(void *addr, int c)
+    {
+        {
+            lock_t lock(m_mutex);
+            auto& blocks = m_blocks[c];
+            if ((blocks.size() + 1) * getClassSize(c) <= PoolAllocator::MaxCachedBytes) {
+                blocks.push_back(addr);
+                return;
+            }
+        }
+        AlignedFree(addr);
+    }
+
+    void trim()
+    {
+        std::vector<void*> tmp[NumClasses];
+        {
+            lock_t lock(m_mutex);
+            for (int i = 0; i < NumClasses; ++i)
+                tmp[i].swap(m_blocks[i]);
+        }
+        for (auto& blocks : tmp) {
+            for (auto *b : blocks)
+                AlignedFree(b);
+        }
+    }
+
+    size_t getCachedBytes()
+    {
+        lock_t lock(m_mutex);
+        size_t ret = 0;
+        for (int i = 0; i < NumClasses; ++i)
+            ret += m_blocks[i].size() * getClassSize(i);
+        return ret;
+    }
+
+private:
+    using lock_t = std::unique_lock<std::mutex>;
+
+    std::mutex m_mutex;
+    std::vector<void*> m_blocks[NumClasses];
+};
+
+} // namespace
+
+void* PoolAllocator::allocate(size_t size)
+{
+    if (size > MaxBlockSize)
+        return AlignedMalloc(size, 64);
+    auto& pool = BlockPool::getInstance();
+    return pool.allocate(pool.getClass(size));
+}
+
+void PoolAllocator::deallocate(void *addr, size_t size)
+{
+    if (!addr)
+        return;
+    if (size > MaxBlockSize) {
+        AlignedFree(addr);
+        return;
+    }
+    auto& pool = BlockPool::getInstance();
+    pool.deallocate(addr, pool.getClass(size));
+}
+
+void* PoolAllocator::reallocate(void *addr, size_t size, size_t new_size)
+{
+    if (addr && size <= MaxBlockSize && new_size <= MaxBlockSize &&
+        BlockPool::getClass(size) == BlockPool::getClass(new_size))
+        return addr;
+    return nullptr;
+}
+
+void PoolAllocator::trim()
+{
+    BlockPool::getInstance().trim();
+}
+
+size_t PoolAllocator::getCachedBytes()
+{
+    return BlockPool::getInstance().getCachedBytes();
+}
+
+
+static thread_local Arena *g_current_arena = nullptr;
+
+static size_t AlignArena(size_t v)
+{
+    return (v + Arena::Alignment - 1) & ~(Arena::Alignment - 1);
+}
+
+Arena::Arena(size_t page_size)
+    : m_page_size(AlignArena(std::max(page_size, (size_t)Alignment)))
+    , m_prev(g_current_arena)
+{
+    g_current_arena = this;
+}
+
+Arena::~Arena()
+{
+    g_current_arena = m_prev;
+    for (auto& page : m_pages)
+        AlignedFree(page.data);
+}
+
+void* Arena::allocate(size_t size)
+{
+    size = AlignArena(std::max<size_t>(size, 1));
+    if (m_pages.empty() || m_pos + size > m_pages.back().size) {
+        auto page_size = std::max(size, m_page_size);
+        auto *data = (char*)AlignedMalloc(page_size, Alignment);
+        if (!data)
+            return nullptr;
+        m_pages.push_back({ data, page_size });
+        m_pos = 0;
+    }
+    auto ret = m_pages.back().data + m_pos;
+    m_pos += size;
+    m_usage += size;
+    return ret;
+}
+
+bool Arena::extend(void *addr, size_t size, size_t new_size)
+{
+    if (m_pages.empty())
+        return false;
+    auto& page = m_pages.back();
+    size = AlignArena(std::max<size_t>(size, 1));
+    new_size = AlignArena(new_size);
+    // only the last allocation can grow
+    if ((char*)addr + size != page.data + m_pos || (char*)addr - page.data + new_size > page.size)
+        return false;
+    m_pos += new_size - size;
+    m_usage += new_size - size;
+    return true;
+}
+
+void Arena::release(void *addr, size_t size)
+{
+    if (m_pages.empty())
+        return;
+    auto& page = m_pages.back();
+    size = AlignArena(std::max<size_t>(size, 1));
+    if ((char*)addr + size == page.data + m_pos) {
+        m_pos -= size;
+        m_usage -= size;
+    }
+}
+
+bool Arena::contains(const void *addr) const
+{
+    for (auto& page : m_pages) {
+        if (addr >= page.data && addr < page.data + page.size)
+            return true;
+    }
+    return false;
+}
+
+size_t Arena::getUsage() const
+{
+    return m_usage;
+}
+
+Arena* Arena::getCurrent()
+{
+    return g_current_arena;
+}
+
+// the arena of this thread that owns addr. null if addr is on the heap.
+static Arena* FindArena(const void *addr)
+{
+    for (auto *a = g_current_arena; a; a = a->getPrevious()) {
+        if (a->contains(addr))
+            return a;
+    }
+    return nullptr;
+}
+
+void* ArenaAllocator::allocate(size_t size)
+{
+    if (auto *arena = Arena::getCurrent())
+        return arena->allocate(size);
+    return malloc(size);
+}
+
+void ArenaAllocator::deallocate(void *addr, size_t size)
+{
+    if (!addr)
+        return;
+    if (auto *arena = FindArena(addr))
+        arena->release(addr, size);
+    else
+        free(addr);
+}
+
+void* ArenaAllocator::reallocate(void *addr, size_t size, size_t new_size)
+{
+    if (!addr)
+        return nullptr;
+    if (auto *arena = FindArena(addr))
+        return arena->extend(addr, size, new_size) ? addr : nullptr;
+    return realloc(addr, new_size);
+}
+
+} // namespace rt
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdlib>
+#include <cstddef>
+#include <vector>
+
+namespace rt {
+
+// allocator policies of RawVector. all functions are static.
+// reallocate() resizes a block keeping its contents. it returns null if it can't, and the caller falls back to
+// allocate() + copy + deallocate(). size is always the size the block was allocated (or reallocated) with.
+
+struct MallocAllocator
+{
+    static void* allocate(size_t size) { return malloc(size); }
+    static void deallocate(void *addr, size_t /*size*/) { free(addr); }
+    // glibc moves large blocks by mremap() instead of copying
+    static void* reallocate(void *addr, size_t /*size*/, size_t new_size) { return realloc(addr, new_size); }
+};
+
+
+void* AlignedMalloc(size_t size, size_t alignment);
+void AlignedFree(void *addr);
+// null if the platform has no aligned realloc
+void* AlignedRealloc(void *addr, size_t new_size, size_t alignment);
+
+// for aligned SIMD loads. e.g. AlignedAllocator<32> for AVX.
+template<size_t Alignment>
+struct AlignedAllocator
+{
+    static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of 2");
+
+    static void* allocate(size_t size) { return AlignedMalloc(size, Alignment); }
+    static void deallocate(void *addr, size_t /*size*/) { AlignedFree(addr); }
+    static void* reallocate(void *addr, size_t /*size*/, size_t new_size) { return AlignedRealloc(addr, new_size, Alignment); }
+};
+using Aligned32Allocator = AlignedAllocator<32>;
+using Aligned64Allocator = AlignedAllocator<64>;
+
+
+// recycles freed blocks by size class (powers of 2 from 64B to 1MB) instead of returning them to the heap.
+// for buffers that are allocated and freed at a high rate, e.g. audio chunks. larger blocks are not pooled.
+// blocks are 64 byte aligned. thread safe.
+struct PoolAllocator
+{
+    static const size_t MinBlockSize = 64;
+    static const size_t MaxBlockSize = 1024 * 1024;
+    static const size_t MaxCachedBytes = 64 * 1024 * 1024; // per size class
+
+    static void* allocate(size_t size);
+    static void deallocate(void *addr, size_t size);
+    // in place if the size class doesn't change
+    static void* reallocate(void *addr, size_t size, size_t new_size);
+    // returns cached blocks to the heap
+    static void trim();
+    static size_t getCachedBytes();
+};
+
+
+// bump allocator. blocks are released all at once when the arena is destroyed.
+// an arena is the current one of the thread while it is alive. nest them like scopes.
+//
+//  {
+//      rt::Arena arena;
+//      rt::RawVector<float, rt::ArenaAllocator> tmp; // allocated in arena
+//      ...
+//  } // tmp must be gone before arena
+class Arena
+{
+public:
+    static const size_t DefaultPageSize = 1024 * 1024;
+    static const size_t Alignment = 64;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    Arena(size_t page_size = DefaultPageSize);
+    ~Arena();
+
+    void* allocate(size_t size);
+    // grows the last allocation in place if the page has room
+    bool extend(void *addr, size_t size, size_t new_size);
+    // rolls back the last allocation. others are kept until the arena is destroyed.
+    void release(void *addr, size_t size);
+    bool contains(const void *addr) const;
+    size_t getUsage() const;
+    // the arena that was current when this one was created
+    Arena* getPrevious() const { return m_prev; }
+
+    // null if there is no arena on this thread
+    static Arena* getCurrent();
+
+private:
+    struct Page
+    {
+        char *data;
+        size_t size;
+    };
+
+    std::vector<Page> m_pages;
+    size_t m_page_size;
+    size_t m_pos = 0; // in the last page
+    size_t m_usage = 0;
+    Arena *m_prev = nullptr;
+};
+
+// allocates from the current arena of the thread, or from the heap if there is none.
+struct ArenaAllocator
+{
+    static void* allocate(size_t size);
+    static void deallocate(void *addr, size_t size);
+    static void* reallocate(void *addr, size_t size, size_t new_size);
+};
+
+} // namespace rt
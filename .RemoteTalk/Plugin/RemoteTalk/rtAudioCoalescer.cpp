@@ -0,0 +1,138 @@
+#include "pch.h"
+#include "rtFoundation.h"
+#include "rtAudioCoalescer.h"
+
+namespace rt {
+
+// format + frequency + channels + data size. see AudioData::serialize()
+static const size_t AudioDataHeaderSize = 16;
+
+float AudioCoalescer::Stats::framesPerSecond() const
+{
+    return duration > 0.0 ? float(frames_out / duration) : 0.0f;
+}
+
+float AudioCoalescer::Stats::headerOverhead() const
+{
+    auto total = payload_bytes + header_bytes;
+    return total > 0 ? float(double(header_bytes) / double(total)) : 0.0f;
+}
+
+
+AudioCoalescer::AudioCoalescer(int frame_ms, int max_hold_ms)
+{
+    setTarget(frame_ms, max_hold_ms);
+}
+
+void AudioCoalescer::setTarget(int frame_ms, int max_hold_ms)
+{
+    m_frame_ms = std::max(frame_ms, 1);
+    m_max_hold_ms = std::max(max_hold_ms, 0);
+}
+
+void AudioCoalescer::reset()
+{
+    m_pending.clear();
+    m_ready.clear();
+    m_stats = {};
+}
+
+size_t AudioCoalescer::getFrameSize() const
+{
+    size_t sample_size = SizeOf(m_pending.format) * m_pending.channels;
+    size_t num_samples = std::max<size_t>((size_t)m_pending.frequency * m_frame_ms / 1000, 1);
+    return sample_size * num_samples;
+}
+
+void AudioCoalescer::push(const AudioData& data)
+{
+    if (data.data.empty())
+        return;
+    ++m_stats.chunks_in;
+
+    if (!m_pending.data.empty() &&
+        (m_pending.format != data.format || m_pending.frequency != data.frequency || m_pending.channels != data.channels))
+    {
+        // format changed. frames can't contain mixed formats.
+        emitPending();
+    }
+    if (m_pending.data.empty()) {
+        m_pending.format = data.format;
+        m_pending.frequency = data.frequency;
+        m_pending.channels = data.channels;
+        m_hold_begin = clock_t::now();
+    }
+    m_pending.data.insert(m_pending.data.end(), data.data.begin(), data.data.end());
+
+    auto frame_size = getFrameSize();
+    if (frame_size == 0 || m_pending.data.size() < frame_size)
+        return;
+
+    // cut out full frames and keep the rest pending
+    size_t pos = 0;
+    size_t size = m_pending.data.size();
+    while (size - pos >= frame_size) {
+        auto frame = std::make_shared<AudioData>();
+        frame->format = m_pending.format;
+        frame->frequency = m_pending.frequency;
+        frame->channels = m_pending.channels;
+        // large frames share the pending buffer. small ones are copied so they don't pin it.
+        if (frame_size < MinSliceSize)
+            frame->data.assign(m_pending.data.cdata() + pos, m_pending.data.cdata() + pos + frame_size);
+        else
+            frame->data = m_pending.data.slice(pos, frame_size);
+        pos += frame_size;
+
+        m_stats.duration += frame->getDuration();
+        m_stats.payload_bytes += frame_size;
+        m_stats.header_bytes += AudioDataHeaderSize;
+        ++m_stats.frames_out;
+        m_ready.push_back(frame);
+    }
+    // the remainder is copied. it would be copied anyway when more data is appended, and a slice would keep
+    // the frames' buffer alive until then.
+    decltype(m_pending.data) rest;
+    rest.assign(m_pending.data.cdata() + pos, m_pending.data.cdata() + size);
+    m_pending.data.swap(rest);
+    if (!m_pending.data.empty())
+        m_hold_begin = clock_t::now();
+}
+
+void AudioCoalescer::emitPending()
+{
+    if (m_pending.data.empty())
+        return;
+
+    auto frame = std::make_shared<AudioData>();
+    frame->format = m_pending.format;
+    frame->frequency = m_pending.frequency;
+    frame->channels = m_pending.channels;
+    frame->data.swap(m_pending.data);
+
+    m_stats.duration += frame->getDuration();
+    m_stats.payload_bytes += frame->data.size();
+    m_stats.header_bytes += AudioDataHeaderSize;
+    ++m_stats.frames_out;
+    m_ready.push_back(frame);
+}
+
+AudioDataPtr AudioCoalescer::pop(bool flush)
+{
+    if (m_ready.empty() && !m_pending.data.empty()) {
+        if (flush || clock_t::now() - m_hold_begin >= std::chrono::milliseconds(m_max_hold_ms))
+            emitPending();
+    }
+    if (m_ready.empty())
+        return nullptr;
+
+    auto ret = m_ready.front();
+    m_ready.pop_front();
+    return ret;
+}
+
+const AudioCoalescer::Stats& AudioCoalescer::getStats() const
+{
+    return m_stats;
+}
+
+} // namespace rt
@@ -0,0 +1,54 @@
+#pragma once
+#include <deque>
+#include <chrono>
+#include "rtAudioData.h"
+
+namespace rt {
+
+// batches small captured chunks into frames of a target duration.
+// hooks deliver whatever the host's cursor moved (sometimes a few hundred bytes) and each one would be
+// a frame with its own header otherwise. pending data is released after max_hold_ms to bound latency.
+class AudioCoalescer
+{
+public:
+    using clock_t = std::chrono::steady_clock;
+    // frames smaller than this are copied instead of sliced out of the pending buffer.
+    // a slice keeps the whole buffer alive as long as the frame lives.
+    static const size_t MinSliceSize = 4096;
+
+    struct Stats
+    {
+        uint64_t chunks_in = 0;
+        uint64_t frames_out = 0;
+        uint64_t payload_bytes = 0;
+        uint64_t header_bytes = 0;
+        double duration = 0.0; // total audio duration in seconds
+
+        float framesPerSecond() const; // frames per second of audio
+        float headerOverhead() const; // header bytes / total bytes
+    };
+
+    AudioCoalescer(int frame_ms = 20, int max_hold_ms = 40);
+    void setTarget(int frame_ms, int max_hold_ms);
+    void reset();
+
+    void push(const AudioData& data);
+    // returns a frame if one has reached the target duration or has been held longer than max_hold_ms.
+    // flush releases pending data regardless of its length.
+    AudioDataPtr pop(bool flush = false);
+
+    const Stats& getStats() const;
+
+private:
+    void emitPending();
+    size_t getFrameSize() const;
+
+    int m_frame_ms = 20;
+    int m_max_hold_ms = 40;
+    AudioData m_pending;
+    clock_t::time_point m_hold_begin;
+    std::deque<AudioDataPtr> m_ready;
+    Stats m_stats;
+};
+
+} // namespace rt
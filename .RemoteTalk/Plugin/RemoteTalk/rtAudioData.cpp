@@ -95,6 +95,18 @@ double AudioData::getDuration() const
     return (double)getSampleLength() / (frequency * channels);
 }
 
+AudioData AudioData::slice(size_t pos, size_t len) const
+{
+    AudioData ret;
+    ret.format = format;
+    ret.frequency = frequency;
+    ret.channels = channels;
+    auto s = SizeOf(format);
+    if (s > 0)
+        ret.data = data.slice(pos * s, len * s);
+    return ret;
+}
+
 bool AudioData::convertFormat(AudioData& dst, AudioFormat fmt) const
 {
     if (format == AudioFormat::Unknown || format == AudioFormat::RawFile || fmt == AudioFormat::Unknown || fmt == AudioFormat::RawFile)
@@ -242,7 +254,7 @@ double AudioData::resample(AudioData& dst, int new_frequency, int new_length, do
     }
 }
 
-int AudioData::toFloat(float *dst, int pos, int len_orig, bool multiply)
+int AudioData::toFloat(float *dst, int pos, int len_orig, bool multiply) const
 {
     int sample_length = (int)getSampleLength();
     pos = std::min(pos, sample_length);
@@ -275,7 +287,7 @@ int AudioData::toFloat(float *dst, int pos, int len_orig, bool multiply)
     return len;
 }
 
-double AudioData::resampleFloat(float *dst, int new_frequency, int new_channels, int length, double pos)
+double AudioData::resampleFloat(float *dst, int new_frequency, int new_channels, int length, double pos) const
 {
     AudioData tmp;
     auto ret = resample(tmp, new_frequency, length / new_channels, pos);
@@ -284,6 +296,32 @@ double AudioData::resampleFloat(float *dst, int new_frequency, int new_channels,
     return ret;
 }
 
+AudioDataPool::AudioDataPool(size_t max_chunks)
+    : m_max_chunks(max_chunks)
+{
+}
+
+AudioDataPtr AudioDataPool::get()
+{
+    // round robin from the last one. the oldest chunks are the most likely to be released.
+    size_t n = m_chunks.size();
+    for (size_t i = 0; i < n; ++i) {
+        auto& c = m_chunks[(m_next + i) % n];
+        if (c.use_count() == 1 && !c->data.shared()) {
+            // see SharedBuffer::unique()
+            std::atomic_thread_fence(std::memory_order_acquire);
+            m_next = (m_next + i + 1) % n;
+            return c;
+        }
+    }
+
+    auto ret = std::make_shared<AudioData>();
+    if (n < m_max_chunks)
+        m_chunks.push_back(ret);
+    return ret;
+}
+
+
 AudioData& AudioData::operator+=(const AudioData& v)
 {
     if (format == AudioFormat::RawFile || v.format == AudioFormat::RawFile || v.format == AudioFormat::Unknown || v.data.empty())
@@ -24,13 +24,14 @@ int SizeOf(AudioFormat f);
 int GetBitCount(AudioFormat f);
 
 
+// copying AudioData doesn't copy the samples. they are shared until either side modifies them (see SharedBuffer).
 class AudioData
 {
 public:
     AudioFormat format = AudioFormat::Unknown;
     int frequency = 0;
     int channels = 0;
-    RawVector<char> data;
+    SharedBuffer<char> data;
 
 public:
     static std::shared_ptr<AudioData> create(std::istream& is);
@@ -50,17 +51,36 @@ public:
     void* allocateSample(size_t num_samples);
     size_t getSampleLength() const;
     double getDuration() const;
+    // shares the samples. pos and len are in samples (not frames).
+    AudioData slice(size_t pos, size_t len) const;
 
     bool convertFormat(AudioData& dst, AudioFormat fmt) const;
     void convertToMono();
     void increaseChannels(int n); // must be mono before call
     double resample(AudioData& dst, int frequency, int length, double pos = 0.0) const;
 
-    int toFloat(float *dst, int pos = 0, int len = -1, bool multiply = false);
-    double resampleFloat(float *dst, int frequency, int channels, int length, double pos = 0.0);
+    int toFloat(float *dst, int pos = 0, int len = -1, bool multiply = false) const;
+    double resampleFloat(float *dst, int frequency, int channels, int length, double pos = 0.0) const;
 
     AudioData& operator+=(const AudioData& v);
 };
 using AudioDataPtr = std::shared_ptr<AudioData>;
 
+// recycles chunks for hooks that capture on the host's audio thread.
+// get() returns a chunk nobody else references any more. filling it within its capacity doesn't allocate,
+// so once the pool has warmed up an update makes no heap allocation as long as the consumer keeps up.
+// not thread safe. the chunks can be released on any thread.
+class AudioDataPool
+{
+public:
+    AudioDataPool(size_t max_chunks = 32);
+    // a new chunk that is not pooled if all max_chunks are in use
+    AudioDataPtr get();
+
+private:
+    std::vector<AudioDataPtr> m_chunks;
+    size_t m_max_chunks;
+    size_t m_next = 0;
+};
+
 } // namespace rt
@@ -1,4 +1,6 @@
 #pragma once
+#include <iosfwd>
+#include <memory>
 #include "rtAudioData.h"
 
 namespace rt {
@@ -16,4 +18,58 @@ bool ExportWave(const AudioData& ad, const char* path);
 bool ExportOgg(const AudioData& ad, std::ostream& os, const OggSettings& settings = {});
 bool ExportOgg(const AudioData& ad, const char* path, const OggSettings& settings = {});
 
+
+// writers that encode audio as it arrives, so that the file is complete as soon as the stream ends.
+// the format is taken from the first chunk. following chunks are converted to it.
+
+class WaveWriter
+{
+public:
+    WaveWriter(const WaveWriter&) = delete;
+    WaveWriter& operator=(const WaveWriter&) = delete;
+
+    WaveWriter(std::ostream& os);
+    WaveWriter(const char *path);
+    ~WaveWriter();
+
+    bool isOpened() const;
+    bool write(const AudioData& chunk);
+    // fills the sizes in the header. returns false if nothing has been written.
+    bool close();
+
+private:
+    std::unique_ptr<std::ostream> m_file;
+    std::ostream *m_os = nullptr;
+    std::streamoff m_begin = 0;
+    AudioFormat m_format = AudioFormat::Unknown;
+    int m_frequency = 0;
+    int m_channels = 0;
+    size_t m_data_size = 0;
+    bool m_closed = false;
+};
+
+class OggWriter
+{
+public:
+    OggWriter(const OggWriter&) = delete;
+    OggWriter& operator=(const OggWriter&) = delete;
+
+    OggWriter(std::ostream& os, const OggSettings& settings = {});
+    OggWriter(const char *path, const OggSettings& settings = {});
+    ~OggWriter();
+
+    bool isOpened() const;
+    bool write(const AudioData& chunk);
+    // flushes the encoder and writes the end of stream. returns false if nothing has been written.
+    bool close();
+
+private:
+    struct Encoder;
+    std::unique_ptr<std::ostream> m_file;
+    std::ostream *m_os = nullptr;
+    OggSettings m_settings;
+    std::unique_ptr<Encoder> m_encoder;
+    bool m_closed = false;
+};
+
 } // namespace rt
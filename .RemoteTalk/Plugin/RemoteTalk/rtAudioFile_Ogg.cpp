@@ -15,10 +15,22 @@ namespace rt {
 
 bool ExportOgg(const AudioData& ad, std::ostream& os, const OggSettings& settings)
 {
-#ifdef rtEnableOgg
-    if (ad.channels == 0 || ad.format == AudioFormat::RawFile)
+    OggWriter writer(os, settings);
+    return writer.write(ad) && writer.close();
+}
+
+bool ExportOgg(const AudioData& ad, const char *path, const OggSettings& settings)
+{
+    OggWriter writer(path, settings);
+    if (!writer.isOpened())
         return false;
+    return writer.write(ad) && writer.close();
+}
 
+
+#ifdef rtEnableOgg
+struct OggWriter::Encoder
+{
     vorbis_info         vo_info;
     vorbis_comment      vo_comment;
     vorbis_dsp_state    vo_dsp;
@@ -26,17 +38,27 @@ bool ExportOgg(const AudioData& ad, std::ostream& os, const OggSettings& setting
     ogg_stream_state    og_stream;
     ogg_page            og_page;
 
-    vorbis_info_init(&vo_info);
-    if (vorbis_encode_init_vbr(&vo_info, ad.channels, ad.frequency, settings.quality) != 0)
-        return false;
-    vorbis_comment_init(&vo_comment);
-    vorbis_analysis_init(&vo_dsp, &vo_info);
-    vorbis_block_init(&vo_dsp, &vo_block);
-
-    static int s_serial = 0;
-    ogg_stream_init(&og_stream, ++s_serial);
+    std::ostream& os;
+    int frequency;
+    int channels;
+    bool valid = false;
 
+    Encoder(std::ostream& os_, const AudioData& first, const OggSettings& settings)
+        : os(os_), frequency(first.frequency), channels(first.channels)
     {
+        vorbis_info_init(&vo_info);
+        if (vorbis_encode_init_vbr(&vo_info, channels, frequency, settings.quality) != 0) {
+            vorbis_info_clear(&vo_info);
+            return;
+        }
+        vorbis_comment_init(&vo_comment);
+        vorbis_analysis_init(&vo_dsp, &vo_info);
+        vorbis_block_init(&vo_dsp, &vo_block);
+
+        static std::atomic_int s_serial{ 0 };
+        ogg_stream_init(&og_stream, ++s_serial);
+        valid = true;
+
         ogg_packet og_header, og_header_comm, og_header_code;
         vorbis_analysis_headerout(&vo_dsp, &vo_comment, &og_header, &og_header_comm, &og_header_code);
         ogg_stream_packetin(&og_stream, &og_header);
@@ -53,20 +75,53 @@ bool ExportOgg(const AudioData& ad, std::ostream& os, const OggSettings& setting
         }
     }
 
+    ~Encoder()
+    {
+        if (!valid)
+            return;
+        ogg_stream_clear(&og_stream);
+        vorbis_block_clear(&vo_block);
+        vorbis_dsp_clear(&vo_dsp);
+        vorbis_comment_clear(&vo_comment);
+        vorbis_info_clear(&vo_info);
+    }
 
-    int sample_len = (int)ad.getSampleLength() / ad.channels;
-
-    auto convert_block = [&](const auto *src, int pos, int len) -> int {
-        len = std::min(len, sample_len - pos);
-        float **buffer = vorbis_analysis_buffer(&vo_dsp, len);
-        for (int bi = 0; bi < len; ++bi) {
-            for (int ci = 0; ci < ad.channels; ++ci)
-                buffer[ci][bi] = src[(bi*ad.channels + ci) + (pos * ad.channels)];
+    void encode(const AudioData& ad)
+    {
+        int sample_len = (int)ad.getSampleLength() / channels;
+
+        auto convert_block = [&](const auto *src, int pos, int len) -> int {
+            len = std::min(len, sample_len - pos);
+            float **buffer = vorbis_analysis_buffer(&vo_dsp, len);
+            for (int bi = 0; bi < len; ++bi) {
+                for (int ci = 0; ci < channels; ++ci)
+                    buffer[ci][bi] = src[(bi*channels + ci) + (pos * channels)];
+            }
+            return len;
+        };
+
+        const int block_size = 4096;
+        int sample_pos = 0;
+        while (sample_pos < sample_len) {
+            int len = 0;
+            switch (ad.format) {
+            case AudioFormat::U8:  len = convert_block(ad.get<unorm8n>(), sample_pos, block_size); break;
+            case AudioFormat::S16: len = convert_block(ad.get<snorm16>(), sample_pos, block_size); break;
+            case AudioFormat::S24: len = convert_block(ad.get<snorm24>(), sample_pos, block_size); break;
+            case AudioFormat::S32: len = convert_block(ad.get<snorm32>(), sample_pos, block_size); break;
+            case AudioFormat::F32: len = convert_block(ad.get<float>()  , sample_pos, block_size); break;
+            default: break;
+            }
+            if (len == 0)
+                break;
+            pageOut(len);
+            sample_pos += len;
         }
-        return len;
-    };
+    }
 
-    auto page_out = [&](int len) {
+    // 0 marks the end of stream
+    void pageOut(int len)
+    {
         if (vorbis_analysis_wrote(&vo_dsp, len) == 0) {
             while (vorbis_analysis_blockout(&vo_dsp, &vo_block) == 1) {
                 vorbis_analysis(&vo_block, nullptr);
@@ -87,48 +142,80 @@ bool ExportOgg(const AudioData& ad, std::ostream& os, const OggSettings& setting
                 }
             }
         }
-    };
-
-    const int block_size = 4096;
-    int sample_pos = 0;
-    for (;;) {
-        int len = 0;
-        switch (ad.format) {
-        case AudioFormat::U8:  len = convert_block(ad.get<unorm8n>(), sample_pos, block_size); break;
-        case AudioFormat::S16: len = convert_block(ad.get<snorm16>(), sample_pos, block_size); break;
-        case AudioFormat::S24: len = convert_block(ad.get<snorm24>(), sample_pos, block_size); break;
-        case AudioFormat::S32: len = convert_block(ad.get<snorm32>(), sample_pos, block_size); break;
-        case AudioFormat::F32: len = convert_block(ad.get<float>()  , sample_pos, block_size); break;
-        default: break;
-        }
-        page_out(len);
-        sample_pos += len;
-        if (len == 0)
-            break;
     }
-
-    ogg_stream_clear(&og_stream);
-    vorbis_block_clear(&vo_block);
-    vorbis_dsp_clear(&vo_dsp);
-    vorbis_comment_clear(&vo_comment);
-    vorbis_info_clear(&vo_info);
-    return true;
+};
 #else
-    return false;
+struct OggWriter::Encoder {};
 #endif
+
+
+OggWriter::OggWriter(std::ostream& os, const OggSettings& settings)
+    : m_os(&os)
+    , m_settings(settings)
+{
 }
 
-bool ExportOgg(const AudioData& ad, const char *path, const OggSettings& settings)
+OggWriter::OggWriter(const char *path, const OggSettings& settings)
+    : m_settings(settings)
 {
 #if _WIN32
     auto wpath = ToWCS(path);
-    std::ofstream os(wpath.c_str(), std::ios::binary);
+    m_file.reset(new std::ofstream(wpath.c_str(), std::ios::binary));
+#else
+    m_file.reset(new std::ofstream(path, std::ios::binary));
+#endif
+    if (*m_file)
+        m_os = m_file.get();
+}
+
+OggWriter::~OggWriter()
+{
+    close();
+}
+
+bool OggWriter::isOpened() const
+{
+    return m_os != nullptr;
+}
+
+bool OggWriter::write(const AudioData& chunk)
+{
+#ifdef rtEnableOgg
+    if (!m_os || m_closed)
+        return false;
+
+    if (!m_encoder) {
+        if (chunk.channels == 0 || chunk.format == AudioFormat::Unknown || chunk.format == AudioFormat::RawFile)
+            return false;
+        m_encoder.reset(new Encoder(*m_os, chunk, m_settings));
+    }
+    auto& enc = *m_encoder;
+    if (!enc.valid || chunk.frequency != enc.frequency || chunk.channels != enc.channels)
+        return false;
+
+    enc.encode(chunk);
+    return !!*m_os;
 #else
-    std::ofstream os(path, std::ios::binary);
+    return false;
 #endif
-    if (!os)
+}
+
+bool OggWriter::close()
+{
+#ifdef rtEnableOgg
+    if (!m_os || m_closed)
         return false;
-    return ExportOgg(ad, os, settings);
+    m_closed = true;
+    if (!m_encoder || !m_encoder->valid)
+        return false;
+
+    m_encoder->pageOut(0);
+    m_encoder.reset();
+    m_os->flush();
+    return !!*m_os;
+#else
+    return false;
+#endif
 }
 
 } // namespace rt
@@ -65,40 +65,106 @@ bool ImportWave(AudioData& ad, const char *path)
 
 bool ExportWave(const AudioData& ad, std::ostream& os)
 {
-    if (ad.channels == 0 || ad.format == AudioFormat::RawFile)
+    WaveWriter writer(os);
+    return writer.write(ad) && writer.close();
+}
+
+bool ExportWave(const AudioData& ad, const char *path)
+{
+    WaveWriter writer(path);
+    if (!writer.isOpened())
         return false;
+    return writer.write(ad) && writer.close();
+}
 
-    WaveHeader header;
-    header.nSampleRate = ad.frequency;
-    header.shCh = (int16_t)ad.channels;
-    header.shBitPerSample = (int16_t)GetBitCount(ad.format);
-    header.shBlockSize = (int16_t)(SizeOf(ad.format) * ad.channels);
-    header.nBytePerSec = ad.frequency * header.shBlockSize;
-    header.shFmtID = ad.format == AudioFormat::F32 ? 3 : 1;
-    os.write((char*)&header, sizeof(header));
-    os.write(ad.data.data(), ad.data.size());
-
-    uint32_t total_size = (uint32_t)(ad.data.size() + sizeof(WaveHeader));
-    uint32_t filesize = total_size - 8;
-    uint32_t datasize = total_size - 44;
-    os.seekp(4);
-    os.write((char*)&filesize, 4);
-    os.seekp(40);
-    os.write((char*)&datasize, 4);
-    return true;
+
+WaveWriter::WaveWriter(std::ostream& os)
+    : m_os(&os)
+{
 }
 
-bool ExportWave(const AudioData& ad, const char *path)
+WaveWriter::WaveWriter(const char *path)
 {
 #if _WIN32
     auto wpath = ToWCS(path);
-    std::ofstream os(wpath.c_str(), std::ios::binary);
+    m_file.reset(new std::ofstream(wpath.c_str(), std::ios::binary));
 #else
-    std::ofstream os(path, std::ios::binary);
+    m_file.reset(new std::ofstream(path, std::ios::binary));
 #endif
-    if (!os)
+    if (*m_file)
+        m_os = m_file.get();
+}
+
+WaveWriter::~WaveWriter()
+{
+    close();
+}
+
+bool WaveWriter::isOpened() const
+{
+    return m_os != nullptr;
+}
+
+bool WaveWriter::write(const AudioData& chunk)
+{
+    if (!m_os || m_closed)
+        return false;
+
+    if (m_format == AudioFormat::Unknown) {
+        if (chunk.channels == 0 || chunk.format == AudioFormat::Unknown || chunk.format == AudioFormat::RawFile)
+            return false;
+        m_format = chunk.format;
+        m_frequency = chunk.frequency;
+        m_channels = chunk.channels;
+
+        // sizes are filled by close()
+        WaveHeader header;
+        header.nSampleRate = m_frequency;
+        header.shCh = (int16_t)m_channels;
+        header.shBitPerSample = (int16_t)GetBitCount(m_format);
+        header.shBlockSize = (int16_t)(SizeOf(m_format) * m_channels);
+        header.nBytePerSec = m_frequency * header.shBlockSize;
+        header.shFmtID = m_format == AudioFormat::F32 ? 3 : 1;
+        m_begin = m_os->tellp();
+        m_os->write((char*)&header, sizeof(header));
+    }
+    else if (chunk.frequency != m_frequency || chunk.channels != m_channels) {
         return false;
-    return ExportWave(ad, os);
+    }
+
+    if (chunk.format == m_format) {
+        m_os->write(chunk.data.data(), chunk.data.size());
+        m_data_size += chunk.data.size();
+    }
+    else {
+        AudioData tmp;
+        if (!chunk.convertFormat(tmp, m_format))
+            return false;
+        m_os->write(tmp.data.data(), tmp.data.size());
+        m_data_size += tmp.data.size();
+    }
+    return !!*m_os;
+}
+
+bool WaveWriter::close()
+{
+    if (!m_os || m_closed)
+        return false;
+    m_closed = true;
+    if (m_format == AudioFormat::Unknown)
+        return false;
+
+    uint32_t total_size = (uint32_t)(m_data_size + sizeof(WaveHeader));
+    uint32_t filesize = total_size - 8;
+    uint32_t datasize = total_size - 44;
+    auto end = m_os->tellp();
+    m_os->seekp(m_begin + 4);
+    m_os->write((char*)&filesize, 4);
+    m_os->seekp(m_begin + 40);
+    m_os->write((char*)&datasize, 4);
+    m_os->seekp(end);
+    m_os->flush();
+    return !!*m_os;
 }
 
 } // namespace rt
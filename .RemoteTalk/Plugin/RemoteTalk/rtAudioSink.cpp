@@ -0,0 +1,209 @@
+#include "pch.h"
+#include "rtFoundation.h"
+#include "rtAudioSink.h"
+
+namespace rt {
+
+PlaybackSink::PlaybackSink(PlaybackBuffer& buffer)
+    : m_buffer(buffer)
+{
+}
+
+void PlaybackSink::write(const AudioData& chunk)
+{
+    m_buffer.push(chunk);
+}
+
+bool PlaybackSink::finish(bool /*succeeded*/)
+{
+    m_buffer.finish();
+    return true;
+}
+
+
+WaveSink::WaveSink(const std::string& path)
+    : m_writer(path.c_str())
+{
+    if (!m_writer.isOpened()) {
+        rtLogError("WaveSink: failed to open %s\n", path.c_str());
+        m_failed = true;
+    }
+}
+
+void WaveSink::write(const AudioData& chunk)
+{
+    if (!m_failed && !m_writer.write(chunk))
+        m_failed = true;
+}
+
+bool WaveSink::finish(bool /*succeeded*/)
+{
+    // an interrupted talk still makes a valid file of what has been received
+    return m_writer.close() && !m_failed;
+}
+
+
+OggSink::OggSink(const std::string& path, const OggSettings& settings)
+    : m_writer(path.c_str(), settings)
+{
+    if (!m_writer.isOpened()) {
+        rtLogError("OggSink: failed to open %s\n", path.c_str());
+        m_failed = true;
+    }
+}
+
+void OggSink::write(const AudioData& chunk)
+{
+    if (!m_failed && !m_writer.write(chunk))
+        m_failed = true;
+}
+
+bool OggSink::finish(bool /*succeeded*/)
+{
+    return m_writer.close() && !m_failed;
+}
+
+
+CallbackSink::CallbackSink(const WriteCallback& on_write, const FinishCallback& on_finish)
+    : m_on_write(on_write)
+    , m_on_finish(on_finish)
+{
+}
+
+void CallbackSink::write(const AudioData& chunk)
+{
+    if (m_on_write)
+        m_on_write(chunk);
+}
+
+bool CallbackSink::finish(bool succeeded)
+{
+    return m_on_finish ? m_on_finish(succeeded) : true;
+}
+
+
+SinkGraph::SinkGraph(ThreadPool& pool)
+    : m_pool(pool)
+{
+}
+
+SinkGraph::~SinkGraph()
+{
+    finish(false);
+    wait();
+}
+
+void SinkGraph::add(const AudioSinkPtr& sink)
+{
+    if (!sink)
+        return;
+    auto node = std::make_shared<Node>();
+    node->sink = sink;
+    node->is_inline = sink->isInline();
+
+    lock_t lock(m_mutex);
+    m_nodes.push_back(node);
+}
+
+size_t SinkGraph::getSinkCount() const
+{
+    lock_t lock(m_mutex);
+    return m_nodes.size();
+}
+
+void SinkGraph::push(const AudioDataPtr& chunk)
+{
+    if (!chunk || chunk->data.empty())
+        return;
+    enqueue(chunk);
+}
+
+void SinkGraph::finish(bool succeeded)
+{
+    {
+        lock_t lock(m_mutex);
+        if (m_finishing)
+            return;
+        m_finishing = true;
+        m_stream_succeeded = succeeded;
+    }
+    enqueue(nullptr);
+}
+
+bool SinkGraph::wait()
+{
+    lock_t lock(m_mutex);
+    m_cond.wait(lock, [this]() {
+        for (auto& node : m_nodes) {
+            if (!node->finished && (m_finishing || node->scheduled))
+                return false;
+        }
+        return true;
+    });
+
+    bool ret = true;
+    for (auto& node : m_nodes)
+        ret = ret && node->succeeded;
+    return ret;
+}
+
+void SinkGraph::enqueue(const AudioDataPtr& chunk)
+{
+    std::vector<NodePtr> to_schedule, to_write;
+    {
+        lock_t lock(m_mutex);
+        for (auto& node : m_nodes) {
+            if (node->is_inline) {
+                to_write.push_back(node);
+                continue;
+            }
+            node->queue.push_back(chunk);
+            // at most one job per sink keeps its chunks in order
+            if (!node->scheduled) {
+                node->scheduled = true;
+                to_schedule.push_back(node);
+            }
+        }
+    }
+    for (auto& node : to_schedule)
+        m_pool.enqueue(ThreadPool::JobType::Short, [this, node]() { drain(node); });
+
+    for (auto& node : to_write) {
+        if (chunk) {
+            node->sink->write(*chunk);
+        }
+        else {
+            bool ok = node->sink->finish(m_stream_succeeded);
+            lock_t lock(m_mutex);
+            node->succeeded = ok;
+            node->finished = true;
+            m_cond.notify_all();
+        }
+    }
+}
+
+void SinkGraph::drain(NodePtr node)
+{
+    lock_t lock(m_mutex);
+    while (!node->queue.empty()) {
+        auto chunk = std::move(node->queue.front());
+        node->queue.pop_front();
+        lock.unlock();
+
+        if (chunk) {
+            node->sink->write(*chunk);
+            lock.lock();
+        }
+        else {
+            bool ok = node->sink->finish(m_stream_succeeded);
+            lock.lock();
+            node->succeeded = ok;
+            node->finished = true;
+        }
+    }
+    node->scheduled = false;
+    // notify while locked. the graph may be destroyed as soon as wait() returns.
+    m_cond.notify_all();
+}
+
+} // namespace rt
@@ -0,0 +1,134 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include "rtAudioData.h"
+#include "rtAudioFile.h"
+#include "rtPlaybackBuffer.h"
+#include "rtThreadPool.h"
+
+namespace rt {
+
+// consumer of the audio of a talk. receives chunks in order as they arrive.
+// chunks are shared by all sinks of a SinkGraph and must not be modified.
+class AudioSink
+{
+public:
+    virtual ~AudioSink() {}
+    virtual void write(const AudioData& chunk) = 0;
+    // end of stream. succeeded is false if the talk failed or was cancelled.
+    // returns false if the sink itself failed.
+    virtual bool finish(bool succeeded) = 0;
+    // true if write() never blocks and is cheap. SinkGraph calls it on the producer's thread then.
+    virtual bool isInline() const { return false; }
+};
+using AudioSinkPtr = std::shared_ptr<AudioSink>;
+
+class PlaybackSink : public AudioSink
+{
+public:
+    // buffer must be reset() before the stream begins
+    PlaybackSink(PlaybackBuffer& buffer);
+    void write(const AudioData& chunk) override;
+    bool finish(bool succeeded) override;
+    // PlaybackBuffer::push() is wait-free
+    bool isInline() const override { return true; }
+
+private:
+    PlaybackBuffer& m_buffer;
+};
+
+class WaveSink : public AudioSink
+{
+public:
+    WaveSink(const std::string& path);
+    void write(const AudioData& chunk) override;
+    bool finish(bool succeeded) override;
+
+private:
+    WaveWriter m_writer;
+    bool m_failed = false;
+};
+
+class OggSink : public AudioSink
+{
+public:
+    OggSink(const std::string& path, const OggSettings& settings = {});
+    void write(const AudioData& chunk) override;
+    bool finish(bool succeeded) override;
+
+private:
+    OggWriter m_writer;
+    bool m_failed = false;
+};
+
+// for analyzers and such
+class CallbackSink : public AudioSink
+{
+public:
+    using WriteCallback = std::function<void(const AudioData&)>;
+    using FinishCallback = std::function<bool(bool succeeded)>;
+
+    CallbackSink(const WriteCallback& on_write, const FinishCallback& on_finish = {});
+    void write(const AudioData& chunk) override;
+    bool finish(bool succeeded) override;
+
+private:
+    WriteCallback m_on_write;
+    FinishCallback m_on_finish;
+};
+
+
+// delivers the chunks of a talk to multiple sinks.
+// inline sinks (e.g. playback) are written by push() itself, so they never wait for a worker.
+// the others process their chunks in order on the pool, in parallel with each other and with the producer.
+// a slow sink (e.g. an encoder) doesn't delay the others. all of them finish shortly after the stream ends.
+// the pool should be dedicated to sinks: a job that waits for the graph must not take the workers it needs.
+class SinkGraph
+{
+public:
+    SinkGraph(const SinkGraph&) = delete;
+    SinkGraph& operator=(const SinkGraph&) = delete;
+
+    SinkGraph(ThreadPool& pool);
+    // waits for the sinks
+    ~SinkGraph();
+
+    // must be called before the first push()
+    void add(const AudioSinkPtr& sink);
+    size_t getSinkCount() const;
+
+    // the chunk is shared, not copied
+    void push(const AudioDataPtr& chunk);
+    void finish(bool succeeded);
+    // waits until all sinks have processed all chunks and finished. returns false if any sink failed.
+    bool wait();
+
+private:
+    struct Node
+    {
+        AudioSinkPtr sink;
+        bool is_inline = false;
+        std::deque<AudioDataPtr> queue; // null is the end of stream. unused if is_inline
+        bool scheduled = false;
+        bool finished = false;
+        bool succeeded = true;
+    };
+    using NodePtr = std::shared_ptr<Node>;
+    using lock_t = std::unique_lock<std::mutex>;
+
+    void enqueue(const AudioDataPtr& chunk);
+    void drain(NodePtr node);
+
+    ThreadPool& m_pool;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<NodePtr> m_nodes;
+    bool m_stream_succeeded = false;
+    bool m_finishing = false;
+};
+
+} // namespace rt
@@ -0,0 +1,107 @@
+#include "pch.h"
+#include <cmath>
+#include <algorithm>
+#include "rtHistogram.h"
+
+namespace rt {
+
+// position of the most significant bit. v must not be 0.
+static inline int MSB(uint64_t v)
+{
+#ifdef _MSC_VER
+    unsigned long r;
+    _BitScanReverse64(&r, v);
+    return (int)r;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+Histogram::Histogram(int significant_bits, uint64_t max_value)
+    : m_sub_bits(std::min(std::max(significant_bits, 2), 16))
+    , m_max_value(std::max<uint64_t>(max_value, 1))
+{
+    m_counts.resize(indexOf(m_max_value) + 1);
+    reset();
+}
+
+void Histogram::reset()
+{
+    std::fill(m_counts.begin(), m_counts.end(), 0);
+    m_total = 0;
+    m_min = ~0ull;
+    m_max = 0;
+    m_sum = 0.0;
+}
+
+// values below 2^sub_bits have their own buckets.
+// above that, value >> shift is in [2^(sub_bits-1), 2^sub_bits) and each shift adds 2^(sub_bits-1) buckets.
+size_t Histogram::indexOf(uint64_t value) const
+{
+    if (value < (1ull << m_sub_bits))
+        return (size_t)value;
+    int shift = MSB(value) - m_sub_bits + 1;
+    uint64_t half = 1ull << (m_sub_bits - 1);
+    return (size_t)(shift * half + (value >> shift));
+}
+
+uint64_t Histogram::lowestAt(size_t index) const
+{
+    uint64_t half = 1ull << (m_sub_bits - 1);
+    if (index < half * 2)
+        return index;
+    int shift = (int)(index / half) - 1;
+    return (index - shift * half) << shift;
+}
+
+uint64_t Histogram::highestAt(size_t index) const
+{
+    uint64_t half = 1ull << (m_sub_bits - 1);
+    int shift = index < half * 2 ? 0 : (int)(index / half) - 1;
+    return lowestAt(index) + (1ull << shift) - 1;
+}
+
+void Histogram::record(uint64_t value, uint64_t count)
+{
+    value = std::min(value, m_max_value);
+    m_counts[indexOf(value)] += count;
+    m_total += count;
+    m_min = std::min(m_min, value);
+    m_max = std::max(m_max, value);
+    m_sum += (double)value * count;
+}
+
+bool Histogram::merge(const Histogram& v)
+{
+    if (v.m_sub_bits != m_sub_bits || v.m_max_value != m_max_value)
+        return false;
+    for (size_t i = 0; i < m_counts.size(); ++i)
+        m_counts[i] += v.m_counts[i];
+    m_total += v.m_total;
+    m_min = std::min(m_min, v.m_min);
+    m_max = std::max(m_max, v.m_max);
+    m_sum += v.m_sum;
+    return true;
+}
+
+uint64_t Histogram::getCount() const { return m_total; }
+uint64_t Histogram::getMin() const { return m_total > 0 ? m_min : 0; }
+uint64_t Histogram::getMax() const { return m_max; }
+double Histogram::getMean() const { return m_total > 0 ? m_sum / m_total : 0.0; }
+
+uint64_t Histogram::getPercentile(double p) const
+{
+    if (m_total == 0)
+        return 0;
+    p = std::min(std::max(p, 0.0), 100.0);
+    auto target = std::max<uint64_t>((uint64_t)std::ceil(p / 100.0 * m_total), 1);
+    uint64_t n = 0;
+    for (size_t i = 0; i < m_counts.size(); ++i) {
+        n += m_counts[i];
+        if (n >= target)
+            return std::min(highestAt(i), m_max);
+    }
+    return m_max;
+}
+
+} // namespace rt
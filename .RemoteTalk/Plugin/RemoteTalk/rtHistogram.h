@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace rt {
+
+// high dynamic range histogram of integer values (e.g. latency in microseconds).
+// buckets are log-linear: every power of two range is split into the same number of sub-buckets,
+// so the relative error is constant (< 1 / 2^(significant_bits-1)) from 1 to max_value.
+// recording is O(1) and doesn't allocate. record on one histogram per thread and merge() them afterwards.
+class Histogram
+{
+public:
+    Histogram(int significant_bits = 10, uint64_t max_value = 3600ull * 1000 * 1000);
+    void reset();
+
+    // values larger than max_value are clamped
+    void record(uint64_t value, uint64_t count = 1);
+    // adds counts of v. v must have the same settings.
+    bool merge(const Histogram& v);
+
+    uint64_t getCount() const;
+    uint64_t getMin() const;
+    uint64_t getMax() const;
+    double getMean() const;
+    // p: [0, 100]. returns the highest value equivalent to the bucket.
+    uint64_t getPercentile(double p) const;
+
+private:
+    size_t indexOf(uint64_t value) const;
+    uint64_t lowestAt(size_t index) const;
+    uint64_t highestAt(size_t index) const;
+
+    int m_sub_bits = 0;
+    uint64_t m_max_value = 0;
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total = 0;
+    uint64_t m_min = 0;
+    uint64_t m_max = 0;
+    double m_sum = 0.0;
+};
+
+} // namespace rt
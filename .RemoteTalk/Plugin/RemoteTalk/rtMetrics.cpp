@@ -0,0 +1,264 @@
+#include "pch.h"
+#include <algorithm>
+#include "rtMetrics.h"
+
+namespace rt {
+
+const double TalkServerMetrics::BucketBounds[BucketCount - 1] = {
+    0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0,
+};
+
+static const int StatusCodes[] = { 200, 400, 404, 500, 503 };
+
+const char* TalkServerMetrics::GetPathName(Path v)
+{
+    switch (v) {
+    case Path::Ready: return "/ready";
+    case Path::Talk: return "/talk";
+    case Path::Stop: return "/stop";
+    case Path::Stats: return "/stats";
+    case Path::Channel: return "/channel";
+    case Path::Metrics: return "/metrics";
+    default: return "other";
+    }
+}
+
+TalkServerMetrics::Path TalkServerMetrics::GetPath(const std::string& path)
+{
+    for (int i = 0; i < (int)Path::Other; ++i) {
+        if (path == GetPathName((Path)i))
+            return (Path)i;
+    }
+    return Path::Other;
+}
+
+const char* TalkServerMetrics::GetStatusName(int index)
+{
+    static const char* s_names[] = { "200", "400", "404", "500", "503", "other" };
+    return index >= 0 && index < StatusCount ? s_names[index] : s_names[StatusCount - 1];
+}
+
+int TalkServerMetrics::GetStatusIndex(int status)
+{
+    for (int i = 0; i < StatusCount - 1; ++i) {
+        if (StatusCodes[i] == status)
+            return i;
+    }
+    return StatusCount - 1;
+}
+
+const char* TalkServerMetrics::GetTimerName(Timer v)
+{
+    switch (v) {
+    case Timer::QueueWait: return "queue_wait";
+    case Timer::TimeToFirstAudio: return "time_to_first_audio";
+    case Timer::Synthesis: return "synthesis";
+    case Timer::Stream: return "stream";
+    default: return "unknown";
+    }
+}
+
+
+uint64_t TalkServerMetrics::Snapshot::getRequests(Path path, int status) const
+{
+    return values[RequestsBegin + (int)path * StatusCount + GetStatusIndex(status)];
+}
+
+int64_t TalkServerMetrics::Snapshot::getStreamsInFlight() const
+{
+    // decrements are stored as wrapped-around adds. the sum is correct as a signed value.
+    return (int64_t)values[StreamsInFlight];
+}
+
+uint64_t TalkServerMetrics::Snapshot::getFramesStreamed() const
+{
+    return values[FramesStreamed];
+}
+
+uint64_t TalkServerMetrics::Snapshot::getBytesStreamed() const
+{
+    return values[BytesStreamed];
+}
+
+uint64_t TalkServerMetrics::Snapshot::getTimerBucket(Timer t, int bucket) const
+{
+    return values[TimersBegin + (int)t * TimerStride + bucket];
+}
+
+uint64_t TalkServerMetrics::Snapshot::getTimerCount(Timer t) const
+{
+    return values[TimersBegin + (int)t * TimerStride + BucketCount];
+}
+
+double TalkServerMetrics::Snapshot::getTimerSum(Timer t) const
+{
+    return (double)values[TimersBegin + (int)t * TimerStride + BucketCount + 1] / 1000000.0;
+}
+
+std::string TalkServerMetrics::Snapshot::toPrometheus() const
+{
+    std::ostringstream os;
+    auto header = [&os](const char *name, const char *type, const char *help) {
+        os << "# HELP remotetalk_" << name << " " << help << "\n";
+        os << "# TYPE remotetalk_" << name << " " << type << "\n";
+    };
+
+    header("requests_total", "counter", "Requests by path and status code.");
+    for (int p = 0; p < PathCount; ++p) {
+        for (int s = 0; s < StatusCount; ++s) {
+            auto n = values[RequestsBegin + p * StatusCount + s];
+            if (n == 0)
+                continue;
+            os << "remotetalk_requests_total{path=\"" << GetPathName((Path)p) << "\",code=\"" << GetStatusName(s) << "\"} " << n << "\n";
+        }
+    }
+
+    header("queue_depth", "gauge", "Messages waiting for the host.");
+    os << "remotetalk_queue_depth " << queue_depth << "\n";
+    header("queued_chars", "gauge", "Text length of accepted but unfinished talks.");
+    os << "remotetalk_queued_chars " << queued_chars << "\n";
+    header("estimated_wait_seconds", "gauge", "Estimated wait of a new talk.");
+    os << "remotetalk_estimated_wait_seconds " << estimated_wait << "\n";
+    header("streams_in_flight", "gauge", "Talks streaming audio to clients.");
+    os << "remotetalk_streams_in_flight " << getStreamsInFlight() << "\n";
+    header("frames_streamed_total", "counter", "Audio frames sent to clients.");
+    os << "remotetalk_frames_streamed_total " << getFramesStreamed() << "\n";
+    header("bytes_streamed_total", "counter", "Audio bytes sent to clients.");
+    os << "remotetalk_bytes_streamed_total " << getBytesStreamed() << "\n";
+
+    static const char *s_help[] = {
+        "Time from receiving a talk to the host starting it.",
+        "Time from receiving a talk to sending the first audio.",
+        "Time from the host starting a talk to the end of captured audio.",
+        "Time the response stream of a talk was open.",
+    };
+    for (int t = 0; t < TimerCount; ++t) {
+        std::string name = std::string(GetTimerName((Timer)t)) + "_seconds";
+        header(name.c_str(), "histogram", s_help[t]);
+
+        uint64_t cumulative = 0;
+        for (int b = 0; b < BucketCount; ++b) {
+            cumulative += getTimerBucket((Timer)t, b);
+            os << "remotetalk_" << name << "_bucket{le=\"";
+            if (b < BucketCount - 1)
+                os << BucketBounds[b];
+            else
+                os << "+Inf";
+            os << "\"} " << cumulative << "\n";
+        }
+        os << "remotetalk_" << name << "_sum " << getTimerSum((Timer)t) << "\n";
+        os << "remotetalk_" << name << "_count " << getTimerCount((Timer)t) << "\n";
+    }
+    return os.str();
+}
+
+
+TalkServerMetrics::Shard::Shard()
+{
+    for (auto& v : values)
+        v.store(0, std::memory_order_relaxed);
+}
+
+TalkServerMetrics::TalkServerMetrics()
+{
+    // thread local shards are looked up by id, not by address. a new instance can reuse the address of a dead one.
+    static std::atomic<uint64_t> s_seed{ 0 };
+    m_id = ++s_seed;
+}
+
+TalkServerMetrics::~TalkServerMetrics()
+{
+    // threads still hold the shards. let them drop them (see getShard())
+    lock_t lock(m_mutex);
+    for (auto& shard : m_shards)
+        shard->orphaned = true;
+}
+
+TalkServerMetrics::Shard& TalkServerMetrics::getShard()
+{
+    thread_local std::map<uint64_t, ShardPtr> t_shards;
+    auto it = t_shards.find(m_id);
+    if (it != t_shards.end())
+        return *it->second;
+
+    // once per thread. drop the shards of destroyed instances on the way.
+    for (auto i = t_shards.begin(); i != t_shards.end();) {
+        if (i->second->orphaned)
+            i = t_shards.erase(i);
+        else
+            ++i;
+    }
+    auto shard = std::make_shared<Shard>();
+    t_shards[m_id] = shard;
+    {
+        lock_t lock(m_mutex);
+        m_shards.push_back(shard);
+    }
+    return *shard;
+}
+
+// only the owner thread writes a shard. no need for an atomic read-modify-write.
+static inline void Add(std::atomic<uint64_t>& dst, uint64_t v)
+{
+    dst.store(dst.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+void TalkServerMetrics::countRequest(const std::string& path, int status)
+{
+    Add(getShard().values[RequestsBegin + (int)GetPath(path) * StatusCount + GetStatusIndex(status)], 1);
+}
+
+void TalkServerMetrics::addStreamsInFlight(int v)
+{
+    Add(getShard().values[StreamsInFlight], (uint64_t)(int64_t)v);
+}
+
+void TalkServerMetrics::countFrame(size_t bytes)
+{
+    auto& shard = getShard();
+    Add(shard.values[FramesStreamed], 1);
+    Add(shard.values[BytesStreamed], bytes);
+}
+
+void TalkServerMetrics::recordTime(Timer t, std::chrono::steady_clock::duration v)
+{
+    double sec = std::chrono::duration<double>(v).count();
+    auto usec = (uint64_t)std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(v).count(), 0);
+
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && sec > BucketBounds[bucket])
+        ++bucket;
+
+    auto *values = getShard().values + TimersBegin + (int)t * TimerStride;
+    Add(values[bucket], 1);
+    Add(values[BucketCount], 1);
+    Add(values[BucketCount + 1], usec);
+}
+
+TalkServerMetrics::Snapshot TalkServerMetrics::getSnapshot()
+{
+    Snapshot ret;
+    lock_t lock(m_mutex);
+
+    // shards only referenced from here belong to finished threads. fold them so that the list doesn't grow.
+    for (auto& shard : m_shards) {
+        if (shard.use_count() == 1) {
+            for (int i = 0; i < ValueCount; ++i)
+                m_retired[i] += shard->values[i].load(std::memory_order_relaxed);
+            shard.reset();
+        }
+    }
+    m_shards.erase(
+        std::remove_if(m_shards.begin(), m_shards.end(), [](ShardPtr& p) { return !p; }),
+        m_shards.end());
+
+    for (int i = 0; i < ValueCount; ++i)
+        ret.values[i] = m_retired[i];
+    for (auto& shard : m_shards) {
+        for (int i = 0; i < ValueCount; ++i)
+            ret.values[i] += shard->values[i].load(std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+} // namespace rt
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+namespace rt {
+
+// counters and histograms of TalkServer, exported in the Prometheus text format ("/metrics").
+// every thread writes its own shard with relaxed atomics, so recording never takes a shared lock.
+// shards are summed only by getSnapshot(). shards of finished threads are folded into one at that time.
+class TalkServerMetrics
+{
+public:
+    enum class Path { Ready, Talk, Stop, Stats, Channel, Metrics, Other, Count };
+    enum class Timer { QueueWait, TimeToFirstAudio, Synthesis, Stream, Count };
+
+    static const int PathCount = (int)Path::Count;
+    static const int StatusCount = 6; // 200, 400, 404, 500, 503, others
+    static const int TimerCount = (int)Timer::Count;
+    static const int BucketCount = 14; // upper bounds of histogram buckets + Inf
+
+    static const char* GetPathName(Path v);
+    static Path GetPath(const std::string& path);
+    static const char* GetStatusName(int index);
+    static int GetStatusIndex(int status);
+    static const char* GetTimerName(Timer v);
+    static const double BucketBounds[BucketCount - 1]; // in seconds
+
+    // flat layout of all values
+    enum : int
+    {
+        RequestsBegin = 0,
+        StreamsInFlight = RequestsBegin + PathCount * StatusCount,
+        FramesStreamed,
+        BytesStreamed,
+        TimersBegin,
+        TimerStride = BucketCount + 2, // buckets, count, sum in microseconds
+        ValueCount = TimersBegin + TimerStride * TimerCount,
+    };
+
+    struct Snapshot
+    {
+        uint64_t values[ValueCount] = {};
+
+        // gauges that are owned by the server. filled by TalkServer::exportMetrics().
+        int queue_depth = 0;
+        int queued_chars = 0;
+        float estimated_wait = 0.0f;
+
+        uint64_t getRequests(Path path, int status) const;
+        int64_t getStreamsInFlight() const;
+        uint64_t getFramesStreamed() const;
+        uint64_t getBytesStreamed() const;
+        // bucket: [0, BucketCount). not cumulative.
+        uint64_t getTimerBucket(Timer t, int bucket) const;
+        uint64_t getTimerCount(Timer t) const;
+        double getTimerSum(Timer t) const; // in seconds
+
+        std::string toPrometheus() const;
+    };
+
+public:
+    TalkServerMetrics(const TalkServerMetrics&) = delete;
+    TalkServerMetrics& operator=(const TalkServerMetrics&) = delete;
+
+    TalkServerMetrics();
+    ~TalkServerMetrics();
+
+    void countRequest(const std::string& path, int status);
+    void addStreamsInFlight(int v);
+    void countFrame(size_t bytes);
+    void recordTime(Timer t, std::chrono::steady_clock::duration v);
+
+    Snapshot getSnapshot();
+
+private:
+    struct Shard
+    {
+        Shard();
+        std::atomic<uint64_t> values[ValueCount];
+        std::atomic_bool orphaned{ false }; // the owner TalkServerMetrics is destroyed
+    };
+    using ShardPtr = std::shared_ptr<Shard>;
+    using lock_t = std::unique_lock<std::mutex>;
+
+    Shard& getShard();
+
+    uint64_t m_id = 0;
+    std::mutex m_mutex;
+    std::vector<ShardPtr> m_shards;
+    uint64_t m_retired[ValueCount] = {};
+};
+
+} // namespace rt
@@ -0,0 +1,148 @@
+#include "pch.h"
+#include "rtFoundation.h"
+#include "rtPlaybackBuffer.h"
+
+namespace rt {
+
+PlaybackBuffer::PlaybackBuffer()
+{
+}
+
+PlaybackBuffer::~PlaybackBuffer()
+{
+    for (auto *block : m_blocks)
+        delete[] block;
+}
+
+float& PlaybackBuffer::at(size_t i) const
+{
+    return m_blocks[i / BlockSize][i % BlockSize];
+}
+
+void PlaybackBuffer::reset()
+{
+    m_length.store(0, std::memory_order_release);
+    m_frequency = 0;
+    m_channels = 0;
+    m_finished = false;
+    m_underruns = 0;
+}
+
+bool PlaybackBuffer::push(const AudioData& chunk)
+{
+    int n = (int)chunk.getSampleLength();
+    if (n == 0 || chunk.channels <= 0)
+        return true;
+
+    size_t length = m_length.load(std::memory_order_relaxed);
+    if (length == 0) {
+        m_frequency = chunk.frequency;
+        m_channels = chunk.channels;
+    }
+    else if (chunk.frequency != m_frequency || chunk.channels != m_channels) {
+        rtLogWarning("PlaybackBuffer::push(): format doesn't match\n");
+        return false;
+    }
+    if (length + n > (size_t)BlockSize * MaxBlocks) {
+        rtLogWarning("PlaybackBuffer::push(): buffer is full\n");
+        return false;
+    }
+
+    // convert block by block. samples become visible only after m_length is updated.
+    auto& src = chunk;
+    int pos = 0;
+    while (pos < n) {
+        size_t bi = (length + pos) / BlockSize;
+        size_t offset = (length + pos) % BlockSize;
+        if (!m_blocks[bi])
+            m_blocks[bi] = new float[BlockSize];
+        int len = std::min(n - pos, (int)(BlockSize - offset));
+        src.toFloat(m_blocks[bi] + offset, pos, len);
+        pos += len;
+    }
+    m_length.store(length + n, std::memory_order_release);
+    return true;
+}
+
+void PlaybackBuffer::finish()
+{
+    m_finished = true;
+}
+
+double PlaybackBuffer::read(float *dst, int frequency, int channels, int length, double pos)
+{
+    // m_finished must be read before m_length. otherwise samples pushed just before finish() could be missed.
+    bool finished = m_finished.load(std::memory_order_acquire);
+    size_t published = m_length.load(std::memory_order_acquire);
+    int src_ch = m_channels;
+    if (published == 0 || src_ch <= 0 || channels <= 0 || frequency <= 1) {
+        for (int i = 0; i < length; ++i)
+            dst[i] = 0.0f;
+        if (!finished && length > 0)
+            ++m_underruns;
+        return pos;
+    }
+
+    int src_freq = m_frequency;
+    int src_len = (int)(published / src_ch);
+    int dst_len = length / channels;
+    // same as AudioData::resample()
+    double step = (double)(src_freq - 1) / (double)(frequency - 1);
+    bool same_frequency = src_freq == frequency;
+
+    for (int i = 0; i < dst_len; ++i) {
+        double sp = same_frequency ? (double)(i + (int)pos) : (double)i * step + pos;
+        int si = (int)sp;
+        for (int ci = 0; ci < channels; ++ci) {
+            // mono is copied to all channels. otherwise channels are wrapped around.
+            int sc = ci % src_ch;
+            float v = 0.0f;
+            if (sp >= 0.0) {
+                if (same_frequency) {
+                    if (si < src_len)
+                        v = at((size_t)si * src_ch + sc);
+                }
+                else if (si < src_len - 1) {
+                    float st = (float)(sp - (double)si);
+                    v = lerp(at((size_t)si * src_ch + sc), at((size_t)(si + 1) * src_ch + sc), st);
+                }
+            }
+            dst[i * channels + ci] *= v;
+        }
+    }
+    for (int i = dst_len * channels; i < length; ++i)
+        dst[i] = 0.0f;
+
+    double end = same_frequency ? (double)dst_len + pos : step * dst_len + pos;
+    if (end > (double)src_len && !finished)
+        ++m_underruns;
+    return std::min(end, (double)src_len);
+}
+
+int PlaybackBuffer::getFrequency() const
+{
+    return m_frequency;
+}
+
+int PlaybackBuffer::getChannels() const
+{
+    return m_channels;
+}
+
+int PlaybackBuffer::getFrameLength() const
+{
+    int ch = m_channels;
+    return ch > 0 ? (int)(m_length.load(std::memory_order_acquire) / ch) : 0;
+}
+
+bool PlaybackBuffer::isFinished() const
+{
+    return m_finished;
+}
+
+int PlaybackBuffer::getUnderrunCount() const
+{
+    return m_underruns;
+}
+
+} // namespace rt
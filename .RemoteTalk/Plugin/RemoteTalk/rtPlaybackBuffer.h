@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include "rtAudioData.h"
+
+namespace rt {
+
+// audio passed from a receiving thread (producer) to an audio callback (consumer) without locks.
+// the producer converts samples to float and stores them in fixed size blocks that never move.
+// they are published by an atomic sample count, so the consumer is wait free and doesn't allocate.
+// single producer, single consumer.
+class PlaybackBuffer
+{
+public:
+    static const int BlockSize = 64 * 1024;  // in samples
+    static const int MaxBlocks = 4096;       // 268M samples. about 93 minutes of 48kHz mono
+
+    PlaybackBuffer(const PlaybackBuffer&) = delete;
+    PlaybackBuffer& operator=(const PlaybackBuffer&) = delete;
+
+    PlaybackBuffer();
+    ~PlaybackBuffer();
+
+    // producer side.
+    // reset() begins a new stream. it must not run concurrently with push().
+    // blocks are kept for the next stream. a consumer still reading the old stream just gets silence.
+    void reset();
+    // returns false if the format differs from the first chunk or the buffer is full.
+    bool push(const AudioData& chunk);
+    void finish();
+
+    // consumer side. same as AudioData::resampleFloat(): dst is multiplied by the samples.
+    // returns the new position in source frames. reading beyond published samples of an unfinished
+    // stream counts as an underrun and the position stays at the end of the published samples.
+    double read(float *dst, int frequency, int channels, int length, double pos);
+
+    int getFrequency() const;
+    int getChannels() const;
+    int getFrameLength() const; // published frames
+    bool isFinished() const;
+    int getUnderrunCount() const;
+
+private:
+    float& at(size_t i) const;
+
+    float *m_blocks[MaxBlocks] = {};
+    std::atomic<size_t> m_length{ 0 }; // published samples
+    std::atomic_int m_frequency{ 0 };
+    std::atomic_int m_channels{ 0 };
+    std::atomic_bool m_finished{ false };
+    std::atomic_int m_underruns{ 0 };
+};
+
+} // namespace rt
@@ -1,13 +1,18 @@
 #pragma once
 
 #include <cstdlib>
+#include <cstdint>
 #include <cstring>
 #include <algorithm>
 #include <initializer_list>
+#include <memory>
+#include <atomic>
+#include "rtAllocator.h"
 
 namespace rt {
 
-template<class T>
+// Allocator is a policy from rtAllocator.h. e.g. RawVector<float, Aligned32Allocator> for SIMD.
+template<class T, class Allocator = MallocAllocator>
 class RawVector
 {
 public:
@@ -78,21 +83,11 @@ public:
     iterator end() { return m_data + m_size; }
     const_iterator end() const { return m_data + m_size; }
 
-    static void* allocateSample(size_t size) { return malloc(size); }
-    static void deallocate(void *addr, size_t /*size*/) { free(addr); }
-
     void reserve(size_t s)
     {
         if (s > m_capacity) {
             s = std::max<size_t>(s, m_size * 2);
-            size_t newsize = sizeof(T) * s;
-            size_t oldsize = sizeof(T) * m_size;
-
-            T *newdata = (T*)allocateSample(newsize);
-            memcpy(newdata, m_data, oldsize);
-            deallocate(m_data, oldsize);
-            m_data = newdata;
-            m_capacity = s;
+            reallocate(s);
         }
     }
 
@@ -101,10 +96,10 @@ public:
         if (s > m_capacity) {
             s = std::max<size_t>(s, m_size * 2);
             size_t newsize = sizeof(T) * s;
-            size_t oldsize = sizeof(T) * m_size;
+            size_t oldsize = sizeof(T) * m_capacity;
 
-            deallocate(m_data, oldsize);
-            m_data = (T*)allocateSample(newsize);
+            Allocator::deallocate(m_data, oldsize);
+            m_data = (T*)Allocator::allocate(newsize);
             m_capacity = s;
         }
     }
@@ -112,7 +107,7 @@ public:
     void shrink_to_fit()
     {
         if (m_size == 0) {
-            deallocate(m_data, m_size);
+            Allocator::deallocate(m_data, sizeof(T) * m_capacity);
             m_data = nullptr;
             m_size = m_capacity = 0;
         }
@@ -121,13 +116,7 @@ public:
             return;
         }
         else {
-            size_t newsize = sizeof(T) * m_size;
-            size_t oldsize = sizeof(T) * m_capacity;
-            T *newdata = (T*)allocateSample(newsize);
-            memcpy(newdata, m_data, newsize);
-            deallocate(m_data, oldsize);
-            m_data = newdata;
-            m_capacity = m_size;
+            reallocate(m_size);
         }
     }
 
@@ -263,12 +252,394 @@ public:
     }
 
 private:
+    void reallocate(size_t s)
+    {
+        size_t newsize = sizeof(T) * s;
+        size_t oldsize = sizeof(T) * m_capacity;
+
+        // in place if the allocator can. for large buffers realloc() remaps pages instead of copying them.
+        T *newdata = m_data ? (T*)Allocator::reallocate(m_data, oldsize, newsize) : nullptr;
+        if (!newdata) {
+            newdata = (T*)Allocator::allocate(newsize);
+            if (m_size > 0)
+                memcpy(newdata, m_data, sizeof(T) * std::min(m_size, s));
+            Allocator::deallocate(m_data, oldsize);
+        }
+        m_data = newdata;
+        m_capacity = s;
+    }
+
     T *m_data = nullptr;
     size_t m_size = 0;
     size_t m_capacity = 0;
 };
 
 
+// copy-on-write view of a RawVector.
+// copies and slices share the storage and it is never modified while shared, so passing buffers to other
+// threads doesn't copy them. non-const access makes a private copy first if the storage is shared or
+// the view doesn't cover all of it. note that this includes non-const data() and begin() just to read.
+// it can also be a view of read-only memory owned by something else (see wrap()).
+template<class T>
+class SharedBuffer
+{
+public:
+    using value_type      = T;
+    using reference       = T&;
+    using const_reference = const T&;
+    using pointer         = T*;
+    using const_pointer   = const T*;
+    using iterator        = pointer;
+    using const_iterator  = const_pointer;
+    using storage_t       = RawVector<T>;
+
+    SharedBuffer() {}
+    SharedBuffer(const storage_t& v) : m_storage(std::make_shared<storage_t>(v)), m_size(v.size()) {}
+    SharedBuffer(storage_t&& v) : m_size(v.size()) { m_storage = std::make_shared<storage_t>(std::move(v)); }
+
+    // view of [data, data + size) that keeps owner alive, e.g. a mapped file. nothing is copied.
+    // the memory is treated as shared: it is copied on the first non-const access.
+    static SharedBuffer wrap(std::shared_ptr<const void> owner, const T *data, size_t size)
+    {
+        SharedBuffer ret;
+        if (owner && size > 0) {
+            ret.m_external = std::shared_ptr<const T>(owner, data);
+            ret.m_size = size;
+        }
+        return ret;
+    }
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_external ? m_size : m_storage ? m_storage->capacity() - m_offset : 0; }
+    // true if the storage is referenced by other buffers or is external
+    bool shared() const { return m_external || (m_storage && m_storage.use_count() > 1); }
+
+    const T* data() const
+    {
+        if (m_external)
+            return m_external.get() + m_offset;
+        return m_storage ? m_storage->data() + m_offset : nullptr;
+    }
+    const T* cdata() const { return data(); }
+    T* data() { detach(); return m_storage ? m_storage->data() : nullptr; }
+
+    const T& at(size_t i) const { return data()[i]; }
+    T& at(size_t i) { return data()[i]; }
+    const T& operator[](size_t i) const { return at(i); }
+    T& operator[](size_t i) { return at(i); }
+
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + m_size; }
+    iterator begin() { return data(); }
+    iterator end() { return data() + m_size; }
+
+    // view of [pos, pos + len) that shares the storage
+    SharedBuffer slice(size_t pos, size_t len) const
+    {
+        SharedBuffer ret;
+        pos = std::min(pos, m_size);
+        len = std::min(len, m_size - pos);
+        if (len > 0) {
+            ret.m_storage = m_storage;
+            ret.m_external = m_external;
+            ret.m_offset = m_offset + pos;
+            ret.m_size = len;
+        }
+        return ret;
+    }
+
+    void reserve(size_t s)
+    {
+        detach();
+        m_storage->reserve(s);
+    }
+
+    void resize(size_t s)
+    {
+        detach();
+        m_storage->resize(s);
+        m_size = s;
+    }
+
+    // contents are undefined. doesn't copy shared storage.
+    void resize_discard(size_t s)
+    {
+        if (!unique())
+            release();
+        if (!m_storage)
+            m_storage = std::make_shared<storage_t>();
+        m_storage->resize_discard(s);
+        m_offset = 0;
+        m_size = s;
+    }
+
+    void resize_zeroclear(size_t s)
+    {
+        resize_discard(s);
+        zeroclear();
+    }
+
+    void clear()
+    {
+        // keep the capacity if the storage is ours. otherwise just let it go.
+        if (unique() && m_offset == 0)
+            m_storage->clear();
+        else
+            release();
+        m_offset = m_size = 0;
+    }
+
+    void swap(SharedBuffer& other)
+    {
+        std::swap(m_storage, other.m_storage);
+        std::swap(m_external, other.m_external);
+        std::swap(m_offset, other.m_offset);
+        std::swap(m_size, other.m_size);
+    }
+
+    template<class FwdIter>
+    void assign(FwdIter first, FwdIter last)
+    {
+        resize_discard(std::distance(first, last));
+        std::copy(first, last, m_storage->begin());
+    }
+    void assign(const_pointer first, const_pointer last)
+    {
+        resize_discard(std::distance(first, last));
+        memcpy(m_storage->data(), first, sizeof(value_type) * m_size);
+    }
+    void assign(pointer first, pointer last)
+    {
+        assign((const_pointer)first, (const_pointer)last);
+    }
+
+    template<class ForwardIter>
+    void insert(const_iterator pos, ForwardIter first, ForwardIter last)
+    {
+        size_t d = pos - cdata();
+        detach();
+        m_storage->insert(m_storage->begin() + d, first, last);
+        m_size = m_storage->size();
+    }
+
+    void erase(const_iterator first, const_iterator last)
+    {
+        size_t d = first - cdata();
+        size_t s = last - first;
+        detach();
+        m_storage->erase(m_storage->begin() + d, m_storage->begin() + d + s);
+        m_size = m_storage->size();
+    }
+
+    void push_back(const T& v)
+    {
+        detach();
+        m_storage->push_back(v);
+        ++m_size;
+    }
+
+    void zeroclear()
+    {
+        if (m_size > 0)
+            memset(data(), 0, sizeof(T) * m_size);
+    }
+
+    bool operator == (const SharedBuffer& other) const
+    {
+        return m_size == other.m_size && (cdata() == other.cdata() || memcmp(cdata(), other.cdata(), sizeof(T) * m_size) == 0);
+    }
+    bool operator != (const SharedBuffer& other) const
+    {
+        return !(*this == other);
+    }
+
+private:
+    // use_count() is a relaxed load. the fence makes the last writes of the owners that released the storage
+    // visible before we modify it in place.
+    bool unique() const
+    {
+        if (!m_storage || m_storage.use_count() != 1)
+            return false;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+
+    void release()
+    {
+        m_storage.reset();
+        m_external.reset();
+        m_offset = m_size = 0;
+    }
+
+    // makes the storage private and the view cover all of it
+    void detach()
+    {
+        if (!m_storage && !m_external) {
+            m_storage = std::make_shared<storage_t>();
+        }
+        else if (unique() && m_offset == 0) {
+            // a head slice of our own storage. just drop the tail.
+            if (m_storage->size() != m_size)
+                m_storage->resize(m_size);
+        }
+        else {
+            auto tmp = std::make_shared<storage_t>();
+            tmp->assign(cdata(), cdata() + m_size);
+            m_storage = tmp;
+            m_external.reset();
+            m_offset = 0;
+        }
+    }
+
+    std::shared_ptr<storage_t> m_storage;
+    std::shared_ptr<const T> m_external; // set instead of m_storage by wrap()
+    size_t m_offset = 0;
+    size_t m_size = 0;
+};
+
+// fixed size ring buffer.
+// lock-free and wait-free for a single producer and a single consumer: one thread can write() while another
+// read()s. resize() and clear() must not race with them.
+// ranges are returned as two spans because they may wrap around the end of the storage.
+template<class T, class Allocator = MallocAllocator>
+class RingBuffer
+{
+public:
+    struct Span
+    {
+        T *data;
+        size_t size;
+    };
+
+    struct Spans
+    {
+        Span first;
+        Span second; // the part that wrapped around. empty if none.
+
+        size_t size() const { return first.size + second.size; }
+        bool empty() const { return size() == 0; }
+
+        void copy_to(T *dst) const
+        {
+            if (first.size > 0)
+                memcpy(dst, first.data, sizeof(T) * first.size);
+            if (second.size > 0)
+                memcpy(dst + first.size, second.data, sizeof(T) * second.size);
+        }
+        void copy_from(const T *src) const
+        {
+            if (first.size > 0)
+                memcpy(first.data, src, sizeof(T) * first.size);
+            if (second.size > 0)
+                memcpy(second.data, src + first.size, sizeof(T) * second.size);
+        }
+    };
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    RingBuffer() {}
+    explicit RingBuffer(size_t capacity) { resize(capacity); }
+
+    // discards the contents
+    void resize(size_t capacity)
+    {
+        m_data.resize_discard(capacity);
+        clear();
+    }
+
+    void clear()
+    {
+        m_read.store(0, std::memory_order_relaxed);
+        m_write.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return m_data.size(); }
+    // number of elements that can be read
+    size_t size() const { return m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_acquire); }
+    // number of elements that can be written
+    size_t space() const { return capacity() - size(); }
+    bool empty() const { return size() == 0; }
+    bool full() const { return space() == 0; }
+
+    // the storage. for buffers whose positions are managed outside, e.g. a shadow of a DirectSound buffer.
+    T* data() { return m_data.data(); }
+    const T* data() const { return m_data.data(); }
+
+    // [pos, pos + len) of the storage. wraps around the end. doesn't change read / write positions.
+    Spans view(size_t pos, size_t len)
+    {
+        size_t cap = capacity();
+        if (cap == 0)
+            return {};
+        pos %= cap;
+        len = std::min(len, cap);
+        size_t len1 = std::min(len, cap - pos);
+        return { { m_data.data() + pos, len1 }, { m_data.data(), len - len1 } };
+    }
+
+    // producer side. fill the spans then commit_write().
+    Spans write_spans(size_t max = SIZE_MAX)
+    {
+        size_t w = m_write.load(std::memory_order_relaxed);
+        size_t r = m_read.load(std::memory_order_acquire);
+        return view(w, std::min(max, capacity() - (w - r)));
+    }
+    void commit_write(size_t n)
+    {
+        m_write.store(m_write.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+    // returns the number of elements written. less than n if the buffer is full.
+    size_t write(const T *src, size_t n)
+    {
+        auto spans = write_spans(n);
+        spans.copy_from(src);
+        commit_write(spans.size());
+        return spans.size();
+    }
+
+    // consumer side. read the spans then commit_read().
+    Spans read_spans(size_t max = SIZE_MAX)
+    {
+        size_t r = m_read.load(std::memory_order_relaxed);
+        size_t w = m_write.load(std::memory_order_acquire);
+        return view(r, std::min(max, w - r));
+    }
+    void commit_read(size_t n)
+    {
+        m_read.store(m_read.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+    // returns the number of elements read
+    size_t read(T *dst, size_t n)
+    {
+        auto spans = read_spans(n);
+        spans.copy_to(dst);
+        commit_read(spans.size());
+        return spans.size();
+    }
+    // reads up to max elements into a chunk in one copy. dst is a RawVector or SharedBuffer and its contents
+    // are replaced. e.g. RawVector<T, PoolAllocator> for chunks that are handed to other threads and freed soon.
+    template<class Container>
+    size_t read_chunk(Container& dst, size_t max = SIZE_MAX)
+    {
+        auto spans = read_spans(max);
+        dst.resize_discard(spans.size());
+        if (!spans.empty())
+            spans.copy_to(dst.data());
+        commit_read(spans.size());
+        return spans.size();
+    }
+
+private:
+    RawVector<T, Allocator> m_data;
+    // positions are not wrapped. size() is just m_write - m_read.
+    // kept on separate cache lines as each is written by a different thread.
+    std::atomic<size_t> m_read{ 0 };
+    char m_pad[64];
+    std::atomic<size_t> m_write{ 0 };
+};
+
 template<class T, size_t N>
 class FixedVector
 {
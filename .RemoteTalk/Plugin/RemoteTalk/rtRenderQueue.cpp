@@ -0,0 +1,266 @@
+#include "pch.h"
+#include "rtFoundation.h"
+#include "rtRenderQueue.h"
+
+namespace rt {
+
+RenderQueue::RenderQueue()
+    : m_cancel(std::make_shared<CancelToken>())
+{
+}
+
+RenderQueue::~RenderQueue()
+{
+    cancel();
+    {
+        lock_t lock(m_mutex);
+        m_stopping = true;
+        m_cond.notify_all();
+    }
+    for (auto& t : m_threads)
+        t.join();
+}
+
+void RenderQueue::addServer(const TalkClientSettings& settings, int max_concurrency)
+{
+    auto server = std::make_shared<Server>();
+    server->settings = settings;
+    server->max_concurrency = std::max(max_concurrency, 1);
+
+    lock_t lock(m_mutex);
+    m_servers.push_back(server);
+    if (m_started)
+        spawn((int)m_servers.size() - 1);
+}
+
+int RenderQueue::getServerCount()
+{
+    lock_t lock(m_mutex);
+    return (int)m_servers.size();
+}
+
+void RenderQueue::setMaxRetries(int v)
+{
+    lock_t lock(m_mutex);
+    m_max_retries = std::max(v, 0);
+}
+
+void RenderQueue::setOggSettings(const OggSettings& v)
+{
+    lock_t lock(m_mutex);
+    m_ogg_settings = v;
+}
+
+int RenderQueue::addJob(const RenderJob& job)
+{
+    lock_t lock(m_mutex);
+    int ret = (int)m_jobs.size();
+    m_jobs.push_back({ job });
+    m_queue.push_back(ret);
+    m_cond.notify_one();
+    return ret;
+}
+
+bool RenderQueue::start()
+{
+    lock_t lock(m_mutex);
+    if (m_servers.empty()) {
+        rtLogError("RenderQueue::start(): no servers\n");
+        return false;
+    }
+    if (!m_started) {
+        m_started = true;
+        for (int i = 0; i < (int)m_servers.size(); ++i)
+            spawn(i);
+    }
+    return true;
+}
+
+void RenderQueue::cancel()
+{
+    CancelTokenPtr token;
+    {
+        lock_t lock(m_mutex);
+        for (int i : m_queue)
+            m_jobs[i].state = JobState::Cancelled;
+        m_queue.clear();
+        // jobs being rendered hold the old token. jobs added later get the new one.
+        token = m_cancel;
+        m_cancel = std::make_shared<CancelToken>();
+        m_done_cond.notify_all();
+    }
+    // outside the lock. subscribers shut sockets down.
+    token->cancel();
+}
+
+bool RenderQueue::wait(int timeout_ms)
+{
+    lock_t lock(m_mutex);
+    auto done = [this]() { return m_queue.empty() && m_rendering == 0; };
+    if (timeout_ms <= 0) {
+        m_done_cond.wait(lock, done);
+        return true;
+    }
+    return m_done_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), done);
+}
+
+bool RenderQueue::isFinished()
+{
+    lock_t lock(m_mutex);
+    return m_queue.empty() && m_rendering == 0;
+}
+
+RenderQueue::Progress RenderQueue::getProgress()
+{
+    lock_t lock(m_mutex);
+    Progress ret;
+    ret.total = (int)m_jobs.size();
+    ret.retries = m_retries;
+    for (auto& job : m_jobs) {
+        switch (job.state) {
+        case JobState::Queued: ++ret.queued; break;
+        case JobState::Rendering: ++ret.rendering; break;
+        case JobState::Succeeded: ++ret.succeeded; break;
+        case JobState::Failed: ++ret.failed; break;
+        case JobState::Cancelled: ++ret.cancelled; break;
+        }
+    }
+    return ret;
+}
+
+RenderQueue::JobState RenderQueue::getJobState(int i)
+{
+    lock_t lock(m_mutex);
+    if (i < 0 || i >= (int)m_jobs.size())
+        return JobState::Failed;
+    return m_jobs[i].state;
+}
+
+void RenderQueue::spawn(int server)
+{
+    // one worker per concurrent talk. workers are joined in the destructor.
+    for (int i = 0; i < m_servers[server]->max_concurrency; ++i)
+        m_threads.emplace_back([this, server]() { process(server); });
+}
+
+int RenderQueue::pick(int server)
+{
+    // don't retry on the server that failed it, unless there is no other
+    bool single = m_servers.size() == 1;
+    for (auto it = m_queue.begin(); it != m_queue.end(); ++it) {
+        int i = *it;
+        if (single || m_jobs[i].failed_server != server) {
+            m_queue.erase(it);
+            return i;
+        }
+    }
+    return -1;
+}
+
+void RenderQueue::process(int server)
+{
+    lock_t lock(m_mutex);
+    for (;;) {
+        int i = -1;
+        m_cond.wait(lock, [&]() { return m_stopping || (i = pick(server)) >= 0; });
+        if (i < 0)
+            return;
+
+        auto& job = m_jobs[i];
+        job.state = JobState::Rendering;
+        ++job.attempts;
+        ++m_rendering;
+        auto request = job.job;
+        auto cancel = m_cancel;
+        lock.unlock();
+
+        AudioData data;
+        bool ok = render(server, request, data, cancel) && !cancel->isCancelled() && save(request, data);
+
+        lock.lock();
+        --m_rendering;
+        if (ok) {
+            job.state = JobState::Succeeded;
+        }
+        else if (cancel->isCancelled()) {
+            job.state = JobState::Cancelled;
+        }
+        else if (job.attempts <= m_max_retries) {
+            job.state = JobState::Queued;
+            job.failed_server = server;
+            m_queue.push_back(i);
+            ++m_retries;
+            m_cond.notify_all();
+        }
+        else {
+            job.state = JobState::Failed;
+            rtLogWarning("RenderQueue: gave up \"%s\"\n", request.path.c_str());
+        }
+        m_done_cond.notify_all();
+    }
+}
+
+bool RenderQueue::resolveCast(Server& server, TalkParams& params, const std::string& cast)
+{
+    if (cast.empty())
+        return true;
+
+    // stats are queried once per server
+    std::unique_lock<std::mutex> lock(server.stats_mutex);
+    if (!server.has_stats) {
+        TalkClient client(server.settings);
+        if (!client.stats(server.stats))
+            return false;
+        server.has_stats = true;
+    }
+    for (auto& c : server.stats.casts) {
+        if (c.name == cast) {
+            params.cast = (short)c.id;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RenderQueue::render(int server_index, const RenderJob& job, AudioData& dst, const CancelTokenPtr& cancel)
+{
+    ServerPtr server;
+    {
+        lock_t lock(m_mutex);
+        server = m_servers[server_index];
+    }
+
+    auto params = job.params;
+    if (!resolveCast(*server, params, job.cast))
+        return false;
+
+    TalkClient client(server->settings);
+    TalkPlayOptions options;
+    options.cancel = cancel;
+    bool ret = client.play(params, job.text, [&dst](const AudioData& ad) {
+        dst += ad;
+    }, options);
+    return ret && dst.getSampleLength() != 0;
+}
+
+bool RenderQueue::save(const RenderJob& job, const AudioData& data)
+{
+    auto& path = job.path;
+    std::string ext = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+    for (auto& c : ext)
+        c = (char)std::tolower(c);
+    bool ogg = ext == ".ogg";
+    if (ogg) {
+        OggSettings settings;
+        {
+            lock_t lock(m_mutex);
+            settings = m_ogg_settings;
+        }
+        return ExportOgg(data, path.c_str(), settings);
+    }
+    else {
+        return ExportWave(data, path.c_str());
+    }
+}
+
+} // namespace rt
@@ -0,0 +1,122 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "rtAudioFile.h"
+#include "rtTalkClient.h"
+
+namespace rt {
+
+struct RenderJob
+{
+    // resolved on each server because cast ids differ between hosts. empty uses params.cast as it is.
+    std::string cast;
+    TalkParams params;
+    std::string text;
+    // ".ogg" is encoded with the queue's OggSettings. anything else is written as wave.
+    std::string path;
+};
+
+// renders many talks to files.
+// jobs are shared by all servers and each server renders up to its own concurrency limit at a time,
+// so faster servers take more jobs. a failed job is retried on another server if there is one.
+class RenderQueue
+{
+public:
+    enum class JobState
+    {
+        Queued,
+        Rendering,
+        Succeeded,
+        Failed, // retries are exhausted
+        Cancelled,
+    };
+
+    struct Progress
+    {
+        int total = 0;
+        int queued = 0;
+        int rendering = 0;
+        int succeeded = 0;
+        int failed = 0;
+        int cancelled = 0;
+        int retries = 0;
+
+        bool isFinished() const { return queued == 0 && rendering == 0; }
+    };
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    RenderQueue();
+    // cancels jobs in progress and waits for them
+    virtual ~RenderQueue();
+
+    // max_concurrency is the number of talks the server renders at the same time
+    void addServer(const TalkClientSettings& settings, int max_concurrency = 1);
+    int getServerCount();
+    void setMaxRetries(int v);
+    void setOggSettings(const OggSettings& v);
+
+    // returns the index of the job. jobs can be added while the queue is running.
+    int addJob(const RenderJob& job);
+    bool start();
+    // queued jobs are cancelled and jobs being rendered are aborted
+    void cancel();
+    // waits until all jobs are done. returns false on timeout. 0 waits forever. call start() before.
+    bool wait(int timeout_ms = 0);
+    bool isFinished();
+
+    Progress getProgress();
+    JobState getJobState(int i);
+
+protected:
+    // these are called from the workers. virtual for tests.
+    virtual bool render(int server, const RenderJob& job, AudioData& dst, const CancelTokenPtr& cancel);
+    virtual bool save(const RenderJob& job, const AudioData& data);
+
+private:
+    struct Server
+    {
+        TalkClientSettings settings;
+        int max_concurrency = 1;
+        std::mutex stats_mutex;
+        TalkServerStats stats;
+        bool has_stats = false;
+    };
+    using ServerPtr = std::shared_ptr<Server>;
+
+    struct Job
+    {
+        RenderJob job;
+        JobState state = JobState::Queued;
+        int attempts = 0;
+        int failed_server = -1; // last server that failed it
+    };
+    using lock_t = std::unique_lock<std::mutex>;
+
+    void spawn(int server);
+    void process(int server);
+    // index of the next job for server. -1 if none.
+    int pick(int server);
+    bool resolveCast(Server& server, TalkParams& params, const std::string& cast);
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;      // to workers
+    std::condition_variable m_done_cond; // to wait()
+    std::vector<ServerPtr> m_servers;
+    std::vector<std::thread> m_threads;
+    std::deque<Job> m_jobs;
+    std::deque<int> m_queue;
+    CancelTokenPtr m_cancel;
+    OggSettings m_ogg_settings;
+    int m_max_retries = 2;
+    int m_rendering = 0;
+    int m_retries = 0;
+    bool m_started = false;
+    bool m_stopping = false;
+};
+
+} // namespace rt
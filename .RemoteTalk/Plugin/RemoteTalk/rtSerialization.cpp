@@ -2,6 +2,7 @@
 #include "rtSerialization.h"
 #include "rtTalkInterface.h"
 #include "rtTalkServer.h"
+#include "rtHistogram.h"
 #include "picojson/picojson.h"
 
 namespace rt {
@@ -209,6 +210,40 @@ template<> bool from_json(float& dst, const picojson::value& v)
     return true;
 }
 
+// json numbers are float. 64 bit integers are written as int64 to keep them exact.
+template<> picojson::value to_json(const uint64_t& v)
+{
+    return value((int64_t)v);
+}
+template<> bool from_json(uint64_t& dst, const picojson::value& v)
+{
+    if (v.is<int64_t>())
+        dst = (uint64_t)v.get<int64_t>();
+    else if (v.is<float>())
+        dst = (uint64_t)v.get<float>();
+    else
+        return false;
+    return true;
+}
+
+// float if it is precise enough (< 2^24). otherwise rounded to an integer.
+template<> picojson::value to_json(const double& v)
+{
+    if (std::abs(v) < (double)(1 << 24))
+        return value((float)v);
+    return value((int64_t)std::llround(v));
+}
+template<> bool from_json(double& dst, const picojson::value& v)
+{
+    if (v.is<int64_t>())
+        dst = (double)v.get<int64_t>();
+    else if (v.is<float>())
+        dst = v.get<float>();
+    else
+        return false;
+    return true;
+}
+
 template<> picojson::value to_json(const std::string& v)
 {
     return value(v);
@@ -354,6 +389,17 @@ template<> picojson::value to_json(const TalkServerStats& v)
     ret["protocol_version"] = to_json(v.protocol_version);
     ret["params"] = to_json(v.params);
     ret["casts"] = to_json(v.casts);
+    ret["ttfb"] = to_json(v.ttfb);
+    ret["frames_per_sec"] = to_json(v.frames_per_sec);
+    ret["header_overhead"] = to_json(v.header_overhead);
+    ret["buffer_size"] = to_json(v.buffer_size);
+    ret["buffer_peak"] = to_json(v.buffer_peak);
+    ret["buffer_capacity"] = to_json(v.buffer_capacity);
+    ret["buffer_degraded"] = to_json(v.buffer_degraded);
+    ret["buffer_blocked_ms"] = to_json(v.buffer_blocked_ms);
+    ret["queued_chars"] = to_json(v.queued_chars);
+    ret["chars_per_sec"] = to_json(v.chars_per_sec);
+    ret["estimated_wait"] = to_json(v.estimated_wait);
     return value(std::move(ret));
 }
 template<> bool from_json(TalkServerStats& dst, const picojson::value& v)
@@ -367,9 +413,36 @@ template<> bool from_json(TalkServerStats& dst, const picojson::value& v)
     if (from_json(dst.protocol_version, v.get("protocol_version"))) ++n;
     if (from_json(dst.params, v.get("params"))) ++n;
     if (from_json(dst.casts, v.get("casts"))) ++n;
+    // optional
+    from_json(dst.ttfb, v.get("ttfb"));
+    from_json(dst.frames_per_sec, v.get("frames_per_sec"));
+    from_json(dst.header_overhead, v.get("header_overhead"));
+    from_json(dst.buffer_size, v.get("buffer_size"));
+    from_json(dst.buffer_peak, v.get("buffer_peak"));
+    from_json(dst.buffer_capacity, v.get("buffer_capacity"));
+    from_json(dst.buffer_degraded, v.get("buffer_degraded"));
+    from_json(dst.buffer_blocked_ms, v.get("buffer_blocked_ms"));
+    from_json(dst.queued_chars, v.get("queued_chars"));
+    from_json(dst.chars_per_sec, v.get("chars_per_sec"));
+    from_json(dst.estimated_wait, v.get("estimated_wait"));
     return n >= 5;
 }
 
+template<> picojson::value to_json(const Histogram& v)
+{
+    // counts and nanoseconds exceed the precision of float
+    object ret;
+    ret["count"] = to_json(v.getCount());
+    ret["min"] = to_json(v.getMin());
+    ret["max"] = to_json(v.getMax());
+    ret["mean"] = to_json(v.getMean());
+    ret["p50"] = to_json(v.getPercentile(50.0));
+    ret["p90"] = to_json(v.getPercentile(90.0));
+    ret["p99"] = to_json(v.getPercentile(99.0));
+    ret["p999"] = to_json(v.getPercentile(99.9));
+    return value(std::move(ret));
+}
+
 template<> picojson::value to_json(const std::map<std::string, std::string>& v)
 {
     object t;
@@ -396,6 +469,17 @@ template<> picojson::value to_json(const TalkServerSettings& v)
     ret["port"] = to_json(v.port);
     ret["max_queue"] = to_json(v.max_queue);
     ret["max_threads"] = to_json(v.max_threads);
+    ret["low_latency"] = to_json(v.low_latency);
+    ret["send_buffer_size"] = to_json(v.send_buffer_size);
+    ret["receive_buffer_size"] = to_json(v.receive_buffer_size);
+    ret["frame_ms"] = to_json(v.frame_ms);
+    ret["max_hold_ms"] = to_json(v.max_hold_ms);
+    ret["max_buffer_size"] = to_json(v.max_buffer_size);
+    ret["buffer_policy"] = to_json((int)v.buffer_policy);
+    ret["max_wait_ms"] = to_json(v.max_wait_ms);
+    ret["record_path"] = to_json(v.record_path);
+    ret["record_audio"] = to_json(v.record_audio);
+    ret["trace"] = to_json(v.trace);
     return value(std::move(ret));
 }
 template<> bool from_json(TalkServerSettings& dst, const picojson::value& v)
@@ -407,6 +491,23 @@ template<> bool from_json(TalkServerSettings& dst, const picojson::value& v)
     if (from_json(dst.port, v.get("port"))) ++n;
     if (from_json(dst.max_queue, v.get("max_queue"))) ++n;
     if (from_json(dst.max_threads, v.get("max_threads"))) ++n;
+    if (from_json(dst.low_latency, v.get("low_latency"))) ++n;
+    if (from_json(dst.send_buffer_size, v.get("send_buffer_size"))) ++n;
+    if (from_json(dst.receive_buffer_size, v.get("receive_buffer_size"))) ++n;
+    if (from_json(dst.frame_ms, v.get("frame_ms"))) ++n;
+    if (from_json(dst.max_hold_ms, v.get("max_hold_ms"))) ++n;
+    if (from_json(dst.max_buffer_size, v.get("max_buffer_size"))) ++n;
+    {
+        int policy;
+        if (from_json(policy, v.get("buffer_policy"))) {
+            dst.buffer_policy = (BufferPolicy)policy;
+            ++n;
+        }
+    }
+    if (from_json(dst.max_wait_ms, v.get("max_wait_ms"))) ++n;
+    if (from_json(dst.record_path, v.get("record_path"))) ++n;
+    if (from_json(dst.record_audio, v.get("record_audio"))) ++n;
+    if (from_json(dst.trace, v.get("trace"))) ++n;
     return n >= 1;
 }
 
@@ -50,16 +50,26 @@ struct read_impl
 
 
 
-template<class T>
-struct write_impl<RawVector<T>>
+template<class T, class A>
+struct write_impl<RawVector<T, A>>
 {
-    void operator()(std::ostream& os, const RawVector<T>& v)
+    void operator()(std::ostream& os, const RawVector<T, A>& v)
     {
         auto size = (uint32_t)v.size();
         os.write((const char*)&size, 4);
         os.write((const char*)v.data(), sizeof(T) * size);
     }
 };
+template<class T>
+struct write_impl<SharedBuffer<T>>
+{
+    void operator()(std::ostream& os, const SharedBuffer<T>& v)
+    {
+        auto size = (uint32_t)v.size();
+        os.write((const char*)&size, 4);
+        os.write((const char*)v.cdata(), sizeof(T) * size);
+    }
+};
 template<>
 struct write_impl<std::string>
 {
@@ -106,10 +116,21 @@ template<class T> inline void write(std::ostream& os, const T& v) { return write
 
 
 
+template<class T, class A>
+struct read_impl<RawVector<T, A>>
+{
+    void operator()(std::istream& is, RawVector<T, A>& v)
+    {
+        uint32_t size = 0;
+        is.read((char*)&size, 4);
+        v.resize_discard(size);
+        is.read((char*)v.data(), sizeof(T) * size);
+    }
+};
 template<class T>
-struct read_impl<RawVector<T>>
+struct read_impl<SharedBuffer<T>>
 {
-    void operator()(std::istream& is, RawVector<T>& v)
+    void operator()(std::istream& is, SharedBuffer<T>& v)
     {
         uint32_t size = 0;
         is.read((char*)&size, 4);
@@ -168,10 +189,22 @@ template<class T> inline void read(std::istream& is, T& v) { return read_impl<T>
 template<class T>
 struct hash_impl;
 
+template<class T, class A>
+struct hash_impl<RawVector<T, A>>
+{
+    uint64_t operator()(const RawVector<T, A>& v)
+    {
+        uint64_t ret = 0;
+        if (sizeof(T) * v.size() >= 8)
+            ret = *(const uint64_t*)((const char*)v.end() - 8);
+        return ret;
+    }
+};
+
 template<class T>
-struct hash_impl<RawVector<T>>
+struct hash_impl<SharedBuffer<T>>
 {
-    uint64_t operator()(const RawVector<T>& v)
+    uint64_t operator()(const SharedBuffer<T>& v)
     {
         uint64_t ret = 0;
         if (sizeof(T) * v.size() >= 8)
@@ -0,0 +1,276 @@
+#include "pch.h"
+#include "rtFoundation.h"
+#include "rtSharedRing.h"
+#include "Poco/SharedMemory.h"
+
+namespace rt {
+
+static const uint32_t SharedRingMagic = 0x47525452; // "RTRG"
+static const size_t SharedRingHeaderSize = 64;
+
+struct SharedRing::Header
+{
+    uint32_t magic;
+    uint32_t capacity;
+    std::atomic<uint64_t> write_pos;
+    std::atomic<uint64_t> read_pos;
+    std::atomic<uint32_t> shutdown;
+};
+
+// spin a bit then sleep. the other side is usually just about to catch up.
+template<class Cond>
+static bool WaitFor(const Cond& cond, int timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (int i = 0; !cond(); ++i) {
+        if (i < 64)
+            std::this_thread::yield();
+        else if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+
+SharedRing::SharedRing()
+{
+}
+
+SharedRing::~SharedRing()
+{
+    close();
+}
+
+bool SharedRing::create(const std::string& name, size_t capacity)
+{
+    static_assert(sizeof(Header) <= SharedRingHeaderSize, "");
+    close();
+    try {
+        m_shm = std::make_shared<Poco::SharedMemory>(name, SharedRingHeaderSize + capacity, Poco::SharedMemory::AM_WRITE, nullptr, true);
+    }
+    catch (Poco::Exception& e) {
+        rtLogError("SharedRing::create() failed: %s\n", e.displayText().c_str());
+        m_shm.reset();
+        return false;
+    }
+    m_name = name;
+    m_capacity = capacity;
+
+    auto *header = getHeader();
+    header->capacity = (uint32_t)capacity;
+    header->write_pos = 0;
+    header->read_pos = 0;
+    header->shutdown = 0;
+    header->magic = SharedRingMagic;
+    return true;
+}
+
+bool SharedRing::open(const std::string& name, size_t capacity)
+{
+    close();
+    try {
+        m_shm = std::make_shared<Poco::SharedMemory>(name, SharedRingHeaderSize + capacity, Poco::SharedMemory::AM_WRITE, nullptr, false);
+    }
+    catch (Poco::Exception&) {
+        m_shm.reset();
+        return false;
+    }
+
+    auto *header = getHeader();
+    if (header->magic != SharedRingMagic || header->capacity != capacity) {
+        m_shm.reset();
+        return false;
+    }
+    m_name = name;
+    m_capacity = capacity;
+    return true;
+}
+
+void SharedRing::close()
+{
+    m_shm.reset();
+    m_name.clear();
+    m_capacity = 0;
+}
+
+bool SharedRing::valid() const
+{
+    return m_shm != nullptr;
+}
+
+const std::string& SharedRing::getName() const
+{
+    return m_name;
+}
+
+size_t SharedRing::getCapacity() const
+{
+    return m_capacity;
+}
+
+SharedRing::Header* SharedRing::getHeader() const
+{
+    return (Header*)m_shm->begin();
+}
+
+char* SharedRing::getData()
+{
+    return m_shm->begin() + SharedRingHeaderSize;
+}
+
+uint64_t SharedRing::getWritePos() const
+{
+    return getHeader()->write_pos.load(std::memory_order_acquire);
+}
+
+uint64_t SharedRing::getReadPos() const
+{
+    return getHeader()->read_pos.load(std::memory_order_acquire);
+}
+
+void SharedRing::setWritePos(uint64_t v)
+{
+    getHeader()->write_pos.store(v, std::memory_order_release);
+}
+
+void SharedRing::setReadPos(uint64_t v)
+{
+    getHeader()->read_pos.store(v, std::memory_order_release);
+}
+
+void SharedRing::shutdown()
+{
+    getHeader()->shutdown = 1;
+}
+
+bool SharedRing::isShutdown() const
+{
+    return getHeader()->shutdown != 0;
+}
+
+bool SharedRing::waitConsumed(int timeout_ms)
+{
+    return WaitFor([this]() { return getReadPos() == getWritePos(); }, timeout_ms);
+}
+
+
+SharedRingWriter::SharedRingWriter(SharedRing& ring, const Doorbell& doorbell, int timeout_ms)
+    : m_ring(ring)
+    , m_doorbell(doorbell)
+    , m_timeout_ms(timeout_ms)
+    , m_pos(ring.getWritePos())
+{
+}
+
+SharedRingWriter::~SharedRingWriter()
+{
+    sync();
+}
+
+void SharedRingWriter::advance()
+{
+    m_pos += pptr() - pbase();
+    setp(nullptr, nullptr);
+}
+
+bool SharedRingWriter::reserve()
+{
+    auto capacity = m_ring.getCapacity();
+    auto free_space = [&]() { return capacity - (size_t)(m_pos - m_ring.getReadPos()); };
+    if (free_space() == 0) {
+        // ring is full. publish what we have and let the consumer drain it.
+        m_ring.setWritePos(m_pos);
+        if (m_doorbell)
+            m_doorbell();
+        if (!WaitFor([&]() { return free_space() > 0; }, m_timeout_ms)) {
+            m_ring.shutdown();
+            return false;
+        }
+    }
+
+    auto offset = (size_t)(m_pos % capacity);
+    auto size = std::min(capacity - offset, free_space());
+    auto *p = m_ring.getData() + offset;
+    setp(p, p + size);
+    return true;
+}
+
+SharedRingWriter::int_type SharedRingWriter::overflow(int_type c)
+{
+    advance();
+    if (!reserve())
+        return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int SharedRingWriter::sync()
+{
+    advance();
+    if (m_pos != m_ring.getWritePos()) {
+        m_ring.setWritePos(m_pos);
+        if (m_doorbell)
+            m_doorbell();
+    }
+    return 0;
+}
+
+
+SharedRingReader::SharedRingReader(SharedRing& ring, int timeout_ms, const AbortCondition& is_aborted)
+    : m_ring(ring)
+    , m_timeout_ms(timeout_ms)
+    , m_is_aborted(is_aborted)
+    , m_pos(ring.getReadPos())
+{
+}
+
+SharedRingReader::~SharedRingReader()
+{
+    advance();
+}
+
+void SharedRingReader::advance()
+{
+    auto n = gptr() - eback();
+    if (n > 0) {
+        m_pos += n;
+        m_ring.setReadPos(m_pos);
+    }
+    setg(nullptr, nullptr, nullptr);
+}
+
+size_t SharedRingReader::available()
+{
+    // also gives consumed space back to the producer
+    advance();
+    return (size_t)(m_ring.getWritePos() - m_pos);
+}
+
+SharedRingReader::int_type SharedRingReader::underflow()
+{
+    advance();
+    uint64_t wpos = 0;
+    bool aborted = false;
+    bool ok = WaitFor([&]() {
+        wpos = m_ring.getWritePos();
+        return wpos != m_pos || m_ring.isShutdown() || (aborted = m_is_aborted && m_is_aborted());
+    }, m_timeout_ms);
+    if (aborted)
+        return traits_type::eof();
+    if (!ok || wpos == m_pos)
+        return traits_type::eof();
+
+    auto capacity = m_ring.getCapacity();
+    auto offset = (size_t)(m_pos % capacity);
+    auto size = std::min(capacity - offset, (size_t)(wpos - m_pos));
+    auto *p = m_ring.getData() + offset;
+    setg(p, p, p + size);
+    return traits_type::to_int_type(*p);
+}
+
+} // namespace rt
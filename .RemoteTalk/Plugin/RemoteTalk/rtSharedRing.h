@@ -0,0 +1,107 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <functional>
+#include <streambuf>
+
+namespace Poco {
+    class SharedMemory;
+}
+
+namespace rt {
+
+// "/talk?transport=shm" from a loopback address makes the server respond with these headers.
+const char SharedRingNameHeader[] = "RemoteTalk-Shared-Memory";
+const char SharedRingSizeHeader[] = "RemoteTalk-Shared-Memory-Size";
+const size_t SharedRingSize = 4 * 1024 * 1024;
+const int SharedRingTimeout = 5000;
+
+// single producer / single consumer byte ring on named shared memory.
+// the server creates it and the client opens it by name. this is the same-host transport of "/talk".
+// positions are monotonic byte counts. position % capacity is the offset in the ring.
+class SharedRing
+{
+public:
+    SharedRing(const SharedRing&) = delete;
+    SharedRing& operator=(const SharedRing&) = delete;
+
+    SharedRing();
+    ~SharedRing();
+    bool create(const std::string& name, size_t capacity);
+    bool open(const std::string& name, size_t capacity);
+    void close();
+    bool valid() const;
+    const std::string& getName() const;
+    size_t getCapacity() const;
+    char* getData();
+
+    uint64_t getWritePos() const;
+    uint64_t getReadPos() const;
+    void setWritePos(uint64_t v);
+    void setReadPos(uint64_t v);
+
+    // producer gave up. the consumer stops waiting for more data.
+    void shutdown();
+    bool isShutdown() const;
+    // wait until the consumer reads everything written. returns false on timeout.
+    bool waitConsumed(int timeout_ms);
+
+private:
+    struct Header;
+    Header* getHeader() const;
+
+    std::shared_ptr<Poco::SharedMemory> m_shm;
+    std::string m_name;
+    size_t m_capacity = 0;
+};
+
+// streambuf that writes directly into the ring.
+// sync() publishes the written data and rings the doorbell. blocks while the ring is full.
+class SharedRingWriter : public std::streambuf
+{
+public:
+    using Doorbell = std::function<void()>;
+
+    SharedRingWriter(SharedRing& ring, const Doorbell& doorbell, int timeout_ms);
+    ~SharedRingWriter();
+
+protected:
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+private:
+    void advance();
+    bool reserve();
+
+    SharedRing& m_ring;
+    Doorbell m_doorbell;
+    int m_timeout_ms;
+    uint64_t m_pos = 0;
+};
+
+// streambuf that reads directly from the ring. blocks while the ring is empty.
+// the wait also ends when is_aborted returns true (e.g. the talk is cancelled).
+class SharedRingReader : public std::streambuf
+{
+public:
+    using AbortCondition = std::function<bool()>;
+
+    SharedRingReader(SharedRing& ring, int timeout_ms, const AbortCondition& is_aborted = {});
+    ~SharedRingReader();
+
+    // published but not yet read bytes
+    size_t available();
+
+protected:
+    int_type underflow() override;
+
+private:
+    void advance();
+
+    SharedRing& m_ring;
+    int m_timeout_ms;
+    AbortCondition m_is_aborted;
+    uint64_t m_pos = 0;
+};
+
+} // namespace rt
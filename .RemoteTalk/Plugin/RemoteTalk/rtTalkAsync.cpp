@@ -0,0 +1,258 @@
+#include "pch.h"
+#include "rtFoundation.h"
+#include "rtTalkAsync.h"
+
+namespace rt {
+
+EventLoop::EventLoop()
+{
+}
+
+EventLoop::~EventLoop()
+{
+}
+
+void EventLoop::post(const std::function<void()>& job)
+{
+    // notify while locked. the loop may return from run() and be destroyed as soon as the lock is released.
+    lock_t lock(m_mutex);
+    m_jobs.push_back(job);
+    m_cond.notify_one();
+}
+
+void EventLoop::addWork()
+{
+    lock_t lock(m_mutex);
+    ++m_work;
+}
+
+void EventLoop::releaseWork()
+{
+    lock_t lock(m_mutex);
+    --m_work;
+    m_cond.notify_all();
+}
+
+void EventLoop::run()
+{
+    lock_t lock(m_mutex);
+    for (;;) {
+        m_cond.wait(lock, [this]() { return m_stopping || !m_jobs.empty() || m_work <= 0; });
+        if (m_stopping || m_jobs.empty()) {
+            m_stopping = false;
+            break;
+        }
+
+        auto job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
+
+bool EventLoop::runOne(int timeout_ms)
+{
+    lock_t lock(m_mutex);
+    if (!m_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() { return !m_jobs.empty(); }))
+        return false;
+
+    auto job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    lock.unlock();
+    job();
+    return true;
+}
+
+void EventLoop::stop()
+{
+    lock_t lock(m_mutex);
+    m_stopping = true;
+    m_cond.notify_all();
+}
+
+
+#ifdef rtEnableCoroutine
+
+AsyncTalkClient::AsyncTalkClient(EventLoop& loop, const TalkClientSettings& settings)
+    : m_loop(loop)
+    , m_channel(settings)
+{
+}
+
+bool AsyncTalkClient::connect()
+{
+    return m_channel.connect();
+}
+
+void AsyncTalkClient::close()
+{
+    m_channel.close();
+}
+
+EventLoop& AsyncTalkClient::getLoop()
+{
+    return m_loop;
+}
+
+TalkChannel& AsyncTalkClient::getChannel()
+{
+    return m_channel;
+}
+
+void AsyncTalkClient::resume(std::coroutine_handle<> h)
+{
+    m_loop.post([h]() { h.resume(); });
+}
+
+AsyncTalkClient::StatsAwaiter AsyncTalkClient::stats()
+{
+    return StatsAwaiter(*this);
+}
+
+AsyncTalkClient::StopAwaiter AsyncTalkClient::stop()
+{
+    return StopAwaiter(*this);
+}
+
+
+AsyncTalkClient::StatsAwaiter::StatsAwaiter(AsyncTalkClient& client)
+    : m_client(client)
+{
+}
+
+void AsyncTalkClient::StatsAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    // the result is written on the receiving thread and read after posting h, which orders them
+    m_client.m_channel.statsAsync([this, h](bool ok, TalkServerStats& stats) {
+        if (ok)
+            m_result = std::move(stats);
+        m_client.resume(h);
+    });
+}
+
+std::optional<TalkServerStats> AsyncTalkClient::StatsAwaiter::await_resume()
+{
+    return std::move(m_result);
+}
+
+
+AsyncTalkClient::StopAwaiter::StopAwaiter(AsyncTalkClient& client)
+    : m_client(client)
+{
+}
+
+void AsyncTalkClient::StopAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    m_client.m_channel.stopAsync([this, h](bool ok) {
+        m_result = ok;
+        m_client.resume(h);
+    });
+}
+
+
+struct AsyncTalkClient::AudioStream::State
+{
+    using lock_t = std::unique_lock<std::mutex>;
+
+    AsyncTalkClient *client = nullptr;
+    std::mutex mutex;
+    std::deque<AudioData> frames;
+    std::coroutine_handle<> waiter;
+    bool finished = false;
+    bool succeeded = false;
+
+    void wake(lock_t& lock)
+    {
+        auto h = waiter;
+        waiter = nullptr;
+        lock.unlock();
+        if (h)
+            client->resume(h);
+    }
+};
+
+AsyncTalkClient::AudioStream AsyncTalkClient::play(const TalkParams& params, const std::string& text)
+{
+    using lock_t = AudioStream::State::lock_t;
+
+    auto state = std::make_shared<AudioStream::State>();
+    state->client = this;
+    m_channel.playAsync(params, text,
+        [state](const AudioData& ad) {
+            // the terminator is reported by on_complete
+            if (ad.data.empty())
+                return;
+            lock_t lock(state->mutex);
+            state->frames.push_back(ad);
+            state->wake(lock);
+        },
+        [state](bool ok) {
+            lock_t lock(state->mutex);
+            state->finished = true;
+            state->succeeded = ok;
+            state->wake(lock);
+        });
+    return AudioStream(state);
+}
+
+AsyncTalkClient::AudioStream::AudioStream(std::shared_ptr<State> state)
+    : m_state(state)
+{
+}
+
+AsyncTalkClient::AudioStream::NextAwaiter AsyncTalkClient::AudioStream::next()
+{
+    return NextAwaiter(*this);
+}
+
+bool AsyncTalkClient::AudioStream::isFinished() const
+{
+    State::lock_t lock(m_state->mutex);
+    return m_state->finished && m_state->frames.empty();
+}
+
+bool AsyncTalkClient::AudioStream::succeeded() const
+{
+    State::lock_t lock(m_state->mutex);
+    return m_state->succeeded;
+}
+
+
+AsyncTalkClient::AudioStream::NextAwaiter::NextAwaiter(AudioStream& stream)
+    : m_stream(stream)
+{
+}
+
+bool AsyncTalkClient::AudioStream::NextAwaiter::await_ready() const
+{
+    auto& s = *m_stream.m_state;
+    State::lock_t lock(s.mutex);
+    return !s.frames.empty() || s.finished;
+}
+
+bool AsyncTalkClient::AudioStream::NextAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    // a frame may have arrived after await_ready(). don't suspend then.
+    auto& s = *m_stream.m_state;
+    State::lock_t lock(s.mutex);
+    if (!s.frames.empty() || s.finished)
+        return false;
+    s.waiter = h;
+    return true;
+}
+
+std::optional<AudioData> AsyncTalkClient::AudioStream::NextAwaiter::await_resume()
+{
+    auto& s = *m_stream.m_state;
+    State::lock_t lock(s.mutex);
+    if (s.frames.empty())
+        return std::nullopt;
+    auto ret = std::move(s.frames.front());
+    s.frames.pop_front();
+    return ret;
+}
+
+#endif // rtEnableCoroutine
+
+} // namespace rt
@@ -0,0 +1,291 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include "rtFoundation.h"
+#include "rtTalkChannel.h"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+    #define rtEnableCoroutine
+    #include <coroutine>
+    #include <optional>
+    #include <exception>
+#endif
+
+namespace rt {
+
+// jobs posted from any thread run on the thread that calls run().
+// completions of TalkChannel's asynchronous requests are posted here, so a single thread can drive
+// any number of talks while the channel's receiving thread does the I/O.
+class EventLoop
+{
+public:
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    EventLoop();
+    ~EventLoop();
+
+    void post(const std::function<void()>& job);
+
+    // outstanding work keeps run() running. e.g. spawned coroutines.
+    void addWork();
+    void releaseWork();
+
+    // runs jobs until there is no outstanding work and no job, or stop() is called.
+    void run();
+    // runs one job. waits up to timeout_ms for it. returns false if there was nothing to run.
+    bool runOne(int timeout_ms = 0);
+    void stop();
+
+private:
+    using lock_t = std::unique_lock<std::mutex>;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::function<void()>> m_jobs;
+    int m_work = 0;
+    bool m_stopping = false;
+};
+
+
+#ifdef rtEnableCoroutine
+
+template<class T> class Task;
+
+namespace detail {
+
+struct TaskPromiseBase
+{
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template<class P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+        {
+            auto c = h.promise().continuation;
+            return c ? c : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+};
+
+template<class T>
+struct TaskPromise : TaskPromiseBase
+{
+    Task<T> get_return_object();
+    void return_value(T v) { value = std::move(v); }
+    T result()
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+        return std::move(*value);
+    }
+
+    std::optional<T> value;
+};
+
+template<>
+struct TaskPromise<void> : TaskPromiseBase
+{
+    Task<void> get_return_object();
+    void return_void() {}
+    void result()
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+};
+
+} // namespace detail
+
+// lazily started coroutine. it begins when awaited, and the awaiter resumes when it finishes.
+template<class T = void>
+class Task
+{
+public:
+    using promise_type = detail::TaskPromise<T>;
+    using handle_t = std::coroutine_handle<promise_type>;
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    Task(Task&& v) noexcept : m_handle(v.m_handle) { v.m_handle = nullptr; }
+    Task& operator=(Task&& v) noexcept
+    {
+        if (this != &v) {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = v.m_handle;
+            v.m_handle = nullptr;
+        }
+        return *this;
+    }
+    explicit Task(handle_t h) : m_handle(h) {}
+    ~Task()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept
+    {
+        m_handle.promise().continuation = awaiter;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().result(); }
+
+private:
+    handle_t m_handle;
+};
+
+template<class T>
+inline Task<T> detail::TaskPromise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+namespace detail {
+
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() {}
+    };
+};
+
+inline Detached RunDetached(EventLoop& loop, Task<void> task)
+{
+    try {
+        co_await task;
+    }
+    catch (...) {
+        rtLogError("Spawn(): unhandled exception in a task\n");
+    }
+    loop.releaseWork();
+}
+
+} // namespace detail
+
+// starts task on loop. loop.run() returns after all spawned tasks have finished.
+inline void Spawn(EventLoop& loop, Task<void> task)
+{
+    loop.addWork();
+    auto t = std::make_shared<Task<void>>(std::move(task));
+    loop.post([&loop, t]() { detail::RunDetached(loop, std::move(*t)); });
+}
+
+
+// awaitable version of TalkChannel. all coroutines resume on the thread that runs loop.
+//
+//  rt::Task<> talk(rt::AsyncTalkClient& client) {
+//      auto stats = co_await client.stats();
+//      auto stream = client.play(stats->params, "hello");
+//      while (auto ad = co_await stream.next())
+//          ...
+//  }
+class AsyncTalkClient
+{
+public:
+    class StatsAwaiter
+    {
+    public:
+        StatsAwaiter(AsyncTalkClient& client);
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        std::optional<TalkServerStats> await_resume();
+
+    private:
+        AsyncTalkClient& m_client;
+        std::optional<TalkServerStats> m_result;
+    };
+
+    class StopAwaiter
+    {
+    public:
+        StopAwaiter(AsyncTalkClient& client);
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        bool await_resume() const noexcept { return m_result; }
+
+    private:
+        AsyncTalkClient& m_client;
+        bool m_result = false;
+    };
+
+    // asynchronous generator of the audio of a talk. the talk begins when play() is called and frames are queued
+    // until they are consumed. next() yields std::nullopt at the end of the stream (the terminator is not yielded).
+    // destroying the stream doesn't stop the talk. use stop() for that.
+    class AudioStream
+    {
+    public:
+        class NextAwaiter
+        {
+        public:
+            NextAwaiter(AudioStream& stream);
+            bool await_ready() const;
+            bool await_suspend(std::coroutine_handle<> h);
+            std::optional<AudioData> await_resume();
+
+        private:
+            AudioStream& m_stream;
+        };
+
+        NextAwaiter next();
+        bool isFinished() const;
+        // valid after the end of the stream
+        bool succeeded() const;
+
+    private:
+        friend class AsyncTalkClient;
+        struct State;
+        AudioStream(std::shared_ptr<State> state);
+
+        std::shared_ptr<State> m_state;
+    };
+
+    AsyncTalkClient(const AsyncTalkClient&) = delete;
+    AsyncTalkClient& operator=(const AsyncTalkClient&) = delete;
+
+    AsyncTalkClient(EventLoop& loop, const TalkClientSettings& settings = {});
+
+    bool connect();
+    void close();
+    EventLoop& getLoop();
+    // the blocking API is available from here
+    TalkChannel& getChannel();
+
+    StatsAwaiter stats();
+    StopAwaiter stop();
+    AudioStream play(const TalkParams& params, const std::string& text);
+
+private:
+    void resume(std::coroutine_handle<> h);
+
+    EventLoop& m_loop;
+    TalkChannel m_channel;
+};
+
+#endif // rtEnableCoroutine
+
+} // namespace rt
@@ -0,0 +1,462 @@
+#include "pch.h"
+#include "rtFoundation.h"
+#include "rtTalkCache.h"
+#include "Poco/SharedMemory.h"
+#include "Poco/Process.h"
+
+namespace rt {
+
+static const uint32_t TalkCacheIndexMagic = 0x58435452; // "RTCX"
+static const uint32_t TalkCacheBlobMagic = 0x42435452;  // "RTCB"
+static const uint32_t TalkCacheVersion = 1;
+static const char TalkCacheIndexFile[] = "index.rtcx";
+static const char TalkCacheBlobExt[] = ".rtcb";
+static const char TalkCacheTempExt[] = ".tmp";
+
+struct TalkCache::IndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t count;
+    uint64_t usage;
+    uint64_t clock; // incremented on every access. last_access of entries.
+};
+
+// key 0 is an empty slot
+struct TalkCache::IndexEntry
+{
+    uint64_t key;
+    uint64_t size;
+    uint64_t last_access;
+};
+
+struct TalkCache::Blob::Header
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t format;
+    int32_t frequency;
+    int32_t channels;
+    uint32_t reserved;
+    uint64_t size;
+};
+
+static uint64_t FNV1a(uint64_t h, const void *data, size_t size)
+{
+    auto *p = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+
+AudioFormat TalkCache::Blob::getFormat() const { return (AudioFormat)m_header->format; }
+int TalkCache::Blob::getFrequency() const { return m_header->frequency; }
+int TalkCache::Blob::getChannels() const { return m_header->channels; }
+const void* TalkCache::Blob::getData() const { return m_header + 1; }
+size_t TalkCache::Blob::getSize() const { return (size_t)m_header->size; }
+
+void TalkCache::Blob::toAudioData(AudioData& dst) const
+{
+    dst.format = getFormat();
+    dst.frequency = getFrequency();
+    dst.channels = getChannels();
+    dst.data = SharedBuffer<char>::wrap(shared_from_this(), (const char*)getData(), getSize());
+}
+
+
+TalkCache::TalkCache()
+{
+}
+
+TalkCache::~TalkCache()
+{
+    close();
+}
+
+bool TalkCache::open(const std::string& dir, uint64_t budget, int capacity)
+{
+    close();
+    capacity = std::max(capacity, 16);
+    size_t index_size = sizeof(IndexHeader) + sizeof(IndexEntry) * capacity;
+
+    lock_t lock(m_mutex);
+    m_dir = dir;
+    m_budget = budget;
+    auto index_path = m_dir + "/" + TalkCacheIndexFile;
+    try {
+        Poco::File(m_dir).createDirectories();
+
+        // the mapping covers the whole file. make sure it has the right size.
+        Poco::File index_file(index_path);
+        if (!index_file.exists() || index_file.getSize() != index_size) {
+            std::ofstream fo(index_path, std::ios::binary | std::ios::trunc);
+            std::vector<char> zero(index_size);
+            fo.write(zero.data(), zero.size());
+            if (!fo) {
+                rtLogError("TalkCache::open(): failed to create %s\n", index_path.c_str());
+                return false;
+            }
+        }
+        m_index = std::make_shared<Poco::SharedMemory>(index_file, Poco::SharedMemory::AM_WRITE);
+    }
+    catch (Poco::Exception& e) {
+        rtLogError("TalkCache::open() failed: %s\n", e.displayText().c_str());
+        m_index.reset();
+        return false;
+    }
+
+    auto *header = getHeader();
+    if (header->magic != TalkCacheIndexMagic || header->version != TalkCacheVersion || header->capacity != (uint32_t)capacity) {
+        // new or broken. start over.
+        memset(m_index->begin(), 0, index_size);
+        header->magic = TalkCacheIndexMagic;
+        header->version = TalkCacheVersion;
+        header->capacity = (uint32_t)capacity;
+    }
+    sweep();
+
+    std::vector<std::string> removed;
+    evict(0, 0, removed);
+    lock.unlock();
+    for (auto& path : removed)
+        std::remove(path.c_str());
+    return true;
+}
+
+void TalkCache::close()
+{
+    lock_t lock(m_mutex);
+    m_index.reset();
+}
+
+bool TalkCache::isOpened() const
+{
+    lock_t lock(m_mutex);
+    return m_index != nullptr;
+}
+
+bool TalkCache::RemoveAll(const std::string& dir)
+{
+    try {
+        Poco::File file(dir);
+        if (file.exists())
+            file.remove(true);
+        return true;
+    }
+    catch (Poco::Exception& e) {
+        rtLogError("TalkCache::RemoveAll() failed: %s\n", e.displayText().c_str());
+        return false;
+    }
+}
+
+uint64_t TalkCache::Fingerprint(const std::string& host, const std::string& cast, const TalkParams& params, const std::string& text)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    h = FNV1a(h, host.c_str(), host.size() + 1);
+    h = FNV1a(h, cast.c_str(), cast.size() + 1);
+    h = FNV1a(h, &params.force_mono, sizeof(params.force_mono));
+    h = FNV1a(h, &params.cast, sizeof(params.cast));
+    for (int i = 0; i < TalkParams::MaxParams; ++i) {
+        if (params.isSet(i)) {
+            h = FNV1a(h, &i, sizeof(i));
+            h = FNV1a(h, &params.params[i], sizeof(float));
+        }
+    }
+    h = FNV1a(h, text.c_str(), text.size());
+    return h != 0 ? h : 1;
+}
+
+TalkCache::BlobPtr TalkCache::read(uint64_t key)
+{
+    std::string path;
+    {
+        lock_t lock(m_mutex);
+        if (!m_index)
+            return nullptr;
+        int slot = find(key);
+        if (slot < 0)
+            return nullptr;
+        getEntries()[slot].last_access = ++getHeader()->clock;
+        path = getPath(key);
+    }
+
+    auto ret = std::make_shared<Blob>();
+    try {
+        ret->m_map = std::make_shared<Poco::SharedMemory>(Poco::File(path), Poco::SharedMemory::AM_READ);
+        ret->m_header = (const Blob::Header*)ret->m_map->begin();
+    }
+    catch (Poco::Exception&) {
+        ret->m_header = nullptr;
+    }
+
+    auto *header = ret->m_header;
+    size_t file_size = ret->m_map ? (size_t)(ret->m_map->end() - ret->m_map->begin()) : 0;
+    if (!header || file_size < sizeof(Blob::Header) ||
+        header->magic != TalkCacheBlobMagic || header->version != TalkCacheVersion ||
+        sizeof(Blob::Header) + header->size > file_size)
+    {
+        // removed or broken by someone else
+        rtLogWarning("TalkCache::read(): %s is broken\n", path.c_str());
+        ret.reset();
+        remove(key);
+        return nullptr;
+    }
+    return ret;
+}
+
+bool TalkCache::contains(uint64_t key)
+{
+    lock_t lock(m_mutex);
+    return m_index && find(key) >= 0;
+}
+
+bool TalkCache::write(uint64_t key, const AudioData& data)
+{
+    uint64_t size = sizeof(Blob::Header) + data.data.size();
+    std::string path, tmp_path;
+    {
+        lock_t lock(m_mutex);
+        if (!m_index || size > m_budget)
+            return false;
+        path = getPath(key);
+    }
+    {
+        // unique per writer. concurrent writers of the same key must not write to the same file.
+        static std::atomic_uint s_count{ 0 };
+        char suffix[64];
+        sprintf(suffix, ".%d.%u%s", (int)Poco::Process::id(), s_count++, TalkCacheTempExt);
+        tmp_path = path + suffix;
+    }
+
+    // write to a temporary file and rename. a reader never sees a partially written file.
+    {
+        Blob::Header header{};
+        header.magic = TalkCacheBlobMagic;
+        header.version = TalkCacheVersion;
+        header.format = (int32_t)data.format;
+        header.frequency = data.frequency;
+        header.channels = data.channels;
+        header.size = data.data.size();
+
+        std::ofstream fo(tmp_path, std::ios::binary | std::ios::trunc);
+        fo.write((const char*)&header, sizeof(header));
+        fo.write(data.data.data(), data.data.size());
+        if (!fo) {
+            fo.close();
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+
+    std::vector<std::string> removed;
+    bool ret = false;
+    {
+        lock_t lock(m_mutex);
+        if (m_index) {
+            // replacing the same key. release its space first.
+            int slot = find(key);
+            if (slot >= 0)
+                erase(slot);
+
+            std::remove(path.c_str());
+            if (std::rename(tmp_path.c_str(), path.c_str()) == 0) {
+                evict(size, 1, removed);
+
+                auto *header = getHeader();
+                auto *entries = getEntries();
+                int cap = (int)header->capacity;
+                int i = (int)(key % (uint64_t)cap);
+                while (entries[i].key != 0)
+                    i = (i + 1) % cap;
+                entries[i].key = key;
+                entries[i].size = size;
+                entries[i].last_access = ++header->clock;
+                header->count++;
+                header->usage += size;
+                ret = true;
+            }
+        }
+    }
+    if (!ret)
+        std::remove(tmp_path.c_str());
+    for (auto& p : removed)
+        std::remove(p.c_str());
+    return ret;
+}
+
+bool TalkCache::remove(uint64_t key)
+{
+    std::string path;
+    {
+        lock_t lock(m_mutex);
+        if (!m_index)
+            return false;
+        int slot = find(key);
+        if (slot < 0)
+            return false;
+        erase(slot);
+        path = getPath(key);
+    }
+    std::remove(path.c_str());
+    return true;
+}
+
+void TalkCache::clear()
+{
+    lock_t lock(m_mutex);
+    if (!m_index)
+        return;
+    reset();
+    sweep();
+}
+
+uint64_t TalkCache::getBudget() const
+{
+    lock_t lock(m_mutex);
+    return m_budget;
+}
+
+void TalkCache::setBudget(uint64_t v)
+{
+    std::vector<std::string> removed;
+    {
+        lock_t lock(m_mutex);
+        m_budget = v;
+        if (m_index)
+            evict(0, 0, removed);
+    }
+    for (auto& path : removed)
+        std::remove(path.c_str());
+}
+
+uint64_t TalkCache::getUsage() const
+{
+    lock_t lock(m_mutex);
+    return m_index ? getHeader()->usage : 0;
+}
+
+int TalkCache::getEntryCount() const
+{
+    lock_t lock(m_mutex);
+    return m_index ? (int)getHeader()->count : 0;
+}
+
+TalkCache::IndexHeader* TalkCache::getHeader() const
+{
+    return (IndexHeader*)m_index->begin();
+}
+
+TalkCache::IndexEntry* TalkCache::getEntries() const
+{
+    return (IndexEntry*)(getHeader() + 1);
+}
+
+int TalkCache::find(uint64_t key) const
+{
+    // linear probing. the table is never full (see evict()), so an empty slot always ends the search.
+    auto *entries = getEntries();
+    int cap = (int)getHeader()->capacity;
+    for (int i = (int)(key % (uint64_t)cap); entries[i].key != 0; i = (i + 1) % cap) {
+        if (entries[i].key == key)
+            return i;
+    }
+    return -1;
+}
+
+void TalkCache::erase(int slot)
+{
+    auto *header = getHeader();
+    auto *entries = getEntries();
+    int cap = (int)header->capacity;
+    header->count--;
+    header->usage -= entries[slot].size;
+
+    // move following entries back so that probing doesn't stop at the hole
+    int i = slot;
+    int j = slot;
+    for (;;) {
+        entries[i] = IndexEntry{};
+        for (;;) {
+            j = (j + 1) % cap;
+            if (entries[j].key == 0)
+                return;
+            int home = (int)(entries[j].key % (uint64_t)cap);
+            // entries[j] can stay if its home is cyclically in (i, j]
+            bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+            if (!stays)
+                break;
+        }
+        entries[i] = entries[j];
+        i = j;
+    }
+}
+
+void TalkCache::evict(uint64_t size_to_add, int entries_to_add, std::vector<std::string>& removed)
+{
+    auto *header = getHeader();
+    auto *entries = getEntries();
+    int cap = (int)header->capacity;
+    // keep 1/4 of the table empty. long probe sequences make lookups slow.
+    int max_entries = cap * 3 / 4;
+    while (header->count > 0 &&
+        (header->usage + size_to_add > m_budget || (int)header->count + entries_to_add > max_entries))
+    {
+        int lru = -1;
+        for (int i = 0; i < cap; ++i) {
+            if (entries[i].key != 0 && (lru < 0 || entries[i].last_access < entries[lru].last_access))
+                lru = i;
+        }
+        removed.push_back(getPath(entries[lru].key));
+        erase(lru);
+    }
+}
+
+void TalkCache::reset()
+{
+    auto *header = getHeader();
+    memset(getEntries(), 0, sizeof(IndexEntry) * header->capacity);
+    header->count = 0;
+    header->usage = 0;
+    header->clock = 0;
+}
+
+void TalkCache::sweep()
+{
+    // files not in the index. left by a crash, or couldn't be removed because they were mapped at that time.
+    std::vector<std::string> orphans;
+    try {
+        Poco::DirectoryIterator end;
+        for (Poco::DirectoryIterator it(m_dir); it != end; ++it) {
+            auto name = it.name();
+            auto ext_pos = name.rfind('.');
+            if (ext_pos == std::string::npos)
+                continue;
+            auto ext = name.substr(ext_pos);
+            if (ext == TalkCacheTempExt) {
+                orphans.push_back(it.path().toString());
+            }
+            else if (ext == TalkCacheBlobExt) {
+                auto key = std::strtoull(name.substr(0, ext_pos).c_str(), nullptr, 16);
+                if (key == 0 || find(key) < 0)
+                    orphans.push_back(it.path().toString());
+            }
+        }
+    }
+    catch (Poco::Exception&) {
+    }
+    for (auto& path : orphans)
+        std::remove(path.c_str());
+}
+
+std::string TalkCache::getPath(uint64_t key) const
+{
+    char name[64];
+    sprintf(name, "/%016llx%s", (unsigned long long)key, TalkCacheBlobExt);
+    return m_dir + name;
+}
+
+} // namespace rt
@@ -0,0 +1,97 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "rtAudioData.h"
+#include "rtTalkInterface.h"
+
+namespace Poco {
+    class SharedMemory;
+}
+
+namespace rt {
+
+// content-addressed store of rendered talks on disk. the key is the fingerprint of the request.
+// audio is stored as raw samples, so a hit is read by mapping the file. nothing is decoded or copied.
+// the index is a fixed size hash table in a memory mapped file. least recently used entries are evicted
+// to keep the total size within the budget.
+// thread safe within a process. a cache directory must not be opened by multiple processes at the same time.
+class TalkCache
+{
+public:
+    static const int DefaultCapacity = 4096; // max entries
+
+    // mapped cache file. stays valid while held even if the entry is evicted meanwhile.
+    class Blob : public std::enable_shared_from_this<Blob>
+    {
+    public:
+        AudioFormat getFormat() const;
+        int getFrequency() const;
+        int getChannels() const;
+        const void* getData() const;
+        size_t getSize() const; // in bytes
+        // dst shares the mapped samples and keeps this blob alive. they are copied only if dst is modified.
+        void toAudioData(AudioData& dst) const;
+
+    private:
+        friend class TalkCache;
+        struct Header;
+        std::shared_ptr<Poco::SharedMemory> m_map;
+        const Header *m_header = nullptr;
+    };
+    using BlobPtr = std::shared_ptr<Blob>;
+
+    TalkCache(const TalkCache&) = delete;
+    TalkCache& operator=(const TalkCache&) = delete;
+
+    TalkCache();
+    ~TalkCache();
+
+    // creates dir and the index if they don't exist. files in dir that aren't in the index are removed.
+    bool open(const std::string& dir, uint64_t budget, int capacity = DefaultCapacity);
+    void close();
+    bool isOpened() const;
+    // deletes dir and everything in it. it must not be opened.
+    static bool RemoveAll(const std::string& dir);
+
+    // host and cast name are included because cast ids and parameters mean different voices on different hosts.
+    // mute is excluded. it doesn't change the audio.
+    static uint64_t Fingerprint(const std::string& host, const std::string& cast, const TalkParams& params, const std::string& text);
+
+    // null on miss. a hit makes the entry the most recently used.
+    BlobPtr read(uint64_t key);
+    bool contains(uint64_t key);
+    // fails if data is larger than the budget. older entries are evicted to make room.
+    bool write(uint64_t key, const AudioData& data);
+    bool remove(uint64_t key);
+    void clear();
+
+    uint64_t getBudget() const;
+    // evicts entries if the new budget is smaller than the usage
+    void setBudget(uint64_t v);
+    uint64_t getUsage() const; // total size of cached files in bytes
+    int getEntryCount() const;
+
+private:
+    struct IndexHeader;
+    struct IndexEntry;
+    using lock_t = std::unique_lock<std::mutex>;
+
+    IndexHeader* getHeader() const;
+    IndexEntry* getEntries() const;
+    int find(uint64_t key) const;
+    void erase(int slot);
+    // returns paths of evicted files. they are removed after unlocking.
+    void evict(uint64_t size_to_add, int entries_to_add, std::vector<std::string>& removed);
+    void reset();
+    void sweep();
+    std::string getPath(uint64_t key) const;
+
+    mutable std::mutex m_mutex;
+    std::shared_ptr<Poco::SharedMemory> m_index;
+    std::string m_dir;
+    uint64_t m_budget = 0;
+};
+
+} // namespace rt
@@ -0,0 +1,700 @@
+#include "pch.h"
+#include "rtFoundation.h"
+#include "rtSerialization.h"
+#include "rtTalkChannel.h"
+
+namespace rt {
+
+using namespace Poco::Net;
+
+class ChannelSocket
+{
+public:
+    ChannelSocket(const WebSocket& ws);
+    WebSocket& socket();
+    bool send(const ChannelHeader& header, const void *payload, size_t size);
+    // frame must begin with sizeof(ChannelHeader) bytes of space. header will be written into there.
+    bool sendFrame(const ChannelHeader& header, RawVector<char>& frame);
+    bool pong(const void *payload, size_t size);
+    void shutdown();
+
+private:
+    using lock_t = std::unique_lock<std::mutex>;
+
+    std::mutex m_mutex;
+    WebSocket m_ws;
+    bool m_closed = false;
+};
+
+ChannelSocket::ChannelSocket(const WebSocket& ws)
+    : m_ws(ws)
+{
+}
+
+WebSocket& ChannelSocket::socket()
+{
+    return m_ws;
+}
+
+bool ChannelSocket::send(const ChannelHeader& header, const void *payload, size_t size)
+{
+    RawVector<char> frame;
+    frame.resize(sizeof(ChannelHeader));
+    if (size > 0)
+        frame.insert(frame.end(), (const char*)payload, (const char*)payload + size);
+    return sendFrame(header, frame);
+}
+
+bool ChannelSocket::sendFrame(const ChannelHeader& header, RawVector<char>& frame)
+{
+    memcpy(frame.data(), &header, sizeof(header));
+
+    lock_t lock(m_mutex);
+    if (m_closed)
+        return false;
+    try {
+        m_ws.sendFrame(frame.data(), (int)frame.size(), WebSocket::FRAME_BINARY);
+        return true;
+    }
+    catch (Poco::Exception&) {
+        m_closed = true;
+        return false;
+    }
+}
+
+bool ChannelSocket::pong(const void *payload, size_t size)
+{
+    lock_t lock(m_mutex);
+    if (m_closed)
+        return false;
+    try {
+        m_ws.sendFrame(payload, (int)size, WebSocket::FRAME_FLAG_FIN | WebSocket::FRAME_OP_PONG);
+        return true;
+    }
+    catch (Poco::Exception&) {
+        m_closed = true;
+        return false;
+    }
+}
+
+void ChannelSocket::shutdown()
+{
+    lock_t lock(m_mutex);
+    if (m_closed)
+        return;
+    m_closed = true;
+    try {
+        m_ws.shutdown();
+    }
+    catch (Poco::Exception&) {
+    }
+}
+
+
+// ostream adapter that sends written data as a channel frame on flush
+class ChannelStreamBuf : public std::streambuf
+{
+public:
+    ChannelStreamBuf(ChannelSocketPtr socket, uint32_t id);
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+    int sync() override;
+
+private:
+    ChannelSocketPtr m_socket;
+    ChannelHeader m_header;
+    RawVector<char> m_frame;
+};
+
+ChannelStreamBuf::ChannelStreamBuf(ChannelSocketPtr socket, uint32_t id)
+    : m_socket(socket)
+{
+    m_header.id = id;
+    m_header.command = ChannelCommand::Audio;
+    m_frame.resize(sizeof(ChannelHeader));
+}
+
+ChannelStreamBuf::int_type ChannelStreamBuf::overflow(int_type c)
+{
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+        m_frame.push_back(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+}
+
+std::streamsize ChannelStreamBuf::xsputn(const char *s, std::streamsize n)
+{
+    m_frame.insert(m_frame.end(), s, s + n);
+    return n;
+}
+
+int ChannelStreamBuf::sync()
+{
+    if (m_frame.size() == sizeof(ChannelHeader))
+        return 0;
+    bool ok = m_socket->sendFrame(m_header, m_frame);
+    m_frame.resize(sizeof(ChannelHeader));
+    return ok ? 0 : -1;
+}
+
+
+// istream adapter for received payloads
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+    MemoryStreamBuf(const char *data, size_t size)
+    {
+        auto *p = (char*)data;
+        setg(p, p, p + size);
+    }
+};
+
+
+class ChannelSession
+{
+public:
+    ChannelSession(TalkServer& server, const WebSocket& ws);
+    void run();
+
+private:
+    using MessagePtr = TalkServer::MessagePtr;
+    using Status = TalkServer::Status;
+
+    void onStats(uint32_t id);
+    void onTalk(uint32_t id, const char *payload, size_t size);
+    void onStop(uint32_t id, const char *payload, size_t size);
+    void waitAsync(MessagePtr mes, const std::function<void(bool)>& on_complete);
+    void sendEnd(uint32_t id, Status status);
+
+    TalkServer& m_server;
+    ChannelSocketPtr m_socket;
+    std::vector<std::future<void>> m_tasks;
+};
+
+ChannelSession::ChannelSession(TalkServer& server, const WebSocket& ws)
+    : m_server(server)
+    , m_socket(std::make_shared<ChannelSocket>(ws))
+{
+}
+
+void ChannelSession::run()
+{
+    auto& ws = m_socket->socket();
+    Poco::Buffer<char> buf(0);
+    for (;;) {
+        int flags = 0;
+        int n = 0;
+        try {
+            buf.resize(0);
+            n = ws.receiveFrame(buf, flags);
+        }
+        catch (Poco::TimeoutException&) {
+            // idle connection. keep it.
+            continue;
+        }
+        catch (Poco::Exception&) {
+            break;
+        }
+
+        int op = flags & WebSocket::FRAME_OP_BITMASK;
+        if ((n == 0 && flags == 0) || op == WebSocket::FRAME_OP_CLOSE)
+            break;
+        if (op == WebSocket::FRAME_OP_PING) {
+            m_socket->pong(buf.begin(), n);
+            continue;
+        }
+        if (op != WebSocket::FRAME_OP_BINARY || n < (int)sizeof(ChannelHeader))
+            continue;
+
+        ChannelHeader header;
+        memcpy(&header, buf.begin(), sizeof(header));
+        const char *payload = buf.begin() + sizeof(header);
+        size_t payload_size = n - sizeof(header);
+        switch (header.command) {
+        case ChannelCommand::Stats: onStats(header.id); break;
+        case ChannelCommand::Talk: onTalk(header.id, payload, payload_size); break;
+        case ChannelCommand::Stop: onStop(header.id, payload, payload_size); break;
+        default: sendEnd(header.id, Status::Failed); break;
+        }
+
+        // release finished tasks
+        m_tasks.erase(
+            std::remove_if(m_tasks.begin(), m_tasks.end(), [](std::future<void>& f) {
+                return f.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready; }),
+            m_tasks.end());
+    }
+
+    for (auto& task : m_tasks)
+        task.wait();
+    m_socket->shutdown();
+}
+
+void ChannelSession::onStats(uint32_t id)
+{
+    auto mes = std::make_shared<TalkServer::StatsMessage>();
+    m_server.addMessage(mes);
+    waitAsync(mes, [this, id, mes](bool ok) {
+        if (!ok) {
+            sendEnd(id, Status::Failed);
+            return;
+        }
+        auto json = mes->to_json();
+        ChannelHeader header;
+        header.id = id;
+        header.command = ChannelCommand::Stats;
+        header.status = (uint8_t)mes->status;
+        m_socket->send(header, json.data(), json.size());
+    });
+}
+
+void ChannelSession::onTalk(uint32_t id, const char *payload, size_t size)
+{
+    auto mes = std::make_shared<TalkServer::TalkMessage>();
+    if (!mes->from_json(std::string(payload, size))) {
+        sendEnd(id, Status::Failed);
+        return;
+    }
+    mes->text = ToANSI(mes->text.c_str());
+    if (mes->request_id == 0)
+        mes->request_id = Tracer::NewRequestId();
+
+    // same single-flight and admission as "/talk"
+    bool leader = false;
+    float wait;
+    auto flight_key = mes->getFlightKey();
+    auto flight = m_server.beginFlight(*mes, m_server.getSettings().max_wait_ms, leader, wait);
+    if (!flight) {
+        sendEnd(id, Status::Failed);
+        return;
+    }
+
+    auto buf = std::make_shared<ChannelStreamBuf>(m_socket, id);
+    auto os = std::make_shared<std::ostream>(buf.get());
+    mes->respond_stream = os.get();
+
+    if (leader) {
+        mes->flight = flight;
+        m_server.addMessage(mes);
+        waitAsync(mes, [this, id, mes, buf, os, flight, flight_key](bool ok) {
+            os->flush();
+            m_server.endTalk(*mes);
+            m_server.endFlight(flight_key, flight, ok);
+            sendEnd(id, ok ? mes->status : Status::Failed);
+        });
+    }
+    else {
+        // replay frames already produced and then follow the leader
+        flight->addFollower(1);
+        m_tasks.push_back(std::async(std::launch::async, [this, id, flight, buf, os]() {
+            size_t pos = 0;
+            std::vector<AudioDataPtr> frames;
+            while (flight->read(pos, frames)) {
+                for (auto& frame : frames)
+                    frame->serialize(*os);
+                os->flush();
+                frames.clear();
+            }
+            flight->addFollower(-1);
+            sendEnd(id, flight->isSucceeded() ? Status::Succeeded : Status::Failed);
+        }));
+    }
+}
+
+void ChannelSession::onStop(uint32_t id, const char *payload, size_t size)
+{
+    auto mes = std::make_shared<TalkServer::StopMessage>();
+    mes->request_id = Tracer::NewRequestId();
+    if (size > 0) {
+        // same as "/stop?id="
+        mes->target = Tracer::ParseRequestId(std::string(payload, size));
+        if (mes->target == 0) {
+            sendEnd(id, Status::Failed);
+            return;
+        }
+        if (m_server.cancelQueuedTalk(mes->target)) {
+            // hasn't started. nothing to stop.
+            sendEnd(id, Status::Succeeded);
+            return;
+        }
+    }
+    m_server.addMessage(mes);
+    waitAsync(mes, [this, id, mes](bool ok) {
+        sendEnd(id, ok ? mes->status : Status::Failed);
+    });
+}
+
+void ChannelSession::waitAsync(MessagePtr mes, const std::function<void(bool)>& on_complete)
+{
+    m_tasks.push_back(std::async(std::launch::async, [mes, on_complete]() {
+        on_complete(mes->wait());
+    }));
+}
+
+void ChannelSession::sendEnd(uint32_t id, Status status)
+{
+    ChannelHeader header;
+    header.id = id;
+    header.command = ChannelCommand::End;
+    header.status = (uint8_t)status;
+    m_socket->send(header, nullptr, 0);
+}
+
+void ServeChannel(TalkServer& server, HTTPServerRequest& request, HTTPServerResponse& response)
+{
+    try {
+        WebSocket ws(request, response);
+        ChannelSession session(server, ws);
+        session.run();
+    }
+    catch (WebSocketException&) {
+        // not a WebSocket handshake
+        response.setStatusAndReason(HTTPResponse::HTTP_BAD_REQUEST);
+        response.setContentLength(0);
+        response.send();
+    }
+}
+
+
+
+TalkChannel::TalkChannel(const TalkClientSettings& settings)
+    : m_settings(settings)
+{
+}
+
+TalkChannel::~TalkChannel()
+{
+    close();
+}
+
+bool TalkChannel::connect()
+{
+    if (isConnected())
+        return true;
+    close();
+
+    ChannelSocketPtr socket;
+    try {
+        HTTPClientSession session{ m_settings.server, m_settings.port };
+        session.setTimeout(m_settings.timeout_ms * 1000);
+
+        HTTPRequest request{ HTTPRequest::HTTP_GET, "/channel", HTTPRequest::HTTP_1_1 };
+        HTTPResponse response;
+        WebSocket ws(session, request, response);
+        socket = std::make_shared<ChannelSocket>(ws);
+    }
+    catch (Poco::Exception&) {
+        return false;
+    }
+
+    {
+        lock_t lock(m_mutex);
+        m_socket = socket;
+    }
+    m_receiving = true;
+    m_receiver = std::thread([this, socket]() { receiveLoop(socket); });
+    return true;
+}
+
+void TalkChannel::close()
+{
+    m_receiving = false;
+    if (m_receiver.joinable()) {
+        // called from a callback, which runs on the receiving thread. it can't join itself.
+        // the loop exits when the callback returns, as the socket is shut down below.
+        if (m_receiver.get_id() == std::this_thread::get_id())
+            m_receiver.detach();
+        else
+            m_receiver.join();
+    }
+
+    ChannelSocketPtr socket;
+    {
+        lock_t lock(m_mutex);
+        socket.swap(m_socket);
+    }
+    if (socket)
+        socket->shutdown();
+    cancelRequests();
+}
+
+bool TalkChannel::isConnected() const
+{
+    lock_t lock(m_mutex);
+    return m_socket && m_receiving;
+}
+
+bool TalkChannel::stats(TalkServerStats& stats)
+{
+    auto req = std::make_shared<Request>();
+    if (!request(ChannelCommand::Stats, "", req))
+        return false;
+
+    TalkServer::StatsMessage mes;
+    if (mes.from_json(req->payload)) {
+        stats = std::move(mes.stats);
+        return true;
+    }
+    return false;
+}
+
+bool TalkChannel::play(const TalkParams& params, const std::string& text, const AudioCallback& cb)
+{
+    TalkServer::TalkMessage mes;
+    mes.params = params;
+    mes.text = text;
+    mes.request_id = Tracer::NewRequestId();
+
+    auto req = std::make_shared<Request>();
+    req->callback = cb;
+    req->talk_id = mes.request_id;
+    return request(ChannelCommand::Talk, mes.to_json(), req);
+}
+
+bool TalkChannel::stop()
+{
+    // one targeted stop per talk. an untargeted stop would abort whatever the server is playing,
+    // which may be a talk of another client.
+    std::vector<RequestPtr> reqs;
+    for (auto talk_id : getTalkIds()) {
+        auto req = std::make_shared<Request>();
+        send(ChannelCommand::Stop, Tracer::ToString(talk_id), req);
+        reqs.push_back(req);
+    }
+
+    bool ret = true;
+    lock_t lock(m_mutex);
+    for (auto& req : reqs) {
+        m_cond.wait(lock, [&req]() { return req->finished; });
+        ret = ret && req->succeeded;
+    }
+    return ret;
+}
+
+void TalkChannel::statsAsync(const StatsCallback& on_complete)
+{
+    auto req = std::make_shared<Request>();
+    auto *r = req.get();
+    req->on_complete = [r, on_complete](bool ok) {
+        TalkServer::StatsMessage mes;
+        ok = ok && mes.from_json(r->payload);
+        if (on_complete)
+            on_complete(ok, mes.stats);
+    };
+    send(ChannelCommand::Stats, "", req);
+}
+
+void TalkChannel::playAsync(const TalkParams& params, const std::string& text, const AudioCallback& cb, const CompletionCallback& on_complete)
+{
+    TalkServer::TalkMessage mes;
+    mes.params = params;
+    mes.text = text;
+    mes.request_id = Tracer::NewRequestId();
+
+    auto req = std::make_shared<Request>();
+    req->callback = cb;
+    req->on_complete = on_complete;
+    req->talk_id = mes.request_id;
+    send(ChannelCommand::Talk, mes.to_json(), req);
+}
+
+void TalkChannel::stopAsync(const CompletionCallback& on_complete)
+{
+    // same as stop(). on_complete is called when all the stops have completed.
+    auto talk_ids = getTalkIds();
+    if (talk_ids.empty()) {
+        if (on_complete)
+            on_complete(true);
+        return;
+    }
+
+    struct Join
+    {
+        std::atomic_int left{ 0 };
+        std::atomic_bool succeeded{ true };
+        CompletionCallback on_complete;
+    };
+    auto join = std::make_shared<Join>();
+    join->left = (int)talk_ids.size();
+    join->on_complete = on_complete;
+    for (auto talk_id : talk_ids) {
+        auto req = std::make_shared<Request>();
+        req->on_complete = [join](bool ok) {
+            if (!ok)
+                join->succeeded = false;
+            if (--join->left == 0 && join->on_complete)
+                join->on_complete(join->succeeded);
+        };
+        send(ChannelCommand::Stop, Tracer::ToString(talk_id), req);
+    }
+}
+
+bool TalkChannel::request(ChannelCommand command, const std::string& payload, RequestPtr req)
+{
+    // blocking requests are asynchronous ones that wait for completion
+    send(command, payload, req);
+    lock_t lock(m_mutex);
+    m_cond.wait(lock, [&req]() { return req->finished; });
+    return req->succeeded;
+}
+
+bool TalkChannel::send(ChannelCommand command, const std::string& payload, RequestPtr req)
+{
+    req->command = command;
+    ChannelSocketPtr socket;
+    ChannelHeader header;
+    header.command = command;
+    {
+        lock_t lock(m_mutex);
+        if (m_socket && m_receiving) {
+            socket = m_socket;
+            header.id = ++m_id_seed;
+            m_requests[header.id] = req;
+        }
+    }
+    if (socket) {
+        if (socket->send(header, payload.data(), payload.size()))
+            return true;
+
+        lock_t lock(m_mutex);
+        // already completed by cancelRequests() if it has been removed
+        if (m_requests.erase(header.id) == 0)
+            return false;
+    }
+    complete(req, false);
+    return false;
+}
+
+void TalkChannel::complete(RequestPtr req, bool succeeded)
+{
+    if (req->callback && !req->terminated) {
+        // make sure callback always receives the terminator
+        req->terminated = true;
+        req->callback(AudioData());
+    }
+
+    CompletionCallback on_complete;
+    {
+        lock_t lock(m_mutex);
+        req->succeeded = succeeded;
+        req->finished = true;
+        // on_complete may hold req. releasing it here breaks the cycle.
+        on_complete = std::move(req->on_complete);
+        req->on_complete = nullptr;
+    }
+    m_cond.notify_all();
+    if (on_complete)
+        on_complete(succeeded);
+}
+
+std::vector<uint64_t> TalkChannel::getTalkIds()
+{
+    std::vector<uint64_t> ret;
+    lock_t lock(m_mutex);
+    for (auto& kvp : m_requests) {
+        if (kvp.second->command == ChannelCommand::Talk && kvp.second->talk_id != 0)
+            ret.push_back(kvp.second->talk_id);
+    }
+    return ret;
+}
+
+void TalkChannel::receiveLoop(ChannelSocketPtr socket)
+{
+    auto& ws = socket->socket();
+    Poco::Buffer<char> buf(0);
+    while (m_receiving) {
+        try {
+            if (!ws.poll(Poco::Timespan(100 * 1000), Socket::SELECT_READ))
+                continue;
+
+            int flags = 0;
+            buf.resize(0);
+            int n = ws.receiveFrame(buf, flags);
+
+            int op = flags & WebSocket::FRAME_OP_BITMASK;
+            if ((n == 0 && flags == 0) || op == WebSocket::FRAME_OP_CLOSE)
+                break;
+            if (op == WebSocket::FRAME_OP_PING) {
+                socket->pong(buf.begin(), n);
+                continue;
+            }
+            if (op != WebSocket::FRAME_OP_BINARY || n < (int)sizeof(ChannelHeader))
+                continue;
+
+            ChannelHeader header;
+            memcpy(&header, buf.begin(), sizeof(header));
+            dispatch(header, buf.begin() + sizeof(header), n - sizeof(header));
+        }
+        catch (Poco::TimeoutException&) {
+        }
+        catch (Poco::Exception&) {
+            break;
+        }
+    }
+
+    // if close() has been called from a callback, this thread is detached and the channel may be connected again.
+    // the requests belong to the new connection then.
+    bool current;
+    {
+        lock_t lock(m_mutex);
+        current = m_socket == socket;
+    }
+    if (current) {
+        m_receiving = false;
+        cancelRequests();
+    }
+}
+
+void TalkChannel::dispatch(const ChannelHeader& header, const char *payload, size_t size)
+{
+    RequestPtr req;
+    {
+        lock_t lock(m_mutex);
+        auto it = m_requests.find(header.id);
+        if (it == m_requests.end())
+            return;
+        req = it->second;
+        if (header.command == ChannelCommand::End || header.command == ChannelCommand::Stats)
+            m_requests.erase(it);
+    }
+
+    switch (header.command) {
+    case ChannelCommand::Audio:
+    {
+        MemoryStreamBuf buf(payload, size);
+        std::istream is(&buf);
+        AudioData ad;
+        while (is.peek() != std::char_traits<char>::eof()) {
+            ad.deserialize(is);
+            if (!is)
+                break;
+            if (ad.data.empty())
+                req->terminated = true;
+            if (req->callback)
+                req->callback(ad);
+        }
+        return;
+    }
+    case ChannelCommand::Stats:
+        req->payload.assign(payload, size);
+        break;
+    default:
+        break;
+    }
+
+    // Stats or End
+    complete(req, (TalkServer::Status)header.status == TalkServer::Status::Succeeded);
+}
+
+void TalkChannel::cancelRequests()
+{
+    std::map<uint32_t, RequestPtr> requests;
+    {
+        lock_t lock(m_mutex);
+        requests.swap(m_requests);
+    }
+    for (auto& kvp : requests)
+        complete(kvp.second, false);
+}
+
+} // namespace rt
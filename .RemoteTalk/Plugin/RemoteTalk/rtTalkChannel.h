@@ -0,0 +1,117 @@
+#pragma once
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include "rtTalkServer.h"
+#include "rtTalkClient.h"
+
+namespace Poco {
+    namespace Net {
+        class WebSocket;
+    }
+}
+
+namespace rt {
+
+// "/channel" is a WebSocket connection that multiplexes talk / stop / stats requests and the audio stream.
+// every frame is a binary frame that begins with ChannelHeader. id is chosen by the client and echoed back by the server.
+//  client -> server: Stats, Talk (payload: TalkMessage json), Stop (payload: request id of the talk to abort, empty to stop whatever is playing)
+//  server -> client: Stats (payload: stats json), Audio (payload: serialized AudioData sequence), End (status of the request)
+enum class ChannelCommand : uint8_t
+{
+    Unknown = 0,
+    Stats,
+    Talk,
+    Stop,
+    Audio,
+    End,
+};
+
+#pragma pack(push, 1)
+struct ChannelHeader
+{
+    uint32_t id = 0;
+    ChannelCommand command = ChannelCommand::Unknown;
+    uint8_t status = 0; // TalkServer::Status
+    uint16_t reserved = 0;
+};
+#pragma pack(pop)
+
+void ServeChannel(TalkServer& server, Poco::Net::HTTPServerRequest& request, Poco::Net::HTTPServerResponse& response);
+
+
+class ChannelSocket;
+using ChannelSocketPtr = std::shared_ptr<ChannelSocket>;
+
+// client side of "/channel".
+// callbacks are called from the receiving thread. close() can be called from them but the channel must not be destroyed there.
+class TalkChannel
+{
+public:
+    using AudioCallback = std::function<void(const AudioData&)>;
+    using CompletionCallback = std::function<void(bool succeeded)>;
+    using StatsCallback = std::function<void(bool succeeded, TalkServerStats& stats)>;
+
+    TalkChannel(const TalkChannel&) = delete;
+    TalkChannel& operator=(const TalkChannel&) = delete;
+
+    TalkChannel(const TalkClientSettings& settings = {});
+    ~TalkChannel();
+
+    bool connect();
+    void close();
+    bool isConnected() const;
+
+    // same semantics as TalkClient. these can be called from multiple threads at the same time.
+    // e.g. play() on one thread and stop() on another share the connection and don't need to re-connect.
+    bool stats(TalkServerStats& stats);
+    bool play(const TalkParams& params, const std::string& text, const AudioCallback& cb);
+    // aborts the talks in flight on this channel. talks of other clients are not affected.
+    bool stop();
+
+    // non-blocking versions. a single receiving thread drives any number of requests in flight.
+    // on_complete is called exactly once: from the receiving thread, or from the calling thread if the request can't be sent.
+    // the audio callback always receives the terminator (empty AudioData) before on_complete.
+    void statsAsync(const StatsCallback& on_complete);
+    void playAsync(const TalkParams& params, const std::string& text, const AudioCallback& cb, const CompletionCallback& on_complete);
+    void stopAsync(const CompletionCallback& on_complete);
+
+private:
+    struct Request
+    {
+        ChannelCommand command = ChannelCommand::Unknown;
+        AudioCallback callback;
+        CompletionCallback on_complete;
+        std::string payload;
+        uint64_t talk_id = 0; // request id of a Talk. the target of stop()
+        bool terminated = false;
+        bool finished = false;
+        bool succeeded = false;
+    };
+    using RequestPtr = std::shared_ptr<Request>;
+    using lock_t = std::unique_lock<std::mutex>;
+
+    bool request(ChannelCommand command, const std::string& payload, RequestPtr req);
+    bool send(ChannelCommand command, const std::string& payload, RequestPtr req);
+    void complete(RequestPtr req, bool succeeded);
+    std::vector<uint64_t> getTalkIds();
+    void receiveLoop(ChannelSocketPtr socket);
+    void dispatch(const ChannelHeader& header, const char *payload, size_t size);
+    void cancelRequests();
+
+    TalkClientSettings m_settings;
+    ChannelSocketPtr m_socket;
+    std::thread m_receiver;
+    std::atomic_bool m_receiving{ false };
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::map<uint32_t, RequestPtr> m_requests;
+    uint32_t m_id_seed = 0;
+};
+
+} // namespace rt
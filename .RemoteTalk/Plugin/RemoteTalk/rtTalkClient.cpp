@@ -1,6 +1,8 @@
 #include "pch.h"
+#include "rtFoundation.h"
 #include "rtSerialization.h"
 #include "rtTalkClient.h"
+#include "rtSharedRing.h"
 
 namespace rt {
 
@@ -8,6 +10,184 @@ using namespace Poco::Net;
 using Poco::URI;
 
 
+bool IsLocalHost(const std::string& server)
+{
+    return server == "127.0.0.1" || server == "localhost" || server == "::1";
+}
+
+bool CancelToken::cancel()
+{
+    lock_t lock(m_mutex);
+    if (m_cancelled)
+        return false;
+    m_cancelled = true;
+    for (auto& kvp : m_callbacks)
+        kvp.second();
+    return true;
+}
+
+bool CancelToken::isCancelled() const
+{
+    lock_t lock(m_mutex);
+    return m_cancelled;
+}
+
+int CancelToken::subscribe(const std::function<void()>& f)
+{
+    lock_t lock(m_mutex);
+    if (m_cancelled)
+        f();
+    int id = ++m_id_seed;
+    m_callbacks[id] = f;
+    return id;
+}
+
+void CancelToken::unsubscribe(int id)
+{
+    lock_t lock(m_mutex);
+    m_callbacks.erase(id);
+}
+
+
+// ends a stream early by cancellation, idle timeout or deadline.
+// cancel() shuts the socket down from the cancelling thread, which wakes up the blocking read immediately.
+class StreamGuard
+{
+public:
+    StreamGuard(HTTPClientSession& session, const TalkPlayOptions& options, int timeout_ms);
+    ~StreamGuard();
+
+    // call before each blocking read. limits the wait to the idle timeout and the rest of the deadline.
+    // returns false if cancelled or the deadline has passed. the socket is shut down then.
+    bool arm();
+    void setTimedOut();
+    // cancelled, timed out or past the deadline
+    bool isAborted() const;
+    int getIdleTimeout() const;
+
+private:
+    void shutdown();
+
+    HTTPClientSession& m_session;
+    CancelTokenPtr m_cancel;
+    int m_subscription = 0;
+    int m_idle_timeout_ms;
+    std::chrono::steady_clock::time_point m_deadline;
+    bool m_has_deadline = false;
+    bool m_timed_out = false;
+};
+
+StreamGuard::StreamGuard(HTTPClientSession& session, const TalkPlayOptions& options, int timeout_ms)
+    : m_session(session)
+    , m_cancel(options.cancel)
+    , m_idle_timeout_ms(options.idle_timeout_ms > 0 ? options.idle_timeout_ms : timeout_ms)
+{
+    if (options.deadline_ms > 0) {
+        m_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.deadline_ms);
+        m_has_deadline = true;
+    }
+    if (m_cancel)
+        m_subscription = m_cancel->subscribe([this]() { shutdown(); });
+}
+
+StreamGuard::~StreamGuard()
+{
+    if (m_cancel)
+        m_cancel->unsubscribe(m_subscription);
+}
+
+void StreamGuard::shutdown()
+{
+    try {
+        m_session.socket().shutdown();
+    }
+    catch (Poco::Exception&) {
+        // not connected yet. arm() stops it before sending.
+    }
+}
+
+bool StreamGuard::arm()
+{
+    int wait_ms = m_idle_timeout_ms;
+    if (m_has_deadline) {
+        auto rest = std::chrono::duration_cast<std::chrono::milliseconds>(m_deadline - std::chrono::steady_clock::now()).count();
+        if (rest <= 0)
+            m_timed_out = true;
+        wait_ms = std::min(wait_ms, (int)rest);
+    }
+    if (isAborted()) {
+        shutdown();
+        return false;
+    }
+    try {
+        m_session.socket().setReceiveTimeout(Poco::Timespan(wait_ms * 1000));
+    }
+    catch (Poco::Exception&) {
+        // not connected yet. the session's timeout applies to the first read.
+    }
+    return true;
+}
+
+void StreamGuard::setTimedOut()
+{
+    m_timed_out = true;
+}
+
+bool StreamGuard::isAborted() const
+{
+    return m_timed_out || (m_cancel && m_cancel->isCancelled());
+}
+
+int StreamGuard::getIdleTimeout() const
+{
+    return m_idle_timeout_ms;
+}
+
+
+// audio is in the shared ring and the response body is the doorbell.
+static bool ReceiveShared(std::istream& doorbell, SharedRing& ring, StreamGuard& guard, const std::function<void(const AudioData&)>& cb)
+{
+    // cancel() shuts down the doorbell socket. the ring wait checks the token by itself.
+    SharedRingReader buf(ring, guard.getIdleTimeout(), [&guard]() { return guard.isAborted(); });
+    std::istream is(&buf);
+    AudioData audio_data;
+    char bell;
+    while (guard.arm() && doorbell.read(&bell, 1)) {
+        while (buf.available() > 0) {
+            audio_data.deserialize(is);
+            if (!is)
+                return false;
+            if (cb)
+                cb(audio_data);
+
+            // empty data means end of stream
+            if (audio_data.data.empty())
+                return true;
+        }
+    }
+    return false;
+}
+
+static URI MakeTalkURI(const TalkParams& params, const std::string& text)
+{
+    URI uri;
+    uri.setPath("/talk");
+
+    uri.addQueryParameter("mute", to_string(params.mute));
+    uri.addQueryParameter("force_mono", to_string(params.force_mono));
+    uri.addQueryParameter("cast", to_string(params.cast));
+    for (int i = 0; i < TalkParams::MaxParams; ++i) {
+        if (params.isSet(i)) {
+            char name[128];
+            sprintf(name, "a%d", i);
+            uri.addQueryParameter(name, to_string((float)params[i]));
+        }
+    }
+    if (!text.empty())
+        uri.addQueryParameter("text", text);
+    return uri;
+}
+
 TalkClient::TalkClient(const TalkClientSettings& settings)
     : m_settings(settings)
 {
@@ -45,11 +225,14 @@ bool TalkClient::stats(TalkServerStats& stats)
     try {
         URI uri;
         uri.setPath("/stats");
+        auto request_id = Tracer::NewRequestId();
+        TraceSpan span("client.stats", request_id);
 
         HTTPClientSession session{ m_settings.server, m_settings.port };
         session.setTimeout(m_settings.timeout_ms * 1000);
 
         HTTPRequest request{ HTTPRequest::HTTP_GET, uri.getPathAndQuery() };
+        request.set(rtRequestIdHeader, Tracer::ToString(request_id));
         session.sendRequest(request);
 
         HTTPResponse response;
@@ -94,71 +277,194 @@ bool TalkClient::ready()
     return ret;
 }
 
-bool TalkClient::play(const TalkParams& params, const std::string& text, const std::function<void(const AudioData&)>& cb)
+bool TalkClient::play(const TalkParams& params, const std::string& text, const std::function<void(const AudioData&)>& cb,
+    const TalkPlayOptions& options)
 {
     bool ret = false;
+    bool terminated = false;
+    auto request_id = Tracer::NewRequestId();
+
+    HTTPClientSession session{ m_settings.server, m_settings.port };
+    session.setTimeout(m_settings.timeout_ms * 1000);
+    StreamGuard guard(session, options, m_settings.timeout_ms);
     try {
-        URI uri;
-        uri.setPath("/talk");
-
-        uri.addQueryParameter("mute", to_string(params.mute));
-        uri.addQueryParameter("force_mono", to_string(params.force_mono));
-        uri.addQueryParameter("cast", to_string(params.cast));
-        for (int i = 0; i < TalkParams::MaxParams; ++i) {
-            if (params.isSet(i)) {
-                char name[128];
-                sprintf(name, "a%d", i);
-                uri.addQueryParameter(name, to_string((float)params[i]));
+        auto uri = MakeTalkURI(params, text);
+        if (m_settings.local_transport && IsLocalHost(m_settings.server))
+            uri.addQueryParameter("transport", "shm");
+        if (options.deadline_ms > 0)
+            uri.addQueryParameter("deadline", std::to_string(options.deadline_ms));
+
+        // client.request: connect, send and wait for the response header.
+        // client.first_audio: from the beginning to the first audio. client.play: whole.
+        auto time_begin = Tracer::Now();
+        TraceSpan play_span("client.play", request_id);
+        TraceSpan request_span("client.request", request_id);
+        bool first = true;
+        auto receive = [&](const AudioData& ad) {
+            if (ad.data.empty())
+                terminated = true;
+            else if (first) {
+                first = false;
+                Tracer::getInstance().record("client.first_audio", request_id, time_begin, Tracer::Now());
+            }
+            if (cb)
+                cb(ad);
+        };
+
+        HTTPRequest request{ HTTPRequest::HTTP_GET, uri.getPathAndQuery() };
+        request.set(rtRequestIdHeader, Tracer::ToString(request_id));
+        if (!guard.arm())
+            throw Poco::IOException();
+        session.sendRequest(request);
+
+        HTTPResponse response;
+        guard.arm();
+        auto& rs = session.receiveResponse(response);
+        request_span.end();
+        if (response.has(SharedRingNameHeader)) {
+            SharedRing ring;
+            auto size = from_string<int>(response.get(SharedRingSizeHeader, "0"));
+            if (ring.open(response.get(SharedRingNameHeader), size)) {
+                if (ReceiveShared(rs, ring, guard, receive))
+                    ret = response.getStatus() == HTTPResponse::HTTP_OK;
             }
+            else
+                rtLogWarning("TalkClient::play(): failed to open shared memory\n");
         }
-        if (!text.empty())
-            uri.addQueryParameter("text", text);
+        else {
+            AudioData audio_data;
+            while (guard.arm()) {
+                audio_data.deserialize(rs);
+                if (!rs)
+                    break;
+                receive(audio_data);
+
+                // empty data means end of stream
+                if (audio_data.data.empty()) {
+                    ret = response.getStatus() == HTTPResponse::HTTP_OK;
+                    break;
+                }
+            }
+        }
+    }
+    catch (Poco::TimeoutException&) {
+        guard.setTimedOut();
+    }
+    catch (Poco::Exception&) {
+    }
+
+    if (!terminated && cb)
+        cb(AudioData());
+    if (guard.isAborted()) {
+        // the stream is closed but the server doesn't know it yet
+        stop(request_id);
+        return false;
+    }
+    return ret;
+}
+
+bool TalkClient::forward(const TalkParams& params, const std::string& text, std::ostream& dst, int& status, uint64_t request_id)
+{
+    // serialized AudioData: format, frequency, channels, data size and data.
+    // a header is held until it is complete and data_left is the rest of the current frame.
+    const size_t header_size = sizeof(int) * 3 + sizeof(uint32_t);
+    char header[header_size];
+    size_t header_pos = 0;
+    size_t data_left = 0;
+    bool terminated = false; // the zero-length frame that ends the stream has been copied
+
+    status = 0;
+    try {
+        auto uri = MakeTalkURI(params, text);
 
         HTTPClientSession session{ m_settings.server, m_settings.port };
         session.setTimeout(m_settings.timeout_ms * 1000);
 
         HTTPRequest request{ HTTPRequest::HTTP_GET, uri.getPathAndQuery() };
+        if (request_id == 0)
+            request_id = Tracer::NewRequestId();
+        request.set(rtRequestIdHeader, Tracer::ToString(request_id));
+        TraceSpan span("client.forward", request_id);
         session.sendRequest(request);
 
         HTTPResponse response;
         auto& rs = session.receiveResponse(response);
-        AudioData audio_data;
-        for (;;) {
-            audio_data.deserialize(rs);
-            if(cb)
-                cb(audio_data);
+        status = response.getStatus();
+        if (status != HTTPResponse::HTTP_OK)
+            return false;
 
-            // empty data means end of stream
-            if (audio_data.data.empty())
-                break;
+        // peek() blocks until something arrives. readsome() takes what is buffered without waiting for more.
+        char buf[4096];
+        while (!terminated && rs.peek() != EOF) {
+            auto n = (size_t)rs.readsome(buf, sizeof(buf));
+            for (size_t i = 0; i < n && !terminated;) {
+                if (data_left == 0) {
+                    auto c = std::min(header_size - header_pos, n - i);
+                    memcpy(header + header_pos, buf + i, c);
+                    header_pos += c;
+                    i += c;
+                    if (header_pos == header_size) {
+                        dst.write(header, header_size);
+                        uint32_t size;
+                        memcpy(&size, header + header_size - sizeof(uint32_t), sizeof(size));
+                        data_left = size;
+                        header_pos = 0;
+                        terminated = size == 0;
+                    }
+                }
+                else {
+                    auto c = std::min(data_left, n - i);
+                    dst.write(buf + i, c);
+                    data_left -= c;
+                    i += c;
+                }
+            }
+            dst.flush();
+            if (!dst)
+                return false;
         }
-        ret = response.getStatus() == HTTPResponse::HTTP_OK;
+        // EOF without the terminator means the server gave up. it is not a complete response even on a frame boundary.
+        if (terminated)
+            return true;
     }
     catch (Poco::Exception&) {
     }
-    return ret;
+
+    // broken before the terminator. drop the incomplete header or fill the rest of the data
+    if (status == HTTPResponse::HTTP_OK && data_left > 0) {
+        char zeros[4096] = {};
+        while (data_left > 0 && dst) {
+            auto c = std::min(data_left, sizeof(zeros));
+            dst.write(zeros, c);
+            data_left -= c;
+        }
+        dst.flush();
+    }
+    return false;
 }
 
-bool TalkClient::stop()
+bool TalkClient::stop(uint64_t talk_id)
 {
     bool ret = false;
     try {
         URI uri;
         uri.setPath("/stop");
+        if (talk_id != 0)
+            uri.addQueryParameter("id", Tracer::ToString(talk_id));
+        auto request_id = Tracer::NewRequestId();
+        TraceSpan span("client.stop", request_id);
 
         HTTPClientSession session{ m_settings.server, m_settings.port };
         session.setTimeout(m_settings.timeout_ms * 1000);
 
         HTTPRequest request{ HTTPRequest::HTTP_GET, uri.getPathAndQuery() };
+        request.set(rtRequestIdHeader, Tracer::ToString(request_id));
         session.sendRequest(request);
 
         HTTPResponse response;
-        auto& rs = session.receiveResponse(response);
-        if (response.getStatus() == HTTPResponse::HTTP_OK) {
-            char r;
-            rs.read(&r, 1);
-            ret = r == '1';
-        }
+        session.receiveResponse(response);
+        // the server replies "ok" with 200 whether or not there was something to stop
+        ret = response.getStatus() == HTTPResponse::HTTP_OK;
     }
     catch (Poco::Exception&) {
     }
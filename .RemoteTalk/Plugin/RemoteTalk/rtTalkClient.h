@@ -9,12 +9,50 @@ struct TalkClientSettings
     std::string server;
     uint16_t port;
     int timeout_ms;
+    // receive audio via shared memory if the server is on the same host
+    bool local_transport = true;
 
     TalkClientSettings(const std::string& s= "127.0.0.1", uint16_t p = 8081, int ms=30000)
     : server(s), port(p), timeout_ms(ms)
     {}
 };
 
+bool IsLocalHost(const std::string& server);
+
+// cancels operations in progress from another thread. e.g. barge-in.
+class CancelToken
+{
+public:
+    // returns false if already cancelled
+    bool cancel();
+    bool isCancelled() const;
+
+    // f is called by cancel(), or right away if already cancelled. it is called with the lock held:
+    // it must return quickly and must not use the token. f is never called after unsubscribe() returns.
+    int subscribe(const std::function<void()>& f);
+    void unsubscribe(int id);
+
+private:
+    using lock_t = std::unique_lock<std::mutex>;
+
+    mutable std::mutex m_mutex;
+    std::map<int, std::function<void()>> m_callbacks;
+    int m_id_seed = 0;
+    bool m_cancelled = false;
+};
+using CancelTokenPtr = std::shared_ptr<CancelToken>;
+
+struct TalkPlayOptions
+{
+    // cancel() closes the stream immediately and play() asks the server to abort the talk
+    CancelTokenPtr cancel;
+    // longest wait for the response and for each frame. 0 is TalkClientSettings::timeout_ms
+    int idle_timeout_ms = 0;
+    // whole talk including the wait in the server's queue. 0 is none.
+    // it is also the server's admission deadline: a talk that can't start in time is rejected right away.
+    int deadline_ms = 0;
+};
+
 class TalkClient
 {
 public:
@@ -25,10 +63,21 @@ public:
 
     bool isServerAvailable();
     bool stats(TalkServerStats& stats);
-    bool play(const TalkParams& params, const std::string& text, const std::function<void (const AudioData&)>& cb);
-    bool stop();
+    // cb always receives the terminator (empty AudioData), even if the talk is cancelled or timed out.
+    // in that case it is delivered as soon as the stream is closed, and the server is asked to abort the talk before returning.
+    bool play(const TalkParams& params, const std::string& text, const std::function<void (const AudioData&)>& cb,
+        const TalkPlayOptions& options = {});
+    // talk_id is the request id of a talk to abort. 0 stops whatever the server is playing.
+    bool stop(uint64_t talk_id = 0);
     bool ready();
 
+    // sends "/talk" and copies the response body (serialized AudioData) to dst as it arrives, without decoding.
+    // status is the HTTP status of the response, 0 if the server can't be reached. nothing is written unless it is 200.
+    // true only if the zero-length terminator frame has been copied. if the stream ends before it, false is returned and
+    // the rest of an incomplete frame is filled with zeros, so dst ends on a frame boundary and the caller can append a terminator.
+    // request_id is passed to the server to tie its trace spans to the caller's (0 generates a new one).
+    bool forward(const TalkParams& params, const std::string& text, std::ostream& dst, int& status, uint64_t request_id = 0);
+
 private:
     TalkClientSettings m_settings;
 };
@@ -0,0 +1,201 @@
+#include "pch.h"
+#include "rtFoundation.h"
+#include "rtTalkProxy.h"
+
+namespace rt {
+
+using namespace Poco::Net;
+
+TalkProxy::TalkProxy()
+{
+    // identical talks are merged by the backends. the proxy forwards bytes and has no frames to share.
+    m_single_flight = false;
+}
+
+TalkProxy::~TalkProxy()
+{
+    stop();
+}
+
+void TalkProxy::addBackend(const TalkClientSettings& settings)
+{
+    auto backend = std::make_shared<Backend>();
+    backend->settings = settings;
+
+    lock_t lock(m_backend_mutex);
+    m_backends.push_back(backend);
+}
+
+bool TalkProxy::loadBackends(const std::string& settings_path, const std::string& server)
+{
+    TalkServerSettingsTable table;
+    if (!LoadServerSettings(table, settings_path))
+        return false;
+    for (auto& kvp : table) {
+        // don't route to myself
+        if (IsLocalHost(server) && kvp.second.port == m_settings.port)
+            continue;
+        addBackend({ server, kvp.second.port });
+    }
+    return true;
+}
+
+void TalkProxy::updateBackends()
+{
+    // query without holding the lock. talks keep being routed meanwhile.
+    for (auto& backend : getBackends()) {
+        TalkServerStats stats;
+        TalkClient client(backend->settings);
+        updateBackend(backend, client.stats(stats) ? &stats : nullptr);
+    }
+}
+
+void TalkProxy::updateBackend(BackendPtr backend, const TalkServerStats *stats)
+{
+    lock_t lock(m_backend_mutex);
+    if (stats) {
+        if (!backend->available)
+            rtLogInfo("TalkProxy: %s:%d is up (%s)\n", backend->settings.server.c_str(), (int)backend->settings.port, stats->host.c_str());
+        backend->stats = *stats;
+        backend->available = true;
+    }
+    else {
+        if (backend->available)
+            rtLogInfo("TalkProxy: %s:%d is down\n", backend->settings.server.c_str(), (int)backend->settings.port);
+        backend->available = false;
+    }
+    rebuildCasts();
+}
+
+std::vector<TalkProxy::BackendPtr> TalkProxy::getBackends()
+{
+    lock_t lock(m_backend_mutex);
+    return m_backends;
+}
+
+void TalkProxy::rebuildCasts()
+{
+    // ids are assigned in order of appearance. they are stable as long as the set of backends doesn't change.
+    std::map<std::string, int> ids;
+    m_casts.clear();
+    m_routes.clear();
+    for (auto& backend : m_backends) {
+        if (!backend->available)
+            continue;
+        for (auto& cast : backend->stats.casts) {
+            auto key = backend->stats.host + "/" + cast.name;
+            auto it = ids.find(key);
+            int id;
+            if (it == ids.end()) {
+                id = (int)m_casts.size();
+                ids[key] = id;
+                m_casts.push_back(cast);
+                m_casts.back().id = id;
+                m_routes.push_back({});
+            }
+            else {
+                id = it->second;
+            }
+            m_routes[id].push_back({ backend, cast.id });
+        }
+    }
+}
+
+std::vector<TalkProxy::Route> TalkProxy::getRoutes(int cast)
+{
+    std::vector<Route> ret;
+    {
+        lock_t lock(m_backend_mutex);
+        if (cast < 0 || cast >= (int)m_routes.size())
+            return ret;
+        for (auto& route : m_routes[cast]) {
+            if (route.backend->available)
+                ret.push_back(route);
+        }
+        // rotate first so that idle backends take turns
+        if (!ret.empty())
+            std::rotate(ret.begin(), ret.begin() + (m_round_robin++ % ret.size()), ret.end());
+    }
+    std::stable_sort(ret.begin(), ret.end(), [](const Route& a, const Route& b) {
+        return a.backend->talking < b.backend->talking;
+    });
+    return ret;
+}
+
+bool TalkProxy::isReady()
+{
+    lock_t lock(m_backend_mutex);
+    return !m_casts.empty();
+}
+
+TalkServer::Status TalkProxy::onStats(StatsMessage& mes)
+{
+    auto& stats = mes.stats;
+    stats.host = "RemoteTalkProxy";
+    stats.plugin_version = rtPluginVersion;
+    stats.protocol_version = rtProtocolVersion;
+    {
+        lock_t lock(m_backend_mutex);
+        stats.casts = m_casts;
+    }
+    return Status::Succeeded;
+}
+
+TalkServer::Status TalkProxy::onTalk(TalkMessage& mes)
+{
+    auto routes = getRoutes(mes.params.cast);
+    if (routes.empty())
+        return Status::Failed;
+
+    mes.task = std::async(std::launch::async, [this, &mes, routes]() {
+        auto& os = *mes.respond_stream;
+        for (auto& route : routes) {
+            auto& backend = *route.backend;
+            auto params = mes.params;
+            params.cast = (short)route.cast;
+
+            int status = 0;
+            TalkClient client(backend.settings);
+            ++backend.talking;
+            bool ok = client.forward(params, mes.text, os, status, mes.request_id);
+            --backend.talking;
+            if (ok)
+                return;
+
+            if (status == 0) {
+                // unreachable. exclude it until the next update.
+                lock_t lock(m_backend_mutex);
+                backend.available = false;
+            }
+            // try the next one if the backend is busy or unreachable.
+            // once the response has started there is no way to switch to another backend.
+            if (status != 0 && status != HTTPResponse::HTTP_SERVICE_UNAVAILABLE)
+                break;
+        }
+        // no backend could take it or it ended before the terminator. terminate the stream (forward() has completed the last frame)
+        mes.failed = true;
+        AudioData().serialize(os);
+        os.flush();
+    });
+    return Status::Succeeded;
+}
+
+TalkServer::Status TalkProxy::onStop(StopMessage& mes)
+{
+    // talks are forwarded with the same request id. backends that don't have the target ignore it.
+    for (auto& backend : getBackends()) {
+        if (backend->available) {
+            TalkClient client(backend->settings);
+            client.stop(mes.target);
+        }
+    }
+    return Status::Succeeded;
+}
+
+bool TalkProxy::isStopNeeded(const StopMessage& /*mes*/)
+{
+    // backends decide
+    return true;
+}
+
+} // namespace rt
@@ -0,0 +1,62 @@
+#pragma once
+#include "rtTalkServer.h"
+#include "rtTalkClient.h"
+
+namespace rt {
+
+// front server of multiple host servers.
+// casts of all backends are merged into one list with new ids and "/talk" is routed by cast.
+// instances of the same host (same TalkServerStats::host) that have the same cast share one id
+// and talks are balanced between them by the number of talks in progress.
+// responses are forwarded as they arrive without decoding or buffering.
+class TalkProxy : public TalkServer
+{
+using super = TalkServer;
+public:
+    struct Backend
+    {
+        TalkClientSettings settings;
+        TalkServerStats stats;
+        bool available = false;
+        std::atomic_int talking{ 0 };
+    };
+    using BackendPtr = std::shared_ptr<Backend>;
+
+    struct Route
+    {
+        BackendPtr backend;
+        int cast = 0; // cast id in the backend
+    };
+
+    TalkProxy();
+    ~TalkProxy() override;
+
+    void addBackend(const TalkClientSettings& settings);
+    // adds all servers in the settings table (see GetOrAddServerSettings())
+    bool loadBackends(const std::string& settings_path, const std::string& server = "127.0.0.1");
+    // queries "/stats" of all backends and rebuilds the cast list. backends that don't respond are excluded.
+    void updateBackends();
+    // same as updateBackends() but with given stats. for tests.
+    void updateBackend(BackendPtr backend, const TalkServerStats *stats);
+    std::vector<BackendPtr> getBackends();
+
+    // routes of the cast ordered by priority. the least busy backend comes first.
+    std::vector<Route> getRoutes(int cast);
+
+    bool isReady() override;
+    Status onStats(StatsMessage& mes) override;
+    Status onTalk(TalkMessage& mes) override;
+    Status onStop(StopMessage& mes) override;
+    bool isStopNeeded(const StopMessage& mes) override;
+
+private:
+    void rebuildCasts();
+
+    std::mutex m_backend_mutex;
+    std::vector<BackendPtr> m_backends;
+    CastList m_casts;
+    std::vector<std::vector<Route>> m_routes; // index is cast id
+    uint32_t m_round_robin = 0;
+};
+
+} // namespace rt
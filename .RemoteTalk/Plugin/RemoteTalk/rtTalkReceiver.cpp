@@ -1,11 +1,16 @@
 #include "pch.h"
+#include "rtSerialization.h"
 #include "rtTalkReceiver.h"
+#include "picojson/picojson.h"
 
 namespace rt {
 
 using namespace Poco::Net;
 using Poco::URI;
 
+// ms
+static const int SubscriberSendTimeout = 5000;
+
 class TalkReceiverRequestHandler : public HTTPRequestHandler
 {
 public:
@@ -33,10 +38,61 @@ TalkReceiverRequestHandler::TalkReceiverRequestHandler(TalkReceiver *server)
 
 void TalkReceiverRequestHandler::handleRequest(HTTPServerRequest& request, HTTPServerResponse& response)
 {
-    //auto& uri = request.getURI();
+    URI uri(request.getURI());
+    auto path = uri.getPath();
 
     bool handled = false;
-    if (request.getMethod() == HTTPServerRequest::HTTP_GET) {
+    if (path == "/publish" && request.getMethod() == HTTPServerRequest::HTTP_POST) {
+        // body is a sequence of serialized AudioData. it can contain multiple talks.
+        auto& is = request.stream();
+        for (;;) {
+            auto frame = std::make_shared<AudioData>();
+            frame->deserialize(is);
+            if (!is)
+                break;
+            m_server->publish(frame);
+        }
+        ServeText(response, "ok", HTTPResponse::HTTP_OK);
+        handled = true;
+    }
+    else if (path == "/subscribe") {
+        // long-lived stream. returns when the client disconnects or the receiver stops.
+        auto sub = m_server->subscribe(request.clientAddress().toString());
+        response.setStatus(HTTPResponse::HTTP_OK);
+        response.setContentType("application/octet-stream");
+        response.setChunkedTransferEncoding(true);
+        try {
+            // a client that stopped reading can't block this thread forever
+            auto& socket = static_cast<HTTPServerRequestImpl&>(request).socket();
+            socket.setSendTimeout(Poco::Timespan(SubscriberSendTimeout * 1000));
+
+            auto& os = response.send();
+            std::vector<AudioDataPtr> frames;
+            while (m_server->read(*sub, frames, 100)) {
+                if (frames.empty()) {
+                    // idle. writes would notice a disconnection but there is nothing to write.
+                    // a closed connection is readable with nothing to read.
+                    if (socket.poll(Poco::Timespan(0), Socket::SELECT_READ | Socket::SELECT_ERROR) && socket.available() == 0)
+                        break;
+                    continue;
+                }
+                for (auto& frame : frames)
+                    frame->serialize(os);
+                if (!frames.empty())
+                    os.flush();
+                if (!os)
+                    break;
+                frames.clear();
+            }
+        }
+        catch (Poco::Exception&) {
+        }
+        m_server->unsubscribe(sub);
+        return;
+    }
+    else if (path == "/stats" || path == "/") {
+        ServeText(response, m_server->getStatsJson(), HTTPResponse::HTTP_OK, "application/json");
+        handled = true;
     }
 
     if (!handled)
@@ -54,7 +110,9 @@ HTTPRequestHandler* TalkReceiverRequestHandlerFactory::createRequestHandler(cons
     return new TalkReceiverRequestHandler(m_server);
 }
 
-TalkReceiver::TalkReceiver()
+TalkReceiver::TalkReceiver(size_t ring_size, size_t max_lag)
+    : m_ring(std::max<size_t>(ring_size, 1))
+    , m_max_lag(std::min(std::max<size_t>(max_lag, 1), m_ring.size()))
 {
 }
 
@@ -70,6 +128,7 @@ void TalkReceiver::setSettings(const TalkServerSettings& v)
 
 bool TalkReceiver::start()
 {
+    m_serving = true;
     if (!m_server) {
         auto* params = new HTTPServerParams;
         if (m_settings.max_queue > 0)
@@ -93,7 +152,102 @@ bool TalkReceiver::start()
 
 void TalkReceiver::stop()
 {
+    m_serving = false;
+    m_cond.notify_all();
     m_server.reset();
 }
 
+void TalkReceiver::publish(AudioDataPtr frame)
+{
+    {
+        lock_t lock(m_mutex);
+        m_ring[m_head % m_ring.size()] = frame;
+        ++m_head;
+        if (frame->data.empty())
+            ++m_ends;
+    }
+    m_cond.notify_all();
+}
+
+TalkReceiver::SubscriberPtr TalkReceiver::subscribe(const std::string& name)
+{
+    auto ret = std::make_shared<Subscriber>();
+    ret->name = name;
+
+    lock_t lock(m_mutex);
+    ret->cursor = m_head;
+    ret->ends = m_ends;
+    m_subscribers.push_back(ret);
+    return ret;
+}
+
+void TalkReceiver::unsubscribe(SubscriberPtr sub)
+{
+    lock_t lock(m_mutex);
+    m_subscribers.erase(std::remove(m_subscribers.begin(), m_subscribers.end(), sub), m_subscribers.end());
+}
+
+bool TalkReceiver::read(Subscriber& sub, std::vector<AudioDataPtr>& dst, int timeout_ms)
+{
+    lock_t lock(m_mutex);
+    if (sub.cursor == m_head)
+        m_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&]() { return sub.cursor != m_head || !m_serving; });
+    if (!m_serving)
+        return false;
+
+    auto lag = m_head - sub.cursor;
+    if (lag > m_max_lag) {
+        // too slow. skip to the latest frame so that this subscriber doesn't hold anyone.
+        // the skipped frames may have been overwritten already. ends of talks are all the same, so deliver new ones.
+        uint64_t latest = m_head - 1;
+        uint64_t ends = m_ends - (m_ring[latest % m_ring.size()]->data.empty() ? 1 : 0);
+        uint64_t skipped_ends = ends - sub.ends;
+        if (skipped_ends > 0) {
+            auto end = std::make_shared<AudioData>();
+            for (uint64_t i = 0; i < skipped_ends; ++i)
+                dst.push_back(end);
+            sub.received += skipped_ends;
+        }
+        sub.ends = ends;
+        sub.dropped += latest - sub.cursor - skipped_ends;
+        sub.cursor = latest;
+    }
+    for (; sub.cursor < m_head; ++sub.cursor) {
+        auto& frame = m_ring[sub.cursor % m_ring.size()];
+        if (frame->data.empty())
+            ++sub.ends;
+        dst.push_back(frame);
+        ++sub.received;
+    }
+    return true;
+}
+
+bool TalkReceiver::isServing() const
+{
+    return m_serving;
+}
+
+std::string TalkReceiver::getStatsJson()
+{
+    using namespace picojson;
+
+    lock_t lock(m_mutex);
+    object ret;
+    ret["published"] = to_json(m_head);
+    ret["ring_size"] = to_json((uint64_t)m_ring.size());
+    ret["max_lag"] = to_json((uint64_t)m_max_lag);
+
+    array subs;
+    for (auto& sub : m_subscribers) {
+        object o;
+        o["name"] = value(sub->name);
+        o["lag"] = to_json(m_head - sub->cursor);
+        o["received"] = to_json(sub->received);
+        o["dropped"] = to_json(sub->dropped);
+        subs.push_back(value(std::move(o)));
+    }
+    ret["subscribers"] = value(std::move(subs));
+    return value(std::move(ret)).serialize(true);
+}
+
 } // namespace rt
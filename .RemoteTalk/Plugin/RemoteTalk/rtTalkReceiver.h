@@ -1,29 +1,66 @@
 #pragma once
+#include <condition_variable>
 #include "rtTalkServer.h"
 
 namespace rt {
 
+// fan-out hub of talk audio.
+// producers publish frames once (POST "/publish" or publish()) and any number of subscribers
+// (GET "/subscribe" or subscribe()) receive the same frames from a shared ring.
+// every subscriber has its own cursor. a subscriber that lags too far behind skips to the latest frame
+// and the skipped frames are counted as dropped. producers and other subscribers never wait for it.
+// ends of talks (empty frames) are never dropped so that subscribers see every talk end.
 class TalkReceiver
 {
 public:
+    struct Subscriber
+    {
+        std::string name;
+        uint64_t cursor = 0;    // sequence number of the next frame to read
+        uint64_t ends = 0;      // ends of talks published before cursor
+        uint64_t received = 0;
+        uint64_t dropped = 0;
+    };
+    using SubscriberPtr = std::shared_ptr<Subscriber>;
+
     TalkReceiver(const TalkReceiver&) = delete;
     TalkReceiver& operator=(const TalkReceiver&) = delete;
 
-    TalkReceiver();
+    TalkReceiver(size_t ring_size = 1024, size_t max_lag = 256);
     virtual ~TalkReceiver();
     virtual void setSettings(const TalkServerSettings& v);
     virtual bool start();
     virtual void stop();
 
+    // empty data is the end of a talk. frames are shared by all subscribers, not copied.
+    void publish(AudioDataPtr frame);
+
+    // new subscribers receive frames published after this.
+    SubscriberPtr subscribe(const std::string& name = "");
+    void unsubscribe(SubscriberPtr sub);
+    // append frames after the subscriber's cursor to dst. waits up to timeout_ms if there are none.
+    // returns false if the receiver has been stopped.
+    bool read(Subscriber& sub, std::vector<AudioDataPtr>& dst, int timeout_ms);
+    bool isServing() const;
+
+    std::string getStatsJson();
+
 private:
     using HTTPServerPtr = std::shared_ptr<Poco::Net::HTTPServer>;
     using lock_t = std::unique_lock<std::mutex>;
 
-    bool m_serving = true;
+    std::atomic_bool m_serving{ true };
     TalkServerSettings m_settings;
 
     HTTPServerPtr m_server;
     std::mutex m_mutex;
+    std::condition_variable m_cond;
+
+    std::vector<AudioDataPtr> m_ring;
+    size_t m_max_lag = 0;
+    uint64_t m_head = 0; // sequence number of the next frame to be published
+    uint64_t m_ends = 0; // ends of talks published
+    std::vector<SubscriberPtr> m_subscribers;
 };
 
 } // namespace rt
@@ -3,6 +3,9 @@
 #include "rtSerialization.h"
 #include "rtTalkServer.h"
 #include "rtTalkClient.h"
+#include "rtTalkChannel.h"
+#include "rtSharedRing.h"
+#include "rtAudioCoalescer.h"
 #include "picojson/picojson.h"
 
 namespace rt {
@@ -113,6 +116,8 @@ public:
     void handleRequest(HTTPServerRequest& request, HTTPServerResponse& response) override;
 
 private:
+    void serve(URI& uri, const std::string& path, HTTPServerRequest& request, HTTPServerResponse& response);
+
     TalkServer *m_server = nullptr;
 };
 
@@ -131,22 +136,76 @@ TalkServerRequestHandler::TalkServerRequestHandler(TalkServer *server)
 {
 }
 
+static void SetupSocket(const TalkServerSettings& settings, HTTPServerRequest& request)
+{
+    if (!settings.low_latency && settings.send_buffer_size <= 0 && settings.receive_buffer_size <= 0)
+        return;
+    try {
+        auto& socket = static_cast<HTTPServerRequestImpl&>(request).socket();
+        if (settings.low_latency)
+            socket.setNoDelay(true);
+        if (settings.send_buffer_size > 0)
+            socket.setSendBufferSize(settings.send_buffer_size);
+        if (settings.receive_buffer_size > 0)
+            socket.setReceiveBufferSize(settings.receive_buffer_size);
+    }
+    catch (Poco::Exception& e) {
+        rtLogWarning("failed to setup socket: %s\n", e.displayText().c_str());
+    }
+}
+
 void TalkServerRequestHandler::handleRequest(HTTPServerRequest& request, HTTPServerResponse& response)
 {
     URI uri(request.getURI());
-
     std::string path = uri.getPath();
     if (path=="/") {
         // show stats by default for now
         path = "/stats";
     }
 
+    serve(uri, path, request, response);
+    m_server->getMetrics().countRequest(path, response.getStatus());
+}
+
+void TalkServerRequestHandler::serve(URI& uri, const std::string& path, HTTPServerRequest& request, HTTPServerResponse& response)
+{
+    auto& settings = m_server->getSettings();
+    SetupSocket(settings, request);
+
     bool handled = false;
-    if (path == "/ready") {
+    auto& metrics = m_server->getMetrics();
+    auto request_id = Tracer::ParseRequestId(request.get(rtRequestIdHeader, ""));
+    if (request_id == 0)
+        request_id = Tracer::NewRequestId();
+    response.set(rtRequestIdHeader, Tracer::ToString(request_id));
+    auto recorder = m_server->getRecorder();
+    if (path == "/channel") {
+        // long-lived bidirectional connection. returns when the client closes it.
+        ServeChannel(*m_server, request, response);
+        return;
+    }
+    else if (path == "/ready") {
         ServeText(response, m_server->isReady() ? "1" : "0", HTTPResponse::HTTPStatus::HTTP_OK);
+        return;
+    }
+    else if (path == "/metrics") {
+        // answered here, not by the host. it must respond even if the host is busy.
+        ServeText(response, m_server->exportMetrics(), HTTPResponse::HTTPStatus::HTTP_OK, "text/plain; version=0.0.4");
+        return;
+    }
+    else if (path == "/trace") {
+        // spans of this process in Chrome trace event JSON
+        char name[128];
+        sprintf(name, "TalkServer :%d", (int)settings.port);
+        ServeText(response, Tracer::getInstance().exportChromeTrace(name), HTTPResponse::HTTPStatus::HTTP_OK, "application/json");
+        return;
     }
     else if (path == "/talk") {
+        TraceSpan parse_span("server.parse", request_id);
         auto mes = std::make_shared<TalkServer::TalkMessage>();
+        mes->request_id = request_id;
+        std::string transport;
+        int deadline_ms = settings.max_wait_ms;
 
         auto qparams = uri.getQueryParameters();
         for (auto& nvp : qparams) {
@@ -163,6 +222,12 @@ void TalkServerRequestHandler::handleRequest(HTTPServerRequest& request, HTTPSer
                 Poco::URI::decode(nvp.second, mes->text, true);
                 mes->text = ToANSI(mes->text.c_str());
             }
+            else if (nvp.first == "transport") {
+                transport = nvp.second;
+            }
+            else if (nvp.first == "deadline") {
+                deadline_ms = rt::from_string<int>(nvp.second);
+            }
             else {
                 for (int i = 0; i < TalkParams::MaxParams; ++i) {
                     char name[128];
@@ -174,33 +239,148 @@ void TalkServerRequestHandler::handleRequest(HTTPServerRequest& request, HTTPSer
             }
         }
 
-        {
-            std::string s(std::istreambuf_iterator<char>(request.stream()), {});
-            if (!s.empty())
-                mes->from_json(s);
+        std::string body(std::istreambuf_iterator<char>(request.stream()), {});
+        if (!body.empty())
+            mes->from_json(body);
+        if (recorder)
+            mes->record_id = recorder->beginSession(request.getURI(), body);
+
+        // joining an identical talk in flight costs nothing. otherwise check the queue.
+        // reject immediately rather than keeping the worker thread waiting.
+        // load balancers can redirect the request by Retry-After.
+        auto flight_key = mes->getFlightKey();
+        bool leader = false;
+        float wait = 0.0f;
+        auto flight = m_server->beginFlight(*mes, deadline_ms, leader, wait);
+        if (!flight) {
+            response.set("Retry-After", std::to_string(std::max((int)std::ceil(wait), 1)));
+            ServeText(response, "", HTTPResponse::HTTP_SERVICE_UNAVAILABLE);
+            if (recorder)
+                recorder->endSession(mes->record_id, HTTPResponse::HTTP_SERVICE_UNAVAILABLE);
+            return;
+        }
+
+        // same-host client can receive audio via shared memory.
+        // in that case the response body is just a doorbell: one byte per publish.
+        std::shared_ptr<SharedRing> ring;
+        if (transport == "shm" && request.clientAddress().host().isLoopback()) {
+            static std::atomic_int s_seq{ 0 };
+            char name[128];
+            sprintf(name, "RemoteTalk_%d_%d", (int)settings.port, ++s_seq);
+
+            ring = std::make_shared<SharedRing>();
+            if (ring->create(name, SharedRingSize)) {
+                response.set(SharedRingNameHeader, ring->getName());
+                response.set(SharedRingSizeHeader, std::to_string(ring->getCapacity()));
+            }
+            else
+                ring.reset();
         }
 
         response.setStatus(HTTPResponse::HTTPStatus::HTTP_OK);
         response.setContentType("application/octet-stream");
-        mes->respond_stream = &response.send();
+        if (settings.low_latency) {
+            // every flush becomes a chunk and goes to the wire immediately
+            response.setChunkedTransferEncoding(true);
+        }
+        auto& os = response.send();
+        auto time_sent = std::chrono::steady_clock::now();
+        parse_span.end();
+        TraceSpan stream_span(leader ? "server.stream" : "server.follow", request_id);
+        metrics.addStreamsInFlight(1);
+
+        std::shared_ptr<SharedRingWriter> ring_buf;
+        std::shared_ptr<std::ostream> ring_os;
+        if (ring) {
+            ring_buf = std::make_shared<SharedRingWriter>(*ring, [&os]() { os.put(1); os.flush(); }, SharedRingTimeout);
+            ring_os = std::make_shared<std::ostream>(ring_buf.get());
+            mes->respond_stream = ring_os.get();
+        }
+        else {
+            mes->respond_stream = &os;
+        }
 
-        m_server->addMessage(mes);
-        if (mes->wait())
-            handled = true;
+        if (leader) {
+            mes->flight = flight;
+            m_server->addMessage(mes);
+            if (mes->wait())
+                handled = true;
+            m_server->endTalk(*mes);
+            m_server->endFlight(flight_key, flight, handled);
+        }
+        else {
+            // replay frames already produced and then follow the leader
+            flight->addFollower(1);
+            auto& fos = *mes->respond_stream;
+            size_t pos = 0;
+            std::vector<AudioDataPtr> frames;
+            while (flight->read(pos, frames)) {
+                if (pos == frames.size())
+                    metrics.recordTime(TalkServerMetrics::Timer::TimeToFirstAudio, std::chrono::steady_clock::now() - mes->time_received);
+                for (auto& frame : frames) {
+                    frame->serialize(fos);
+                    if (!frame->data.empty())
+                        metrics.countFrame(frame->data.size());
+                    if (recorder)
+                        recorder->recordFrame(mes->record_id, *frame);
+                }
+                fos.flush();
+                frames.clear();
+            }
+            handled = flight->isSucceeded();
+            flight->addFollower(-1);
+        }
+
+        if (ring) {
+            // keep the shared memory alive until the client has read everything
+            ring_os->flush();
+            if (!ring->waitConsumed(SharedRingTimeout))
+                ring->shutdown();
+        }
+        metrics.addStreamsInFlight(-1);
+        metrics.recordTime(TalkServerMetrics::Timer::Stream, std::chrono::steady_clock::now() - time_sent);
+        if (recorder)
+            recorder->endSession(mes->record_id, handled ? HTTPResponse::HTTP_OK : HTTPResponse::HTTP_SERVICE_UNAVAILABLE);
     }
     else if (path == "/stop") {
+        TraceSpan span("server.stop", request_id);
         auto mes = std::make_shared<TalkServer::StopMessage>();
-        m_server->addMessage(mes);
-        if (mes->wait())
+        mes->request_id = request_id;
+        auto qparams = uri.getQueryParameters();
+        for (auto& nvp : qparams) {
+            if (nvp.first == "id")
+                mes->target = Tracer::ParseRequestId(nvp.second);
+        }
+        if (recorder)
+            mes->record_id = recorder->beginSession(request.getURI(), "");
+        if (mes->target != 0 && m_server->cancelQueuedTalk(mes->target)) {
+            // hasn't started. nothing to stop.
             handled = true;
+        }
+        else {
+            m_server->addMessage(mes);
+            if (mes->wait())
+                handled = true;
+        }
         ServeText(response, "ok", HTTPResponse::HTTPStatus::HTTP_OK);
+        if (recorder)
+            recorder->endSession(mes->record_id, handled ? HTTPResponse::HTTP_OK : HTTPResponse::HTTP_SERVICE_UNAVAILABLE);
     }
     else if (path == "/stats") {
+        TraceSpan span("server.stats", request_id);
         auto mes = std::make_shared<TalkServer::StatsMessage>();
+        mes->request_id = request_id;
+        if (recorder)
+            mes->record_id = recorder->beginSession(request.getURI(), "");
         m_server->addMessage(mes);
         if (mes->wait())
             handled = true;
-        ServeText(response, mes->to_json(), HTTPResponse::HTTPStatus::HTTP_OK, "application/json");
+        auto json = mes->to_json();
+        ServeText(response, json, HTTPResponse::HTTPStatus::HTTP_OK, "application/json");
+        if (recorder) {
+            recorder->recordResponse(mes->record_id, json);
+            recorder->endSession(mes->record_id, handled ? HTTPResponse::HTTP_OK : HTTPResponse::HTTP_SERVICE_UNAVAILABLE);
+        }
     }
 #ifdef rtDebug
     else if (path == "/debug") {
@@ -241,7 +421,7 @@ bool TalkServer::Message::wait()
     if (task.valid()) {
         task.wait();
     }
-    return handled.load();
+    return handled.load() && !failed.load();
 }
 
 bool TalkServer::Message::isProcessing()
@@ -268,12 +448,70 @@ bool TalkServer::StatsMessage::from_json(const std::string& str)
 }
 
 
+std::string TalkServer::TalkMessage::getFlightKey() const
+{
+    // mute doesn't change the audio
+    TalkMessage tmp;
+    tmp.params = params;
+    tmp.params.mute = false;
+    tmp.text = text;
+    return tmp.to_json();
+}
+
+void TalkServer::Flight::append(AudioDataPtr frame)
+{
+    {
+        lock_t lock(m_mutex);
+        m_frames.push_back(frame);
+    }
+    m_cond.notify_all();
+}
+
+void TalkServer::Flight::finish(bool succeeded)
+{
+    {
+        lock_t lock(m_mutex);
+        m_finished = true;
+        m_succeeded = succeeded;
+    }
+    m_cond.notify_all();
+}
+
+bool TalkServer::Flight::read(size_t& pos, std::vector<AudioDataPtr>& dst)
+{
+    lock_t lock(m_mutex);
+    m_cond.wait(lock, [&]() { return pos < m_frames.size() || m_finished; });
+    if (pos == m_frames.size())
+        return false;
+    dst.insert(dst.end(), m_frames.begin() + pos, m_frames.end());
+    pos = m_frames.size();
+    return true;
+}
+
+bool TalkServer::Flight::isSucceeded()
+{
+    lock_t lock(m_mutex);
+    return m_succeeded;
+}
+
+void TalkServer::Flight::addFollower(int v)
+{
+    m_followers += v;
+}
+
+int TalkServer::Flight::getFollowerCount() const
+{
+    return m_followers;
+}
+
 std::string TalkServer::TalkMessage::to_json()
 {
     using namespace picojson;
     object ret;
     ret["params"] = rt::to_json(params);
     ret["text"] = rt::to_json(text);
+    if (request_id != 0)
+        ret["request_id"] = rt::to_json(Tracer::ToString(request_id));
     return value(std::move(ret)).serialize(true);
 }
 
@@ -288,6 +526,9 @@ bool TalkServer::TalkMessage::from_json(const std::string & str)
         ret = true;
     if (rt::from_json(text, val.get("text")))
         ret = true;
+    std::string id;
+    if (rt::from_json(id, val.get("request_id")))
+        request_id = Tracer::ParseRequestId(id);
     return ret;
 }
 
@@ -331,6 +572,15 @@ void TalkServer::setSettings(const TalkServerSettings& v)
 
 bool TalkServer::start()
 {
+    if (m_settings.trace)
+        Tracer::getInstance().setEnabled(true);
+
+    if (!m_settings.record_path.empty() && !m_recorder) {
+        auto recorder = std::make_shared<TrafficRecorder>();
+        if (recorder->open(m_settings.record_path, m_settings.record_audio))
+            m_recorder = recorder;
+    }
+
     if (!m_server) {
         auto* params = new HTTPServerParams;
         if (m_settings.max_queue > 0)
@@ -355,6 +605,7 @@ bool TalkServer::start()
 void TalkServer::stop()
 {
     m_server.reset();
+    m_recorder.reset();
 }
 
 bool TalkServer::isRunning() const
@@ -365,15 +616,46 @@ bool TalkServer::isRunning() const
 void TalkServer::processMessages()
 {
     lock_t lock(m_mutex);
+    // targeted stops go first. they must not wait behind pending talks (barge-in).
+    std::stable_partition(m_messages.begin(), m_messages.end(), [](MessagePtr& p) {
+        auto *stop = dynamic_cast<StopMessage*>(p.get());
+        return stop && stop->target != 0;
+    });
     for (auto& mes : m_messages) {
         if (!mes->handled.load()) {
             auto s = Status::Failed;
-            if (auto *talk = dynamic_cast<TalkMessage*>(mes.get()))
+            if (auto *talk = dynamic_cast<TalkMessage*>(mes.get())) {
+                auto begin = std::chrono::steady_clock::now();
                 s = onTalk(*talk);
-            else if (auto *stop = dynamic_cast<StopMessage*>(mes.get()))
-                s = onStop(*stop);
-            else if (auto *stats = dynamic_cast<StatsMessage*>(mes.get()))
+                if (s != Status::Pending) {
+                    auto& tracer = Tracer::getInstance();
+                    tracer.record("server.queue", talk->request_id, Tracer::ToNS(talk->time_received), Tracer::ToNS(begin));
+                    tracer.record("server.onTalk", talk->request_id, Tracer::ToNS(begin), Tracer::Now());
+                    m_metrics.recordTime(TalkServerMetrics::Timer::QueueWait, begin - talk->time_received);
+                }
+            }
+            else if (auto *stop = dynamic_cast<StopMessage*>(mes.get())) {
+                TraceSpan span("server.onStop", stop->request_id);
+                s = isStopNeeded(*stop) ? onStop(*stop) : Status::Succeeded;
+            }
+            else if (auto *stats = dynamic_cast<StatsMessage*>(mes.get())) {
+                stats->stats.ttfb = m_ttfb;
+                stats->stats.frames_per_sec = m_frames_per_sec;
+                stats->stats.header_overhead = m_header_overhead;
+                {
+                    lock_t lock(m_data_mutex);
+                    stats->stats.buffer_size = (int)m_data_size;
+                    stats->stats.buffer_peak = (int)m_data_peak;
+                    stats->stats.buffer_capacity = m_settings.max_buffer_size;
+                    stats->stats.buffer_degraded = m_data_degraded;
+                    stats->stats.buffer_blocked_ms = m_data_blocked_ms;
+                }
+                stats->stats.queued_chars = m_queued_chars;
+                stats->stats.chars_per_sec = m_chars_per_sec;
+                stats->stats.estimated_wait = getEstimatedWait();
+                TraceSpan span("server.onStats", stats->request_id);
                 s = onStats(*stats);
+            }
 #ifdef rtDebug
             else if (auto *dbg = dynamic_cast<DebugMessage*>(mes.get()))
                 s = onDebug(*dbg);
@@ -389,12 +671,322 @@ void TalkServer::processMessages()
     m_messages.erase(
         std::remove_if(m_messages.begin(), m_messages.end(), [](MessagePtr &p) { return !p; }),
         m_messages.end());
+    m_queue_depth = (int)m_messages.size();
 }
 
 void TalkServer::addMessage(MessagePtr mes)
 {
     lock_t lock(m_mutex);
     m_messages.push_back(mes);
+    m_queue_depth = (int)m_messages.size();
+}
+
+bool TalkServer::cancelQueuedTalk(uint64_t request_id)
+{
+    lock_t lock(m_mutex);
+    for (auto it = m_messages.begin(); it != m_messages.end(); ++it) {
+        auto *talk = dynamic_cast<TalkMessage*>(it->get());
+        if (!talk || talk->request_id != request_id || talk->handled.load())
+            continue;
+        // others may be waiting for this talk to be synthesized
+        if (talk->flight && talk->flight->getFollowerCount() > 0)
+            return false;
+        talk->status = Status::Failed;
+        talk->handled = true;
+        m_messages.erase(it);
+        m_queue_depth = (int)m_messages.size();
+        return true;
+    }
+    return false;
+}
+
+bool TalkServer::isStopNeeded(const StopMessage& mes)
+{
+    if (mes.target == 0)
+        return true;
+    lock_t lock(m_flight_mutex);
+    return mes.target == m_streaming_id && (!m_streaming_flight || m_streaming_flight->getFollowerCount() == 0);
+}
+
+bool TalkServer::admitTalk(const TalkMessage& mes, int deadline_ms, float& wait)
+{
+    // check and reserve in one step
+    int chars = (int)mes.text.size();
+    float cps = m_chars_per_sec;
+    int queued = m_queued_chars;
+    for (;;) {
+        // can't estimate until the first talk is measured
+        wait = cps > 0.0f ? (float)(queued + chars) / cps : 0.0f;
+        if (deadline_ms > 0 && wait * 1000.0f > (float)deadline_ms)
+            return false;
+        if (m_queued_chars.compare_exchange_weak(queued, queued + chars))
+            return true;
+    }
+}
+
+void TalkServer::endTalk(const TalkMessage& mes)
+{
+    m_queued_chars -= (int)mes.text.size();
+}
+
+TrafficRecorderPtr TalkServer::getRecorder() const
+{
+    return m_recorder;
+}
+
+TalkServerMetrics& TalkServer::getMetrics()
+{
+    return m_metrics;
+}
+
+std::string TalkServer::exportMetrics()
+{
+    auto snapshot = m_metrics.getSnapshot();
+    snapshot.queue_depth = m_queue_depth;
+    snapshot.queued_chars = m_queued_chars;
+    snapshot.estimated_wait = getEstimatedWait();
+    return snapshot.toPrometheus();
+}
+
+float TalkServer::getEstimatedWait() const
+{
+    // can't estimate until the first talk is measured
+    float cps = m_chars_per_sec;
+    return cps > 0.0f ? (float)m_queued_chars / cps : 0.0f;
+}
+
+TalkServer::FlightPtr TalkServer::findFlight(const std::string& key)
+{
+    lock_t lock(m_flight_mutex);
+    auto it = m_flights.find(key);
+    return it != m_flights.end() ? it->second : nullptr;
+}
+
+TalkServer::FlightPtr TalkServer::beginFlight(const TalkMessage& mes, int deadline_ms, bool& leader, float& wait)
+{
+    if (!m_single_flight) {
+        leader = true;
+        return admitTalk(mes, deadline_ms, wait) ? std::make_shared<Flight>() : nullptr;
+    }
+
+    auto key = mes.getFlightKey();
+    lock_t lock(m_flight_mutex);
+    auto it = m_flights.find(key);
+    if (it != m_flights.end()) {
+        leader = false;
+        wait = 0.0f;
+        return it->second;
+    }
+
+    leader = true;
+    if (!admitTalk(mes, deadline_ms, wait))
+        return nullptr;
+    auto flight = std::make_shared<Flight>();
+    m_flights[key] = flight;
+    return flight;
+}
+
+void TalkServer::endFlight(const std::string& key, FlightPtr flight, bool succeeded)
+{
+    {
+        lock_t lock(m_flight_mutex);
+        auto it = m_flights.find(key);
+        if (it != m_flights.end() && it->second == flight)
+            m_flights.erase(it);
+    }
+    flight->finish(succeeded);
+}
+
+void TalkServer::clearAudioQueue()
+{
+    {
+        lock_t lock(m_data_mutex);
+        m_data_queue.clear();
+        m_data_size = m_data_peak = 0;
+        m_data_degraded = 0;
+        m_data_blocked_ms = 0.0f;
+    }
+    m_space_cond.notify_all();
+}
+
+// one step of lossy re-encoding. returns false if it can't be reduced any more.
+// only the bit depth is reduced. clients merge chunks with AudioData::operator+=(), which converts formats
+// but drops chunks whose channels or frequency differ.
+static bool DegradeAudio(AudioData& data)
+{
+    if (SizeOf(data.format) > 2) {
+        AudioData tmp;
+        data.convertFormat(tmp, AudioFormat::S16);
+        data.data.swap(tmp.data);
+        data.format = AudioFormat::S16;
+        return true;
+    }
+    else if (data.format == AudioFormat::S16) {
+        AudioData tmp;
+        data.convertFormat(tmp, AudioFormat::U8);
+        data.data.swap(tmp.data);
+        data.format = AudioFormat::U8;
+        return true;
+    }
+    return false;
+}
+
+void TalkServer::pushAudio(AudioDataPtr data)
+{
+    {
+        lock_t lock(m_data_mutex);
+        size_t limit = (size_t)std::max(m_settings.max_buffer_size, 0);
+        if (limit > 0 && !data->data.empty() && m_data_size + data->data.size() > limit) {
+            if (m_settings.buffer_policy == BufferPolicy::Degrade) {
+                // re-encode queued data and the new data until it fits
+                for (;;) {
+                    bool degraded = false;
+                    for (auto& ad : m_data_queue) {
+                        if (m_data_size + data->data.size() <= limit)
+                            break;
+                        size_t before = ad->data.size();
+                        if (DegradeAudio(*ad)) {
+                            m_data_size -= before - ad->data.size();
+                            ++m_data_degraded;
+                            degraded = true;
+                        }
+                    }
+                    if (m_data_size + data->data.size() > limit && DegradeAudio(*data)) {
+                        ++m_data_degraded;
+                        degraded = true;
+                    }
+                    if (!degraded || m_data_size + data->data.size() <= limit)
+                        break;
+                }
+            }
+
+            if (m_data_size + data->data.size() > limit) {
+                // the client is not reading fast enough. stall the capture.
+                // give up after a while so that a dead client can't freeze the host forever.
+                auto begin = std::chrono::steady_clock::now();
+                bool ok = m_space_cond.wait_for(lock, std::chrono::seconds(5), [&]() {
+                    return m_data_size == 0 || m_data_size + data->data.size() <= limit; });
+                m_data_blocked_ms += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count();
+                if (!ok)
+                    rtLogWarning("TalkServer::pushAudio(): buffer is full\n");
+            }
+        }
+
+        m_data_queue.push_back(data);
+        m_data_size += data->data.size();
+        m_data_peak = std::max(m_data_peak, m_data_size);
+    }
+    m_data_cond.notify_one();
+}
+
+void TalkServer::releaseAudio(size_t size)
+{
+    {
+        lock_t lock(m_data_mutex);
+        m_data_size -= std::min(size, m_data_size);
+    }
+    m_space_cond.notify_all();
+}
+
+void TalkServer::streamAudio(TalkMessage& mes)
+{
+    {
+        lock_t lock(m_flight_mutex);
+        m_streaming_id = mes.request_id;
+        m_streaming_flight = mes.flight;
+    }
+    mes.task = std::async(std::launch::async, [this, &mes]() {
+        auto time_begin = std::chrono::steady_clock::now();
+        bool low_latency = m_settings.low_latency;
+        int frame_ms = m_settings.frame_ms > 0 ? m_settings.frame_ms : (low_latency ? 10 : 40);
+        int max_hold_ms = m_settings.max_hold_ms > 0 ? m_settings.max_hold_ms : frame_ms * 2;
+        AudioCoalescer coalescer(frame_ms, max_hold_ms);
+        auto recorder = m_recorder;
+
+        bool first = true;
+        auto& os = *mes.respond_stream;
+        std::vector<AudioDataPtr> tmp;
+        for (;;) {
+            {
+                lock_t lock(m_data_mutex);
+                if (low_latency && m_data_queue.empty()) {
+                    // wake up as soon as the hook pushes data
+                    m_data_cond.wait_for(lock, std::chrono::milliseconds(10), [this]() { return !m_data_queue.empty(); });
+                }
+                tmp.swap(m_data_queue);
+            }
+
+            bool terminated = false;
+            size_t batch_size = 0;
+            for (auto& ad : tmp) {
+                if (ad->data.empty())
+                    terminated = true;
+                else
+                    coalescer.push(*ad);
+                batch_size += ad->data.size();
+            }
+
+            bool sent = false;
+            auto time_send = Tracer::Now();
+            auto send = [&](AudioDataPtr frame) {
+                frame->serialize(os);
+                if (!frame->data.empty())
+                    m_metrics.countFrame(frame->data.size());
+                if (mes.flight)
+                    mes.flight->append(frame);
+                if (recorder)
+                    recorder->recordFrame(mes.record_id, *frame);
+                sent = true;
+            };
+            while (auto frame = coalescer.pop(terminated)) {
+                send(frame);
+                if (low_latency)
+                    os.flush();
+            }
+            if (terminated)
+                send(std::make_shared<AudioData>());
+            if (sent) {
+                os.flush();
+                Tracer::getInstance().record("server.serialize", mes.request_id, time_send, Tracer::Now());
+                if (first) {
+                    first = false;
+                    auto ttfb = std::chrono::steady_clock::now() - mes.time_received;
+                    m_ttfb = std::chrono::duration<float, std::milli>(ttfb).count();
+                    m_metrics.recordTime(TalkServerMetrics::Timer::TimeToFirstAudio, ttfb);
+                }
+            }
+            // written to the socket (or held by the coalescer). give the space back to the capture.
+            if (batch_size > 0)
+                releaseAudio(batch_size);
+
+            if (terminated) {
+                m_metrics.recordTime(TalkServerMetrics::Timer::Synthesis, std::chrono::steady_clock::now() - time_begin);
+                Tracer::getInstance().record("server.capture", mes.request_id, Tracer::ToNS(time_begin), Tracer::Now());
+                break;
+            }
+            else if (!low_latency)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            tmp.clear();
+        }
+
+        auto& stats = coalescer.getStats();
+        m_frames_per_sec = stats.framesPerSecond();
+        m_header_overhead = stats.headerOverhead();
+
+        // update measured speed of synthesis (exponential moving average)
+        float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - time_begin).count();
+        if (!mes.text.empty() && elapsed > 0.0f) {
+            float cps = (float)mes.text.size() / elapsed;
+            float prev = m_chars_per_sec;
+            m_chars_per_sec = prev > 0.0f ? prev * 0.7f + cps * 0.3f : cps;
+        }
+
+        lock_t lock(m_flight_mutex);
+        if (m_streaming_id == mes.request_id) {
+            m_streaming_id = 0;
+            m_streaming_flight.reset();
+        }
+    });
 }
 
 } // namespace rt
@@ -4,9 +4,14 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <future>
 #include "rtAudioData.h"
 #include "rtTalkInterface.h"
+#include "rtTrafficLog.h"
+#include "rtMetrics.h"
+#include "rtTrace.h"
 
 namespace Poco {
     namespace Net {
@@ -18,11 +23,39 @@ namespace Poco {
 
 namespace rt {
 
+enum class BufferPolicy
+{
+    Block,      // stall the host's capture until the client catches up
+    Degrade,    // reduce bit depth of buffered audio first (to S16, then U8). block if it is still full
+};
+
 struct TalkServerSettings
 {
     int max_queue = 256;
     int max_threads = 8;
     uint16_t port = 8100;
+
+    // low latency mode: TCP_NODELAY, chunked transfer and flush after every frame.
+    // default is throughput mode that batches frames. better for batch rendering.
+    bool low_latency = false;
+    // socket buffer sizes in bytes. 0 means system default.
+    int send_buffer_size = 0;
+    int receive_buffer_size = 0;
+    // captured audio is batched into frames of this duration (e.g. 10, 20, 40).
+    // pending audio is sent after max_hold_ms even if it is shorter. 0 means auto (depends on low_latency).
+    int frame_ms = 0;
+    int max_hold_ms = 0;
+    // limit of captured audio waiting to be sent in bytes. 0 means unlimited.
+    int max_buffer_size = 8 * 1024 * 1024;
+    BufferPolicy buffer_policy = BufferPolicy::Block;
+    // admission control. /talk is rejected with 503 + Retry-After if the estimated wait exceeds this.
+    // requests can override it by "deadline" parameter (ms). 0 means no limit.
+    int max_wait_ms = 0;
+    // record traffic to this file if not empty (see TrafficRecorder). samples are recorded only if record_audio is true.
+    std::string record_path;
+    bool record_audio = false;
+    // enable span tracing of this process on start() (see Tracer). spans are served at "/trace".
+    bool trace = false;
 };
 using TalkServerSettingsTable = std::map<std::string, TalkServerSettings>;
 bool SaveServerSettings(const TalkServerSettingsTable& src, const std::string& path);
@@ -37,6 +70,21 @@ struct TalkServerStats
     int protocol_version = 0;
     TalkParams params;
     CastList casts;
+    float ttfb = 0.0f; // time-to-first-byte of the last talk in milliseconds
+    float frames_per_sec = 0.0f; // sent frames per second of audio in the last talk
+    float header_overhead = 0.0f; // header bytes / total bytes in the last talk
+
+    // occupancy of the buffer between the capture and the network
+    int buffer_size = 0;        // current size in bytes
+    int buffer_peak = 0;        // peak size in the last talk
+    int buffer_capacity = 0;    // TalkServerSettings::max_buffer_size
+    int buffer_degraded = 0;    // chunks re-encoded by BufferPolicy::Degrade in the last talk
+    float buffer_blocked_ms = 0.0f; // time the capture was blocked in the last talk
+
+    // admission control
+    int queued_chars = 0;           // text length of accepted but unfinished talks
+    float chars_per_sec = 0.0f;     // measured speed of synthesis. 0 if not measured yet
+    float estimated_wait = 0.0f;    // queued_chars / chars_per_sec in seconds
 };
 
 void ServeText(Poco::Net::HTTPServerResponse& response, const std::string& data, int stat, const std::string& mimetype = "text/plain");
@@ -61,8 +109,12 @@ public:
 
         Status status;
         std::atomic_bool handled = { false };
+        std::chrono::steady_clock::time_point time_received = std::chrono::steady_clock::now();
         std::ostream *respond_stream = nullptr;
         std::future<void> task;
+        uint32_t record_id = 0; // session id in the traffic log
+        uint64_t request_id = 0; // tag of trace spans (rtRequestIdHeader)
+        std::atomic_bool failed = { false }; // set by task if the talk fails after the handler returned. wait() returns false
 
     };
     using MessagePtr = std::shared_ptr<Message>;
@@ -76,11 +128,40 @@ public:
         bool from_json(const std::string& str);
     };
 
+    // identical concurrent talks share one synthesis (single-flight).
+    // the leader's frames are recorded here. followers replay them from the beginning and then follow live.
+    // frames are shared, not copied.
+    class Flight
+    {
+    public:
+        void append(AudioDataPtr frame);
+        void finish(bool succeeded);
+        // wait until frames after pos are available. returns false if finished and there are no more frames.
+        bool read(size_t& pos, std::vector<AudioDataPtr>& dst);
+        bool isSucceeded();
+        // clients following the leader. a talk with followers is not stopped by a targeted stop.
+        void addFollower(int v);
+        int getFollowerCount() const;
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::vector<AudioDataPtr> m_frames;
+        bool m_finished = false;
+        bool m_succeeded = false;
+        std::atomic_int m_followers{ 0 };
+    };
+    using FlightPtr = std::shared_ptr<Flight>;
+
     class TalkMessage : public Message
     {
     public:
         TalkParams params;
         std::string text;
+        FlightPtr flight;
+
+        // same key means same audio
+        std::string getFlightKey() const;
 
         std::string to_json();
         bool from_json(const std::string& str);
@@ -89,6 +170,7 @@ public:
     class StopMessage : public Message
     {
     public:
+        uint64_t target = 0; // request id of the talk to abort ("/stop?id="). 0 stops whatever is playing.
     };
 
 #ifdef rtDebug
@@ -125,7 +207,42 @@ public:
 
     virtual void addMessage(MessagePtr mes);
 
+    // targeted stop. a talk that hasn't started is just removed from the queue. returns false if it isn't queued.
+    bool cancelQueuedTalk(uint64_t request_id);
+    // whether mes has to stop the host. a targeted stop doesn't stop other talks or a talk other clients are following.
+    virtual bool isStopNeeded(const StopMessage& mes);
+
+    // admission control. estimated wait (in seconds) = (queued text length + mes.text length) / measured chars per second.
+    // returns false and the estimated wait if the talk can't finish within deadline_ms.
+    // on success the text length of mes is added to the queue at once, so concurrent requests can't all pass.
+    // endTalk() releases it.
+    bool admitTalk(const TalkMessage& mes, int deadline_ms, float& wait);
+    void endTalk(const TalkMessage& mes);
+    float getEstimatedWait() const;
+
+    // null if not recording
+    TrafficRecorderPtr getRecorder() const;
+    // counters for "/metrics". exportMetrics() returns them in the Prometheus text format.
+    TalkServerMetrics& getMetrics();
+    std::string exportMetrics();
+
+    // single-flight. joins the in-flight talk identical to mes if exists (leader = false. no admission needed).
+    // otherwise admits mes by admitTalk() and registers a new flight (leader = true). returns null if rejected.
+    // lookup, admission and registration are one step so that identical requests can't both become leaders.
+    // if m_single_flight is false, every talk is admitted as a leader of its own unregistered flight.
+    FlightPtr findFlight(const std::string& key);
+    FlightPtr beginFlight(const TalkMessage& mes, int deadline_ms, bool& leader, float& wait);
+    void endFlight(const std::string& key, FlightPtr flight, bool succeeded);
+
 protected:
+    // audio queue shared by all hosts.
+    // hooks push captured samples and streamAudio() sends them to the client. empty data is the terminator.
+    void clearAudioQueue();
+    // blocks or re-encodes data if the buffer is full. see TalkServerSettings::buffer_policy.
+    void pushAudio(AudioDataPtr data);
+    void releaseAudio(size_t size);
+    void streamAudio(TalkMessage& mes);
+
     using HTTPServerPtr = std::shared_ptr<Poco::Net::HTTPServer>;
     using lock_t = std::unique_lock<std::mutex>;
 
@@ -135,6 +252,32 @@ protected:
     HTTPServerPtr m_server;
     std::mutex m_mutex;
     std::vector<MessagePtr> m_messages;
+
+    std::mutex m_data_mutex;
+    std::condition_variable m_data_cond;
+    std::condition_variable m_space_cond;
+    std::vector<AudioDataPtr> m_data_queue;
+    size_t m_data_size = 0; // queued + being sent
+    size_t m_data_peak = 0;
+    int m_data_degraded = 0;
+    float m_data_blocked_ms = 0.0f;
+
+    std::mutex m_flight_mutex;
+    std::map<std::string, FlightPtr> m_flights;
+    bool m_single_flight = true;
+    uint64_t m_streaming_id = 0; // request id of the talk streamAudio() is sending
+    FlightPtr m_streaming_flight;
+
+    TrafficRecorderPtr m_recorder;
+    TalkServerMetrics m_metrics;
+
+    std::atomic_int m_queue_depth{ 0 };
+
+    std::atomic_int m_queued_chars{ 0 };
+    std::atomic<float> m_chars_per_sec{ 0.0f };
+    std::atomic<float> m_ttfb{ 0.0f };
+    std::atomic<float> m_frames_per_sec{ 0.0f };
+    std::atomic<float> m_header_overhead{ 0.0f };
 };
 
 } // namespace rt
@@ -0,0 +1,116 @@
+#include "pch.h"
+#include "rtThreadPool.h"
+#include <algorithm>
+
+namespace rt {
+
+ThreadPool::ThreadPool(int num_threads)
+{
+    setThreadCount(num_threads);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_t lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cond.notify_all();
+    for (auto& t : m_threads)
+        t.join();
+}
+
+void ThreadPool::setThreadCount(int v)
+{
+    {
+        lock_t lock(m_mutex);
+        joinRetired();
+        m_thread_count = std::max(v, 2);
+        while (m_alive < m_thread_count) {
+            ++m_alive;
+            spawn();
+        }
+    }
+    m_cond.notify_all();
+}
+
+int ThreadPool::getThreadCount()
+{
+    lock_t lock(m_mutex);
+    return m_thread_count;
+}
+
+void ThreadPool::enqueue(JobType type, const std::function<void()>& job)
+{
+    {
+        lock_t lock(m_mutex);
+        if (type == JobType::Long)
+            m_long_jobs.push_back(job);
+        else
+            m_short_jobs.push_back(job);
+    }
+    m_cond.notify_one();
+}
+
+void ThreadPool::spawn()
+{
+    m_threads.emplace_back([this]() { process(); });
+}
+
+void ThreadPool::joinRetired()
+{
+    // retired threads have released m_mutex for good. joining them under the lock is safe.
+    for (auto id : m_retired) {
+        auto it = std::find_if(m_threads.begin(), m_threads.end(), [id](std::thread& t) { return t.get_id() == id; });
+        if (it != m_threads.end()) {
+            it->join();
+            m_threads.erase(it);
+        }
+    }
+    m_retired.clear();
+}
+
+bool ThreadPool::canRunLong() const
+{
+    return !m_long_jobs.empty() && m_running_long < m_thread_count - 1;
+}
+
+void ThreadPool::process()
+{
+    lock_t lock(m_mutex);
+    for (;;) {
+        m_cond.wait(lock, [this]() {
+            return m_alive > m_thread_count || !m_short_jobs.empty() || canRunLong() ||
+                (m_stopping && m_short_jobs.empty() && m_long_jobs.empty());
+        });
+
+        if (m_alive > m_thread_count) {
+            --m_alive;
+            m_retired.push_back(std::this_thread::get_id());
+            return;
+        }
+        else if (!m_short_jobs.empty()) {
+            auto job = std::move(m_short_jobs.front());
+            m_short_jobs.pop_front();
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+        else if (canRunLong()) {
+            auto job = std::move(m_long_jobs.front());
+            m_long_jobs.pop_front();
+            ++m_running_long;
+            lock.unlock();
+            job();
+            lock.lock();
+            --m_running_long;
+            // a waiting long job may be able to run now
+            m_cond.notify_all();
+        }
+        else if (m_stopping) {
+            return;
+        }
+    }
+}
+
+} // namespace rt
@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+
+namespace rt {
+
+// bounded set of worker threads shared by asynchronous operations.
+// long jobs (e.g. receiving a whole talk) can't occupy every worker. one is always left for short jobs
+// (e.g. stop), so they never get stuck behind long ones.
+class ThreadPool
+{
+public:
+    enum class JobType
+    {
+        Short,
+        Long,
+    };
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ThreadPool(int num_threads = 8);
+    // runs all queued jobs and joins the workers
+    ~ThreadPool();
+
+    // at least 2. shrinking takes effect when workers become idle.
+    void setThreadCount(int v);
+    int getThreadCount();
+
+    void enqueue(JobType type, const std::function<void()>& job);
+
+    // done is called on the worker after the future becomes ready.
+    template<class F>
+    auto submit(JobType type, F&& f, const std::function<void()>& done = {}) -> std::future<decltype(f())>
+    {
+        using R = decltype(f());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        auto ret = task->get_future();
+        enqueue(type, [task, done]() {
+            (*task)();
+            if (done)
+                done();
+        });
+        return ret;
+    }
+
+private:
+    using lock_t = std::unique_lock<std::mutex>;
+    void spawn();
+    void joinRetired();
+    void process();
+    bool canRunLong() const;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::function<void()>> m_short_jobs;
+    std::deque<std::function<void()>> m_long_jobs;
+    std::vector<std::thread> m_threads;
+    std::vector<std::thread::id> m_retired; // exited by shrinking and not joined yet
+    int m_thread_count = 0;
+    int m_alive = 0;
+    int m_running_long = 0;
+    bool m_stopping = false;
+};
+
+} // namespace rt
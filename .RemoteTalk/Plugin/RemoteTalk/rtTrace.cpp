@@ -0,0 +1,184 @@
+#include "pch.h"
+#include "rtFoundation.h"
+#include "rtTrace.h"
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace rt {
+
+static int GetProcessID()
+{
+#ifdef _WIN32
+    return (int)::GetCurrentProcessId();
+#else
+    return (int)::getpid();
+#endif
+}
+
+static uint32_t GetThreadID()
+{
+    thread_local uint32_t t_id = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+    return t_id;
+}
+
+static std::string EscapeJSON(const char *s)
+{
+    std::string ret;
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\')
+            ret += '\\';
+        if ((unsigned char)*s >= 0x20)
+            ret += *s;
+    }
+    return ret;
+}
+
+
+Tracer& Tracer::getInstance()
+{
+    static Tracer s_instance;
+    return s_instance;
+}
+
+Tracer::Tracer(size_t capacity)
+    : m_capacity(std::max<size_t>(capacity, 1))
+    , m_slots(new Slot[m_capacity])
+{
+}
+
+Tracer::~Tracer()
+{
+}
+
+void Tracer::setEnabled(bool v)
+{
+    m_enabled = v;
+}
+
+bool Tracer::isEnabled() const
+{
+    return m_enabled.load(std::memory_order_relaxed);
+}
+
+void Tracer::record(const char *name, uint64_t request_id, uint64_t begin_ns, uint64_t end_ns)
+{
+    if (!isEnabled())
+        return;
+
+    uint64_t index = m_head.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = m_slots[index % m_capacity];
+    slot.seq.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.request_id.store(request_id, std::memory_order_relaxed);
+    slot.begin.store(begin_ns, std::memory_order_relaxed);
+    slot.end.store(end_ns, std::memory_order_relaxed);
+    slot.thread.store(GetThreadID(), std::memory_order_relaxed);
+    slot.seq.store(index * 2 + 2, std::memory_order_release);
+}
+
+void Tracer::clear()
+{
+    m_tail = m_head.load();
+}
+
+std::string Tracer::exportChromeTrace(const char *process_name) const
+{
+    int pid = GetProcessID();
+    std::ostringstream os;
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    os << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":0,\"args\":{\"name\":\"" << EscapeJSON(process_name) << "\"}}";
+
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    uint64_t begin = std::max(m_tail.load(), head > m_capacity ? head - m_capacity : 0);
+    char buf[512];
+    for (uint64_t index = begin; index < head; ++index) {
+        auto& slot = m_slots[index % m_capacity];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        auto name = slot.name.load(std::memory_order_relaxed);
+        auto request_id = slot.request_id.load(std::memory_order_relaxed);
+        auto span_begin = slot.begin.load(std::memory_order_relaxed);
+        auto span_end = slot.end.load(std::memory_order_relaxed);
+        auto thread = slot.thread.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // being written, or already overwritten by a newer span
+        if (seq != index * 2 + 2 || slot.seq.load(std::memory_order_relaxed) != seq || !name)
+            continue;
+
+        // timestamps in microseconds. double keeps sub-microsecond precision.
+        sprintf(buf, ",\n{\"name\":\"%s\",\"cat\":\"rt\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{\"request_id\":\"%s\"}}",
+            name, (double)span_begin / 1000.0, (double)(span_end - std::min(span_begin, span_end)) / 1000.0,
+            pid, thread, ToString(request_id).c_str());
+        os << buf;
+    }
+    os << "\n]}\n";
+    return os.str();
+}
+
+bool Tracer::exportChromeTrace(const std::string& path, const char *process_name) const
+{
+    std::ofstream fo(path);
+    if (!fo)
+        return false;
+    fo << exportChromeTrace(process_name);
+    return true;
+}
+
+uint64_t Tracer::Now()
+{
+    return ToNS(std::chrono::steady_clock::now());
+}
+
+uint64_t Tracer::ToNS(std::chrono::steady_clock::time_point t)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+uint64_t Tracer::NewRequestId()
+{
+    // unique enough across processes: process id, start time of the process and a counter
+    static const uint64_t s_base = ((uint64_t)GetProcessID() << 48) ^ (Now() << 16);
+    static std::atomic<uint64_t> s_seq{ 0 };
+    uint64_t ret = s_base + (++s_seq);
+    return ret != 0 ? ret : 1;
+}
+
+std::string Tracer::ToString(uint64_t request_id)
+{
+    char buf[32];
+    sprintf(buf, "%016llx", (unsigned long long)request_id);
+    return buf;
+}
+
+uint64_t Tracer::ParseRequestId(const std::string& v)
+{
+    if (v.empty() || v.size() > 16)
+        return 0;
+    char *end = nullptr;
+    auto ret = (uint64_t)std::strtoull(v.c_str(), &end, 16);
+    return end && *end == '\0' ? ret : 0;
+}
+
+
+TraceSpan::TraceSpan(const char *name, uint64_t request_id)
+    : m_name(name)
+    , m_request_id(request_id)
+    , m_begin(Tracer::Now())
+{
+}
+
+TraceSpan::~TraceSpan()
+{
+    end();
+}
+
+void TraceSpan::end()
+{
+    if (m_name) {
+        Tracer::getInstance().record(m_name, m_request_id, m_begin, Tracer::Now());
+        m_name = nullptr;
+    }
+}
+
+} // namespace rt
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <chrono>
+
+// TalkClient sends an id with each request and TalkServer tags its spans with it.
+// the server generates one if the request doesn't have it.
+#define rtRequestIdHeader "X-RemoteTalk-Request-Id"
+
+namespace rt {
+
+// span tracing. spans go into a fixed size lock-free ring (the oldest are overwritten)
+// and are exported as Chrome trace event JSON, viewable in chrome://tracing or Perfetto.
+// timestamps are steady_clock, so traces of a client and a server on the same machine line up.
+// disabled by default. it is a diagnostic. enable it by setEnabled() or TalkServerSettings::trace.
+class Tracer
+{
+public:
+    static Tracer& getInstance();
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    Tracer(size_t capacity = 16384);
+    ~Tracer();
+
+    void setEnabled(bool v);
+    bool isEnabled() const;
+
+    // thread safe and wait free. name must outlive the tracer (string literals).
+    void record(const char *name, uint64_t request_id, uint64_t begin_ns, uint64_t end_ns);
+    void clear();
+
+    // process_name is shown in the trace viewer.
+    std::string exportChromeTrace(const char *process_name) const;
+    bool exportChromeTrace(const std::string& path, const char *process_name) const;
+
+    static uint64_t Now(); // in nanoseconds
+    static uint64_t ToNS(std::chrono::steady_clock::time_point t);
+    static uint64_t NewRequestId();
+    static std::string ToString(uint64_t request_id);
+    static uint64_t ParseRequestId(const std::string& v); // 0 if invalid
+
+private:
+    // seqlock per slot. seq is odd while being written.
+    struct Slot
+    {
+        std::atomic<uint64_t> seq{ 0 };
+        std::atomic<const char*> name{ nullptr };
+        std::atomic<uint64_t> request_id{ 0 };
+        std::atomic<uint64_t> begin{ 0 };
+        std::atomic<uint64_t> end{ 0 };
+        std::atomic<uint32_t> thread{ 0 };
+    };
+
+    size_t m_capacity = 0;
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<uint64_t> m_head{ 0 };
+    std::atomic<uint64_t> m_tail{ 0 }; // slots before this are cleared
+    std::atomic_bool m_enabled{ false };
+};
+
+// records a span of the scope
+class TraceSpan
+{
+public:
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    TraceSpan(const char *name, uint64_t request_id = 0);
+    ~TraceSpan();
+    void end();
+
+private:
+    const char *m_name = nullptr;
+    uint64_t m_request_id = 0;
+    uint64_t m_begin = 0;
+};
+
+} // namespace rt
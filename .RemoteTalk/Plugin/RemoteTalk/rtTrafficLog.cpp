@@ -0,0 +1,320 @@
+#include "pch.h"
+#include "rtFoundation.h"
+#include "rtSerialization.h"
+#include "rtTrafficLog.h"
+
+namespace rt {
+
+static const uint32_t TrafficLogMagic = 0x4c545452; // "RTTL"
+static const uint32_t TrafficLogVersion = 1;
+
+TrafficRecorder::TrafficRecorder()
+{
+}
+
+TrafficRecorder::~TrafficRecorder()
+{
+    close();
+}
+
+bool TrafficRecorder::open(const std::string& path, bool record_audio)
+{
+    close();
+
+    lock_t lock(m_mutex);
+    m_file.open(path, std::ios::binary);
+    if (!m_file) {
+        rtLogError("TrafficRecorder::open(): failed to open %s\n", path.c_str());
+        return false;
+    }
+    write(m_file, TrafficLogMagic);
+    write(m_file, TrafficLogVersion);
+    m_opened = true;
+    m_record_audio = record_audio;
+    m_session_seed = 0;
+    m_time_begin = std::chrono::steady_clock::now();
+    m_writer = std::thread([this]() { processWrites(); });
+    return true;
+}
+
+void TrafficRecorder::close()
+{
+    {
+        lock_t lock(m_mutex);
+        m_opened = false;
+    }
+    // the writer drains the queue before it exits
+    m_cond.notify_all();
+    if (m_writer.joinable())
+        m_writer.join();
+
+    lock_t lock(m_mutex);
+    if (m_file.is_open())
+        m_file.close();
+}
+
+bool TrafficRecorder::isOpened() const
+{
+    lock_t lock(m_mutex);
+    return m_opened;
+}
+
+uint64_t TrafficRecorder::now() const
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_time_begin).count();
+}
+
+void TrafficRecorder::push(Record&& rec)
+{
+    m_records.push_back(std::move(rec));
+    m_cond.notify_one();
+}
+
+void TrafficRecorder::processWrites()
+{
+    std::vector<Record> records;
+    for (;;) {
+        {
+            lock_t lock(m_mutex);
+            m_cond.wait(lock, [this]() { return !m_records.empty() || !m_opened; });
+            if (m_records.empty())
+                break;
+            records.swap(m_records);
+        }
+        bool flush = false;
+        for (auto& rec : records) {
+            m_file.write(rec.header.data(), rec.header.size());
+            if (!rec.samples.empty())
+                m_file.write(rec.samples.cdata(), rec.samples.size());
+            flush = flush || rec.flush;
+        }
+        if (flush)
+            m_file.flush();
+        records.clear();
+    }
+    m_file.flush();
+}
+
+uint32_t TrafficRecorder::beginSession(const std::string& uri, const std::string& body)
+{
+    lock_t lock(m_mutex);
+    if (!m_opened)
+        return 0;
+
+    auto id = ++m_session_seed;
+    std::ostringstream os;
+    write(os, TrafficLog::RecordType::Request);
+    write(os, id);
+    write(os, now());
+    write(os, uri);
+    write(os, body);
+    push({ os.str() });
+    return id;
+}
+
+void TrafficRecorder::recordFrame(uint32_t session, const AudioData& frame)
+{
+    if (session == 0)
+        return;
+
+    bool record_audio;
+    uint64_t time;
+    {
+        lock_t lock(m_mutex);
+        if (!m_opened)
+            return;
+        record_audio = m_record_audio;
+        time = now();
+    }
+
+    // serialize outside the lock. the samples are shared with frame.
+    Record rec;
+    {
+        std::ostringstream os;
+        write(os, TrafficLog::RecordType::Frame);
+        write(os, session);
+        write(os, time);
+        write(os, (uint8_t)frame.format);
+        write(os, (int32_t)frame.frequency);
+        write(os, (int32_t)frame.channels);
+        write(os, (uint32_t)frame.data.size());
+        write(os, (uint8_t)record_audio);
+        rec.header = os.str();
+        if (record_audio)
+            rec.samples = frame.data;
+    }
+
+    lock_t lock(m_mutex);
+    if (m_opened)
+        push(std::move(rec));
+}
+
+void TrafficRecorder::recordResponse(uint32_t session, const std::string& body)
+{
+    if (session == 0)
+        return;
+
+    std::ostringstream os;
+    write(os, TrafficLog::RecordType::Response);
+    write(os, session);
+    write(os, now());
+    write(os, body);
+
+    lock_t lock(m_mutex);
+    if (m_opened)
+        push({ os.str() });
+}
+
+void TrafficRecorder::endSession(uint32_t session, int status)
+{
+    if (session == 0)
+        return;
+
+    std::ostringstream os;
+    write(os, TrafficLog::RecordType::End);
+    write(os, session);
+    write(os, now());
+    write(os, (int32_t)status);
+
+    lock_t lock(m_mutex);
+    if (m_opened) {
+        // sessions are the unit of replay. make them visible even if the server dies.
+        Record rec{ os.str() };
+        rec.flush = true;
+        push(std::move(rec));
+    }
+}
+
+
+AudioDataPtr TrafficLog::Frame::toAudioData() const
+{
+    auto ret = std::make_shared<AudioData>();
+    ret->format = format;
+    ret->frequency = frequency;
+    ret->channels = channels;
+    if (!data.empty()) {
+        ret->data = data;
+    }
+    else {
+        ret->data.resize(size);
+        // silence of unsigned 8 bit is 128
+        memset(ret->data.data(), format == AudioFormat::U8 ? 0x80 : 0, size);
+    }
+    return ret;
+}
+
+std::string TrafficLog::Session::getPath() const
+{
+    return uri.substr(0, uri.find('?'));
+}
+
+// strings and samples longer than what is left in the file are broken lengths
+static bool ReadString(std::istream& is, std::string& dst, uint64_t left)
+{
+    uint32_t size = 0;
+    read(is, size);
+    if (!is || size > left)
+        return false;
+    dst.resize(size);
+    is.read(&dst[0], size);
+    return !!is;
+}
+
+bool TrafficLog::load(const std::string& path)
+{
+    std::ifstream is(path, std::ios::binary);
+    if (!is)
+        return false;
+    is.seekg(0, std::ios::end);
+    uint64_t file_size = (uint64_t)is.tellg();
+    is.seekg(0, std::ios::beg);
+    auto left = [&]() -> uint64_t { return file_size - (uint64_t)is.tellg(); };
+
+    uint32_t magic = 0, version = 0;
+    read(is, magic);
+    read(is, version);
+    if (!is || magic != TrafficLogMagic || version != TrafficLogVersion) {
+        rtLogError("TrafficLog::load(): %s is not a traffic log\n", path.c_str());
+        return false;
+    }
+
+    m_sessions.clear();
+    std::map<uint32_t, size_t> index;
+    // a record cut off by a crash or broken ends loading. what has been read completely is kept.
+    for (;;) {
+        RecordType type;
+        uint32_t id = 0;
+        uint64_t time = 0;
+        read(is, type);
+        read(is, id);
+        read(is, time);
+        if (!is)
+            break;
+
+        if (type == RecordType::Request) {
+            Session s;
+            s.id = id;
+            s.time_begin = time;
+            if (!ReadString(is, s.uri, left()) || !ReadString(is, s.body, left()))
+                break;
+            index[id] = m_sessions.size();
+            m_sessions.push_back(std::move(s));
+            continue;
+        }
+
+        auto it = index.find(id);
+        Session dummy;
+        auto& s = it != index.end() ? m_sessions[it->second] : dummy;
+        if (type == RecordType::Frame) {
+            Frame f;
+            uint8_t format = 0, has_data = 0;
+            int32_t frequency = 0, channels = 0;
+            f.time = time;
+            read(is, format);
+            read(is, frequency);
+            read(is, channels);
+            read(is, f.size);
+            read(is, has_data);
+            if (!is)
+                break;
+            f.format = (AudioFormat)format;
+            f.frequency = frequency;
+            f.channels = channels;
+            if (has_data) {
+                if (f.size > left())
+                    break;
+                f.data.resize(f.size);
+                is.read(f.data.data(), f.size);
+                if (!is)
+                    break;
+            }
+            s.frames.push_back(std::move(f));
+        }
+        else if (type == RecordType::Response) {
+            std::string response;
+            if (!ReadString(is, response, left()))
+                break;
+            s.response = std::move(response);
+        }
+        else if (type == RecordType::End) {
+            int32_t status = 0;
+            read(is, status);
+            if (!is)
+                break;
+            s.time_end = time;
+            s.status = status;
+        }
+        else {
+            // broken file. keep what has been read.
+            break;
+        }
+    }
+    return true;
+}
+
+std::vector<TrafficLog::Session>& TrafficLog::getSessions()
+{
+    return m_sessions;
+}
+
+} // namespace rt
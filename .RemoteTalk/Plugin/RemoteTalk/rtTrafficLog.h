@@ -0,0 +1,116 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include "rtAudioData.h"
+
+namespace rt {
+
+// recorded traffic of a server: requests, timing and size of every sent frame, and results.
+// file format (native endian):
+//   header: uint32 magic, uint32 version
+//   record: uint8 type, uint32 session, uint64 time (microseconds since the recording began), payload
+//     Request:  string uri, string body
+//     Frame:    uint8 format, int32 frequency, int32 channels, uint32 size, uint8 has_data, [data]
+//     Response: string body (response of requests other than "/talk")
+//     End:      int32 HTTP status
+// strings are uint32 length + bytes.
+// records are queued and written by a writer thread, so the streaming threads don't wait for the disk.
+// recorded samples are shared with the sent frames, not copied.
+class TrafficRecorder
+{
+public:
+    TrafficRecorder(const TrafficRecorder&) = delete;
+    TrafficRecorder& operator=(const TrafficRecorder&) = delete;
+
+    TrafficRecorder();
+    ~TrafficRecorder();
+    // record_audio: record samples of frames too. sizes and timings are always recorded.
+    bool open(const std::string& path, bool record_audio);
+    void close();
+    bool isOpened() const;
+
+    // all functions are thread safe. session id 0 is never used.
+    uint32_t beginSession(const std::string& uri, const std::string& body);
+    void recordFrame(uint32_t session, const AudioData& frame);
+    void recordResponse(uint32_t session, const std::string& body);
+    void endSession(uint32_t session, int status);
+
+private:
+    using lock_t = std::unique_lock<std::mutex>;
+
+    struct Record
+    {
+        std::string header;         // serialized record without samples
+        SharedBuffer<char> samples; // written after header
+        bool flush = false;
+    };
+
+    uint64_t now() const;
+    void push(Record&& rec);
+    void processWrites();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<Record> m_records;
+    std::thread m_writer;
+    bool m_opened = false;
+    std::ofstream m_file; // accessed by the writer thread while opened
+    bool m_record_audio = false;
+    uint32_t m_session_seed = 0;
+    std::chrono::steady_clock::time_point m_time_begin;
+};
+using TrafficRecorderPtr = std::shared_ptr<TrafficRecorder>;
+
+
+class TrafficLog
+{
+public:
+    enum class RecordType : uint8_t
+    {
+        Request = 1,
+        Frame = 2,
+        Response = 3,
+        End = 4,
+    };
+
+    struct Frame
+    {
+        uint64_t time = 0;
+        AudioFormat format = AudioFormat::Unknown;
+        int frequency = 0;
+        int channels = 0;
+        uint32_t size = 0;
+        RawVector<char> data; // empty if audio was not recorded
+
+        // recorded samples, or silence of the recorded size if audio was not recorded
+        AudioDataPtr toAudioData() const;
+    };
+
+    struct Session
+    {
+        uint32_t id = 0;
+        uint64_t time_begin = 0;
+        uint64_t time_end = 0;
+        std::string uri;
+        std::string body;
+        std::string response;
+        int status = 0;
+        std::vector<Frame> frames;
+
+        std::string getPath() const;
+    };
+
+    bool load(const std::string& path);
+    std::vector<Session>& getSessions(); // ordered by time_begin
+
+private:
+    std::vector<Session> m_sessions;
+};
+
+} // namespace rt
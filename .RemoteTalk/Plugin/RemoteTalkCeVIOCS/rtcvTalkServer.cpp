@@ -54,6 +54,7 @@ TalkServer::Status TalkServer::onTalk(TalkMessage& mes)
     auto ifs = rtGetTalkInterface_();
     ifs->setParams(mes.params);
     ifs->setText(mes.text.c_str());
+    clearAudioQueue();
 
     if (m_mode == Mode::ExportFile) {
         ifs->setTempFilePath(m_tmp_path.c_str());
@@ -65,8 +66,8 @@ TalkServer::Status TalkServer::onTalk(TalkMessage& mes)
             return Status::Failed;
 
         std::remove(m_tmp_path.c_str());
-        m_data_queue.push_back(data);
-        m_data_queue.push_back(std::make_shared<rt::AudioData>());
+        pushAudio(data);
+        pushAudio(std::make_shared<rt::AudioData>());
     }
     else {
         ifs->setTempFilePath("");
@@ -77,33 +78,11 @@ TalkServer::Status TalkServer::onTalk(TalkMessage& mes)
         m_task_talk = std::async(std::launch::async, [this, ifs]() {
             ifs->wait();
             WaveOutHandler::getInstance().mute = false;
-            {
-                auto terminator = std::make_shared<rt::AudioData>();
-                std::unique_lock<std::mutex> lock(m_data_mutex);
-                m_data_queue.push_back(terminator);
-            }
+            pushAudio(std::make_shared<rt::AudioData>());
         });
     }
 
-    mes.task = std::async(std::launch::async, [this, &mes]() {
-        std::vector<rt::AudioDataPtr> tmp;
-        for (;;) {
-            {
-                std::unique_lock<std::mutex> lock(m_data_mutex);
-                tmp = m_data_queue;
-                m_data_queue.clear();
-            }
-
-            for (auto& ad : tmp) {
-                ad->serialize(*mes.respond_stream);
-            }
-
-            if (!tmp.empty() && tmp.back()->data.empty())
-                break;
-            else
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        }
-        });
+    streamAudio(mes);
     return Status::Succeeded;
 }
 
@@ -129,10 +108,7 @@ void TalkServer::onUpdateBuffer(const rt::AudioData& data)
     auto tmp = std::make_shared<rt::AudioData>(data);
     if (m_params.force_mono)
         tmp->convertToMono();
-    {
-        std::unique_lock<std::mutex> lock(m_data_mutex);
-        m_data_queue.push_back(tmp);
-    }
+    pushAudio(tmp);
 }
 
 } // namespace rtcv
@@ -33,8 +33,6 @@ private:
     std::string m_tmp_path;
 
     std::future<void> m_task_talk;
-    std::mutex m_data_mutex;
-    std::vector<rt::AudioDataPtr> m_data_queue;
 };
 
 } // namespace rtcv
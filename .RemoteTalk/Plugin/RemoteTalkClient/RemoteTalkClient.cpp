@@ -2,6 +2,55 @@
 #include "RemoteTalkClient.h"
 
 
+rtCompletionQueue& rtCompletionQueue::getInstance()
+{
+    static rtCompletionQueue s_instance;
+    return s_instance;
+}
+
+void rtCompletionQueue::push(rtAsyncBase *v)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (std::find(m_queue.begin(), m_queue.end(), v) == m_queue.end())
+        m_queue.push_back(v);
+}
+
+void rtCompletionQueue::remove(rtAsyncBase *v)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queue.erase(std::remove(m_queue.begin(), m_queue.end(), v), m_queue.end());
+}
+
+int rtCompletionQueue::drain(rtAsyncBase **dst, int max)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    int n = std::min(max, (int)m_queue.size());
+    std::copy(m_queue.begin(), m_queue.begin() + n, dst);
+    m_queue.erase(m_queue.begin(), m_queue.begin() + n);
+    return n;
+}
+
+rt::ThreadPool& rtGetWorkerPool()
+{
+    // never destroyed. joining threads while the module is being unloaded can dead lock.
+    static auto *s_instance = new rt::ThreadPool(8);
+    return *s_instance;
+}
+
+rt::ThreadPool& rtGetSinkPool()
+{
+    // separate from the worker pool. talks occupying the workers would starve the sinks they wait for.
+    static auto *s_instance = new rt::ThreadPool(4);
+    return *s_instance;
+}
+
+rt::TalkCache& rtGetTalkCache()
+{
+    static rt::TalkCache s_instance;
+    return s_instance;
+}
+
+
 rtHTTPClient::rtHTTPClient()
 {
 }
@@ -24,16 +73,19 @@ void rtHTTPClient::reset(const char *address, uint16_t port)
 
 rtAsync<bool>& rtHTTPClient::updateServerStats()
 {
-    m_task_stats.task = std::async(std::launch::async, [this]() {
-        if (m_client.stats(m_server_stats)) {
-            return true;
-        }
-        else {
+    m_task_stats.wait();
+    return m_task_stats.run(rt::ThreadPool::JobType::Short, [this]() {
+        rt::TalkServerStats stats;
+        bool ret = m_client.stats(stats);
+
+        // play() reads it on the caller's thread (getCacheKey())
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (ret)
+            m_server_stats = stats;
+        else
             m_server_stats.host = "Server Not Found";
-            return false;
-        }
+        return ret;
     });
-    return m_task_stats;
 }
 
 const rt::TalkServerStats& rtHTTPClient::getServerStats() const
@@ -48,37 +100,124 @@ bool rtHTTPClient::isReady()
 
 rtAsync<bool>& rtHTTPClient::play(const rt::TalkParams& params, const std::string& text)
 {
+    // the previous talk must not push to the playback buffer after reset
+    m_task_talk.wait();
     m_buf_public.clear();
     m_buf_receiving.clear();
-
-    m_task_talk.task = std::async(std::launch::async, [this, params, text]() {
-        return m_client.play(params, text, [this](const rt::AudioData& ad) {
-            if (ad.getSampleLength() != 0) {
-                std::unique_lock<std::mutex> lock(m_mutex);
-                m_buf_receiving += ad;
+    m_playback.reset();
+
+    // chunks are shared by the sinks. playback is fed on the receiving thread.
+    // the public buffer and exports run in parallel as they arrive.
+    auto graph = std::make_shared<rt::SinkGraph>(rtGetSinkPool());
+    graph->add(std::make_shared<rt::PlaybackSink>(m_playback));
+    graph->add(std::make_shared<rt::CallbackSink>([this](const rt::AudioData& ad) {
+        // the audio callback reads m_playback. m_mutex is only shared with the main thread.
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_buf_receiving += ad;
+    }));
+    for (auto& sink : m_sinks)
+        graph->add(sink);
+    m_sinks.clear();
+
+    rt::TalkPlayOptions options;
+    options.cancel = std::make_shared<rt::CancelToken>();
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cancel = options.cancel;
+    }
+    uint64_t key = rtGetTalkCache().isOpened() ? getCacheKey(params, text) : 0;
+    return m_task_talk.run(rt::ThreadPool::JobType::Long, [this, params, text, options, key, graph]() {
+        auto& cache = rtGetTalkCache();
+        std::shared_ptr<rt::AudioData> whole;
+        if (key) {
+            if (auto blob = cache.read(key)) {
+                // the server is not contacted at all. the samples are shared with the mapped file, not copied.
+                auto ad = std::make_shared<rt::AudioData>();
+                blob->toAudioData(*ad);
+                graph->push(ad);
+                graph->finish(true);
+                bool ret = graph->wait();
+                endTalk(options.cancel);
+                return ret;
             }
-        });
+            whole = std::make_shared<rt::AudioData>();
+            graph->add(std::make_shared<rt::CallbackSink>([whole](const rt::AudioData& ad) { *whole += ad; }));
+        }
+
+        bool ret = m_client.play(params, text, [&graph, &options](const rt::AudioData& ad) {
+            if (ad.getSampleLength() != 0)
+                graph->push(std::make_shared<rt::AudioData>(ad));
+            else
+                graph->finish(!options.cancel->isCancelled());
+        }, options);
+        graph->finish(ret);
+        bool sinks_succeeded = graph->wait();
+        endTalk(options.cancel);
+
+        // interrupted talks are incomplete. don't cache them.
+        if (ret && whole && !options.cancel->isCancelled() && whole->getSampleLength() != 0)
+            cache.write(key, *whole);
+        return ret && sinks_succeeded;
     });
-    return m_task_talk;
+}
+
+void rtHTTPClient::endTalk(const rt::CancelTokenPtr& cancel)
+{
+    // finished. stop() no longer targets this talk
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_cancel == cancel)
+        m_cancel.reset();
+}
+
+void rtHTTPClient::addSink(const rt::AudioSinkPtr& sink)
+{
+    m_sinks.push_back(sink);
+}
+
+uint64_t rtHTTPClient::getCacheKey(const rt::TalkParams& params, const std::string& text)
+{
+    std::string host, cast_name;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        host = m_server_stats.host;
+        for (auto& c : m_server_stats.casts) {
+            if (c.id == params.cast) {
+                cast_name = c.name;
+                break;
+            }
+        }
+    }
+    // without the stats talks of different servers and casts would share keys. don't use the cache
+    if (host.empty() || cast_name.empty())
+        return 0;
+    return rt::TalkCache::Fingerprint(host, cast_name, params, text);
 }
 
 rtAsync<bool>& rtHTTPClient::stop()
 {
-    m_task_stop.task = std::async(std::launch::async, [this]() {
-        return m_client.stop();
+    // the stream of our talk is closed right here and play() asks the server to abort just that talk.
+    // other clients' talks are left alone. before the first talk, stop whatever the server is playing.
+    rt::CancelTokenPtr cancel;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        cancel = m_cancel;
+    }
+    bool cancelled = cancel && cancel->cancel();
+    m_task_stop.wait();
+    return m_task_stop.run(rt::ThreadPool::JobType::Short, [this, cancelled]() {
+        return cancelled || m_client.stop();
     });
-    return m_task_stop;
 }
 
 rtAsync<bool>& rtHTTPClient::exportWave(const std::string& path)
 {
     m_task_export.wait();
 
+    // shares the samples. syncBuffers() makes its own copy if it appends while exporting.
     auto tmp_buf = std::make_shared<rt::AudioData>(m_buf_public);
-    m_task_export.task = std::async(std::launch::async, [tmp_buf, path]() {
+    return m_task_export.run(rt::ThreadPool::JobType::Long, [tmp_buf, path]() {
         return ExportWave(*tmp_buf, path.c_str());
     });
-    return m_task_export;
 }
 
 rtAsync<bool>& rtHTTPClient::exportOgg(const std::string& path, const rt::OggSettings& settings)
@@ -86,10 +225,9 @@ rtAsync<bool>& rtHTTPClient::exportOgg(const std::string& path, const rt::OggSet
     m_task_export.wait();
 
     auto tmp_buf = std::make_shared<rt::AudioData>(m_buf_public);
-    m_task_export.task = std::async(std::launch::async, [tmp_buf, path, settings]() {
+    return m_task_export.run(rt::ThreadPool::JobType::Long, [tmp_buf, path, settings]() {
         return ExportOgg(*tmp_buf, path.c_str(), settings);
     });
-    return m_task_export;
 }
 
 void rtHTTPClient::wait()
@@ -120,6 +258,11 @@ const rt::AudioData& rtHTTPClient::getBuffer()
     return m_buf_public;
 }
 
+rt::PlaybackBuffer& rtHTTPClient::getPlayback()
+{
+    return m_playback;
+}
+
 
 
 #pragma region rtAsync
@@ -130,7 +273,86 @@ rtAPI const char* rtGetVersion()
 #pragma endregion
 
 
+#pragma region rtTrace
+rtAPI void rtTraceSetEnabled(bool v)
+{
+    rt::Tracer::getInstance().setEnabled(v);
+}
+
+rtAPI bool rtTraceIsEnabled()
+{
+    return rt::Tracer::getInstance().isEnabled();
+}
+
+rtAPI bool rtTraceExport(const char *path)
+{
+    if (!path)
+        return false;
+    return rt::Tracer::getInstance().exportChromeTrace(path, "RemoteTalkClient");
+}
+#pragma endregion
+
+
+#pragma region rtCache
+// talks are cached in dir while it is opened. budget is the max total size in bytes.
+rtAPI bool rtCacheOpen(const char *dir, uint64_t budget)
+{
+    if (!dir)
+        return false;
+    return rtGetTalkCache().open(dir, budget);
+}
+
+rtAPI void rtCacheClose()
+{
+    rtGetTalkCache().close();
+}
+
+rtAPI bool rtCacheIsOpened()
+{
+    return rtGetTalkCache().isOpened();
+}
+
+rtAPI void rtCacheClear()
+{
+    rtGetTalkCache().clear();
+}
+
+rtAPI void rtCacheSetBudget(uint64_t v)
+{
+    rtGetTalkCache().setBudget(v);
+}
+
+rtAPI uint64_t rtCacheGetUsage()
+{
+    return rtGetTalkCache().getUsage();
+}
+
+rtAPI int rtCacheGetEntryCount()
+{
+    return rtGetTalkCache().getEntryCount();
+}
+#pragma endregion
+
+
 #pragma region rtAsync
+rtAPI void rtSetWorkerThreadCount(int v)
+{
+    rtGetWorkerPool().setThreadCount(v);
+}
+
+rtAPI int rtGetWorkerThreadCount()
+{
+    return rtGetWorkerPool().getThreadCount();
+}
+
+// handles of operations finished since the last call. the application can call this once per frame.
+rtAPI int rtAsyncDrainCompleted(rtAsyncBase **dst, int max)
+{
+    if (!dst || max <= 0)
+        return 0;
+    return rtCompletionQueue::getInstance().drain(dst, max);
+}
+
 rtAPI bool rtAsyncIsValid(rtAsyncBase *self)
 {
     if (!self)
@@ -408,6 +630,49 @@ rtAPI const rtAudioData* rtHTTPClientGetBuffer(rtHTTPClient *self)
     return &self->getBuffer();
 }
 
+// these don't lock. safe to call from the audio thread.
+rtAPI double rtHTTPClientReadSamples(rtHTTPClient *self, float *dst, int frequency, int channels, int length, double pos)
+{
+    if (!self || !dst)
+        return 0;
+    return self->getPlayback().read(dst, frequency, channels, length, pos);
+}
+
+rtAPI int rtHTTPClientGetPlaybackLength(rtHTTPClient *self)
+{
+    if (!self)
+        return 0;
+    return self->getPlayback().getFrameLength();
+}
+
+rtAPI bool rtHTTPClientIsPlaybackFinished(rtHTTPClient *self)
+{
+    if (!self)
+        return false;
+    return self->getPlayback().isFinished();
+}
+
+rtAPI int rtHTTPClientGetUnderrunCount(rtHTTPClient *self)
+{
+    if (!self)
+        return 0;
+    return self->getPlayback().getUnderrunCount();
+}
+
+// these write the next talk to the file while it is being received
+rtAPI void rtHTTPClientAddWaveSink(rtHTTPClient *self, const char *path)
+{
+    if (!self || !path)
+        return;
+    self->addSink(std::make_shared<rt::WaveSink>(path));
+}
+rtAPI void rtHTTPClientAddOggSink(rtHTTPClient *self, const char *path, const rtOggSettings *settings)
+{
+    if (!self || !path || !settings)
+        return;
+    self->addSink(std::make_shared<rt::OggSink>(path, *settings));
+}
+
 rtAPI rtAsyncBase* rtHTTPClientExportWave(rtHTTPClient *self, const char *path)
 {
     if (!self || !path)
@@ -421,3 +686,87 @@ rtAPI rtAsyncBase* rtHTTPClientExportOgg(rtHTTPClient *self, const char *path, c
     return &self->exportOgg(path, *settings);
 }
 #pragma endregion
+
+
+#pragma region rtRenderQueue
+using rtRenderQueue = rt::RenderQueue;
+using rtRenderProgress = rt::RenderQueue::Progress;
+
+rtAPI rtRenderQueue* rtRenderQueueCreate()
+{
+    return new rtRenderQueue();
+}
+
+rtAPI void rtRenderQueueRelease(rtRenderQueue *self)
+{
+    delete self;
+}
+
+rtAPI void rtRenderQueueAddServer(rtRenderQueue *self, const char *address, int port, int max_concurrency)
+{
+    if (!self || !address)
+        return;
+    self->addServer({ address, (uint16_t)port }, max_concurrency);
+}
+
+rtAPI void rtRenderQueueSetMaxRetries(rtRenderQueue *self, int v)
+{
+    if (self)
+        self->setMaxRetries(v);
+}
+
+rtAPI void rtRenderQueueSetOggSettings(rtRenderQueue *self, const rtOggSettings *settings)
+{
+    if (self && settings)
+        self->setOggSettings(*settings);
+}
+
+// cast is the cast name. null or empty uses the cast id in p.
+rtAPI int rtRenderQueueAddJob(rtRenderQueue *self, const char *cast, const rtTalkParams *p, const char *text, const char *path)
+{
+    if (!self || !p || !text || !path)
+        return -1;
+    return self->addJob({ cast ? cast : "", *p, text, path });
+}
+
+rtAPI bool rtRenderQueueStart(rtRenderQueue *self)
+{
+    if (!self)
+        return false;
+    return self->start();
+}
+
+rtAPI void rtRenderQueueCancel(rtRenderQueue *self)
+{
+    if (self)
+        self->cancel();
+}
+
+rtAPI bool rtRenderQueueWait(rtRenderQueue *self, int timeout_ms)
+{
+    if (!self)
+        return false;
+    return self->wait(timeout_ms);
+}
+
+rtAPI bool rtRenderQueueIsFinished(rtRenderQueue *self)
+{
+    if (!self)
+        return false;
+    return self->isFinished();
+}
+
+rtAPI void rtRenderQueueGetProgress(rtRenderQueue *self, rtRenderProgress *dst)
+{
+    if (!self || !dst)
+        return;
+    *dst = self->getProgress();
+}
+
+rtAPI int rtRenderQueueGetJobState(rtRenderQueue *self, int i)
+{
+    if (!self)
+        return (int)rt::RenderQueue::JobState::Failed;
+    return (int)self->getJobState(i);
+}
+#pragma endregion
@@ -10,10 +10,58 @@ struct rtAsyncBase
     virtual bool wait(int timeout_ms = 0) = 0;
 };
 
+// finished rtAsync are queued here, so that the application can drain them once per frame
+// instead of polling each of them.
+class rtCompletionQueue
+{
+public:
+    static rtCompletionQueue& getInstance();
+
+    void push(rtAsyncBase *v);
+    void remove(rtAsyncBase *v);
+    // returns the number of handles written to dst
+    int drain(rtAsyncBase **dst, int max);
+
+private:
+    std::mutex m_mutex;
+    std::vector<rtAsyncBase*> m_queue;
+};
+
+// all asynchronous operations of the plugin run on this pool instead of a thread per operation.
+rt::ThreadPool& rtGetWorkerPool();
+// sinks of talks (files, cache and callbacks) run here. talks wait for them on the worker pool.
+rt::ThreadPool& rtGetSinkPool();
+
+// rendered talks of all clients are cached here when it is opened. see rtCacheOpen().
+rt::TalkCache& rtGetTalkCache();
+
 template<class T>
 struct rtAsync : public rtAsyncBase
 {
     std::future<T> task;
+    std::atomic_int pending{ 0 };
+
+    ~rtAsync()
+    {
+        // the completion callback refers this
+        if (task.valid())
+            task.wait();
+        while (pending > 0)
+            std::this_thread::yield();
+        rtCompletionQueue::getInstance().remove(this);
+    }
+
+    // runs f on the worker pool. the handle is queued to rtCompletionQueue when it finishes.
+    template<class F>
+    rtAsync& run(rt::ThreadPool::JobType type, F&& f)
+    {
+        ++pending;
+        task = rtGetWorkerPool().submit(type, std::forward<F>(f), [this]() {
+            rtCompletionQueue::getInstance().push(this);
+            --pending;
+        });
+        return *this;
+    }
 
     bool isValid() override
     {
@@ -58,6 +106,8 @@ public:
 
     bool isReady();
     rtAsync<bool>& play(const rt::TalkParams& params, const std::string& text);
+    // sink of the next play(). e.g. to export the talk while it is received.
+    void addSink(const rt::AudioSinkPtr& sink);
     rtAsync<bool>& stop();
     rtAsync<bool>& exportWave(const std::string& path);
     rtAsync<bool>& exportOgg(const std::string& path, const rt::OggSettings& settings);
@@ -66,7 +116,14 @@ public:
     const rt::AudioData& syncBuffers();
     const rt::AudioData& getBuffer();
 
+    // lock free access for the audio callback. see rt::PlaybackBuffer.
+    rt::PlaybackBuffer& getPlayback();
+
 private:
+    // 0 (don't cache) if the server's host and cast names are unknown
+    uint64_t getCacheKey(const rt::TalkParams& params, const std::string& text);
+    void endTalk(const rt::CancelTokenPtr& cancel);
+
     rt::TalkClientSettings m_settings;
     rt::TalkClient m_client;
 
@@ -74,6 +131,9 @@ private:
     rt::AudioData m_buf_receiving;
     rt::AudioData m_buf_public;
     std::mutex m_mutex;
+    rt::PlaybackBuffer m_playback;
+    rt::CancelTokenPtr m_cancel; // of the current talk. null when it has finished. guarded by m_mutex
+    std::vector<rt::AudioSinkPtr> m_sinks;
     rtAsync<bool> m_task_stats;
     rtAsync<bool> m_task_talk;
     rtAsync<bool> m_task_stop;
@@ -0,0 +1,291 @@
+#include "pch.h"
+#include "RemoteTalk/RemoteTalk.h"
+#include "RemoteTalk/RemoteTalkNet.h"
+#include "RemoteTalk/picojson/picojson.h"
+
+// load generator. drives concurrent TalkClients and reports latency histograms as JSON.
+// usage: RemoteTalkLoad [name=value ...]
+//  server, port: target server (127.0.0.1, 8180)
+//  clients: number of concurrent clients (8)
+//  duration: length of the run in seconds (10)
+//  requests: max requests per client. 0 means until duration (0)
+//  mix: weights of requests (stats:1,talk:8,stop:1)
+//  text, cast: talk content ("Hello RemoteTalk.", 0)
+//  think_ms: interval between requests of a client (0)
+//  timeout_ms: TalkClientSettings::timeout_ms (30000)
+//  local_transport: use shared memory on the same host (0)
+//  seed: seed of the request mix (0)
+//  out: output file. stdout if not specified
+// all times are in microseconds.
+
+struct LoadSettings
+{
+    rt::TalkClientSettings client{ "127.0.0.1", 8180 };
+    int clients = 8;
+    float duration = 10.0f;
+    int requests = 0;
+    int weight_stats = 1;
+    int weight_talk = 8;
+    int weight_stop = 1;
+    std::string text = "Hello RemoteTalk.";
+    int cast = 0;
+    int think_ms = 0;
+    uint32_t seed = 0;
+    std::string out;
+};
+
+struct RequestStats
+{
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    rt::Histogram latency;
+
+    void merge(const RequestStats& v)
+    {
+        requests += v.requests;
+        errors += v.errors;
+        latency.merge(v.latency);
+    }
+};
+
+struct TalkStats
+{
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    rt::Histogram ttfa;     // time to first audio
+    rt::Histogram total;    // total stream time
+    rt::Histogram bytes_per_sec{ 10, 1ull << 40 };
+
+    void merge(const TalkStats& v)
+    {
+        requests += v.requests;
+        errors += v.errors;
+        bytes += v.bytes;
+        ttfa.merge(v.ttfa);
+        total.merge(v.total);
+        bytes_per_sec.merge(v.bytes_per_sec);
+    }
+};
+
+// each client records to its own histograms. they are merged after the run.
+struct ClientResult
+{
+    RequestStats stats;
+    RequestStats stop;
+    TalkStats talk;
+
+    void merge(const ClientResult& v)
+    {
+        stats.merge(v.stats);
+        stop.merge(v.stop);
+        talk.merge(v.talk);
+    }
+};
+
+using std::chrono::steady_clock;
+
+static uint64_t ElapsedUS(steady_clock::time_point begin)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(steady_clock::now() - begin).count();
+}
+
+static void RunClient(const LoadSettings& settings, int index, steady_clock::time_point deadline, ClientResult& result)
+{
+    rt::TalkClient client(settings.client);
+    std::mt19937 rng(settings.seed + index);
+    int weight_total = settings.weight_stats + settings.weight_talk + settings.weight_stop;
+    std::uniform_int_distribution<int> dist(0, std::max(weight_total - 1, 0));
+
+    rt::TalkParams params;
+    params.cast = (short)settings.cast;
+
+    for (int i = 0; settings.requests <= 0 || i < settings.requests; ++i) {
+        if (steady_clock::now() >= deadline)
+            break;
+
+        int r = dist(rng);
+        auto begin = steady_clock::now();
+        if (r < settings.weight_stats) {
+            rt::TalkServerStats stats;
+            bool ok = client.stats(stats);
+            result.stats.latency.record(ElapsedUS(begin));
+            ++result.stats.requests;
+            if (!ok)
+                ++result.stats.errors;
+        }
+        else if (r < settings.weight_stats + settings.weight_talk) {
+            bool first = true;
+            uint64_t bytes = 0;
+            bool ok = client.play(params, settings.text, [&](const rt::AudioData& ad) {
+                if (ad.data.empty())
+                    return;
+                if (first) {
+                    first = false;
+                    result.talk.ttfa.record(ElapsedUS(begin));
+                }
+                bytes += ad.data.size();
+            });
+            auto elapsed = ElapsedUS(begin);
+            ++result.talk.requests;
+            result.talk.bytes += bytes;
+            if (ok && bytes > 0) {
+                result.talk.total.record(elapsed);
+                result.talk.bytes_per_sec.record(bytes * 1000000 / std::max<uint64_t>(elapsed, 1));
+            }
+            else
+                ++result.talk.errors;
+        }
+        else {
+            bool ok = client.stop();
+            result.stop.latency.record(ElapsedUS(begin));
+            ++result.stop.requests;
+            if (!ok)
+                ++result.stop.errors;
+        }
+
+        if (settings.think_ms > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(settings.think_ms));
+    }
+}
+
+static picojson::value ToJson(const RequestStats& v, float duration)
+{
+    using namespace picojson;
+    object ret;
+    ret["requests"] = rt::to_json(v.requests);
+    ret["errors"] = rt::to_json(v.errors);
+    ret["error_rate"] = value(v.requests > 0 ? (float)((double)v.errors / (double)v.requests) : 0.0f);
+    ret["requests_per_sec"] = rt::to_json((double)v.requests / duration);
+    ret["latency"] = rt::to_json(v.latency);
+    return value(std::move(ret));
+}
+
+static picojson::value ToJson(const TalkStats& v, float duration)
+{
+    using namespace picojson;
+    object ret;
+    ret["requests"] = rt::to_json(v.requests);
+    ret["errors"] = rt::to_json(v.errors);
+    ret["error_rate"] = value(v.requests > 0 ? (float)((double)v.errors / (double)v.requests) : 0.0f);
+    ret["requests_per_sec"] = rt::to_json((double)v.requests / duration);
+    ret["bytes"] = rt::to_json(v.bytes);
+    ret["ttfa"] = rt::to_json(v.ttfa);
+    ret["total"] = rt::to_json(v.total);
+    ret["bytes_per_sec"] = rt::to_json(v.bytes_per_sec);
+    return value(std::move(ret));
+}
+
+static void ParseMix(LoadSettings& settings, const std::string& mix)
+{
+    settings.weight_stats = settings.weight_talk = settings.weight_stop = 0;
+    std::istringstream ss(mix);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        auto sep = item.find(':');
+        auto name = item.substr(0, sep);
+        int weight = sep == std::string::npos ? 1 : std::max(std::atoi(item.substr(sep + 1).c_str()), 0);
+        if (name == "stats")
+            settings.weight_stats = weight;
+        else if (name == "talk")
+            settings.weight_talk = weight;
+        else if (name == "stop")
+            settings.weight_stop = weight;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    LoadSettings settings;
+    settings.client.local_transport = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto sep = arg.find('=');
+        if (sep == std::string::npos)
+            continue;
+        auto name = arg.substr(0, sep);
+        auto value = arg.substr(sep + 1);
+        auto to_i = [&]() { return std::atoi(value.c_str()); };
+
+        if (name == "server")
+            settings.client.server = value;
+        else if (name == "port")
+            settings.client.port = (uint16_t)to_i();
+        else if (name == "timeout_ms")
+            settings.client.timeout_ms = to_i();
+        else if (name == "local_transport")
+            settings.client.local_transport = to_i() != 0;
+        else if (name == "clients")
+            settings.clients = std::max(to_i(), 1);
+        else if (name == "duration")
+            settings.duration = std::max((float)std::atof(value.c_str()), 0.1f);
+        else if (name == "requests")
+            settings.requests = to_i();
+        else if (name == "mix")
+            ParseMix(settings, value);
+        else if (name == "text")
+            settings.text = value;
+        else if (name == "cast")
+            settings.cast = to_i();
+        else if (name == "think_ms")
+            settings.think_ms = to_i();
+        else if (name == "seed")
+            settings.seed = (uint32_t)to_i();
+        else if (name == "out")
+            settings.out = value;
+    }
+    if (settings.weight_stats + settings.weight_talk + settings.weight_stop <= 0) {
+        fprintf(stderr, "mix has no requests\n");
+        return 1;
+    }
+
+    std::vector<ClientResult> results(settings.clients);
+    std::vector<std::thread> threads;
+    auto begin = steady_clock::now();
+    auto deadline = begin + std::chrono::milliseconds((int)(settings.duration * 1000.0f));
+    for (int i = 0; i < settings.clients; ++i)
+        threads.emplace_back([&, i]() { RunClient(settings, i, deadline, results[i]); });
+    for (auto& t : threads)
+        t.join();
+    float duration = std::chrono::duration<float>(steady_clock::now() - begin).count();
+
+    ClientResult total;
+    for (auto& r : results)
+        total.merge(r);
+
+    using namespace picojson;
+    object s;
+    s["server"] = value(settings.client.server);
+    s["port"] = value((int64_t)settings.client.port);
+    s["clients"] = value((int64_t)settings.clients);
+    s["requests"] = value((int64_t)settings.requests);
+    s["mix_stats"] = value((int64_t)settings.weight_stats);
+    s["mix_talk"] = value((int64_t)settings.weight_talk);
+    s["mix_stop"] = value((int64_t)settings.weight_stop);
+    s["text"] = value(settings.text);
+    s["cast"] = value((int64_t)settings.cast);
+    s["think_ms"] = value((int64_t)settings.think_ms);
+    s["local_transport"] = value(settings.client.local_transport);
+
+    object ret;
+    ret["settings"] = value(std::move(s));
+    ret["duration"] = value(duration);
+    ret["stats"] = ToJson(total.stats, duration);
+    ret["talk"] = ToJson(total.talk, duration);
+    ret["stop"] = ToJson(total.stop, duration);
+    auto json = value(std::move(ret)).serialize(true);
+
+    if (settings.out.empty()) {
+        printf("%s\n", json.c_str());
+    }
+    else {
+        std::ofstream fo(settings.out);
+        if (!fo) {
+            fprintf(stderr, "failed to open %s\n", settings.out.c_str());
+            return 1;
+        }
+        fo << json;
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "pch.h"
+#include "RemoteTalk/RemoteTalk.h"
+#include "RemoteTalk/RemoteTalkNet.h"
+
+// usage: RemoteTalkProxy [port=8080] [config=RemoteTalkVOICEROID2.json ...] [backend=127.0.0.1:8100 ...] [interval=5000]
+//  config: settings table of host servers. all servers in it become backends. can be specified multiple times.
+//  backend: address of a host server. can be specified multiple times.
+//  interval: period of updating backends' stats in milliseconds.
+//  trace: 1 enables span tracing (served at "/trace").
+int main(int argc, char *argv[])
+{
+    rt::TalkServerSettings settings;
+    settings.port = 8080;
+    int interval = 5000;
+
+    std::vector<std::string> configs, backends;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto sep = arg.find('=');
+        if (sep == std::string::npos)
+            continue;
+        auto name = arg.substr(0, sep);
+        auto value = arg.substr(sep + 1);
+        if (name == "port")
+            settings.port = (uint16_t)std::atoi(value.c_str());
+        else if (name == "config")
+            configs.push_back(value);
+        else if (name == "backend")
+            backends.push_back(value);
+        else if (name == "interval")
+            interval = std::max(std::atoi(value.c_str()), 100);
+        else if (name == "low_latency")
+            settings.low_latency = std::atoi(value.c_str()) != 0;
+        else if (name == "trace")
+            settings.trace = std::atoi(value.c_str()) != 0;
+    }
+
+    rt::TalkProxy proxy;
+    proxy.setSettings(settings);
+    for (auto& path : configs) {
+        if (!proxy.loadBackends(path))
+            printf("failed to load %s\n", path.c_str());
+    }
+    for (auto& addr : backends) {
+        rt::TalkClientSettings cs;
+        auto sep = addr.find(':');
+        cs.server = addr.substr(0, sep);
+        if (sep != std::string::npos)
+            cs.port = (uint16_t)std::atoi(addr.substr(sep + 1).c_str());
+        proxy.addBackend(cs);
+    }
+    if (proxy.getBackends().empty()) {
+        printf("no backends. specify config=path or backend=host:port\n");
+        return 1;
+    }
+
+    proxy.updateBackends();
+    if (!proxy.start()) {
+        printf("failed to start server on port %d\n", (int)settings.port);
+        return 1;
+    }
+    printf("RemoteTalkProxy: listening on port %d\n", (int)settings.port);
+
+    // backends that are down can take a while to time out. update them on another thread.
+    std::thread updater([&]() {
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+            proxy.updateBackends();
+        }
+    });
+
+    for (;;) {
+        proxy.processMessages();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#ifdef _WIN32
+#pragma warning(disable:4996)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <memory>
@@ -0,0 +1,420 @@
+#include "pch.h"
+#include "RemoteTalk/RemoteTalk.h"
+#include "RemoteTalk/RemoteTalkNet.h"
+#include "RemoteTalk/picojson/picojson.h"
+
+// replays traffic recorded by TalkServer (TalkServerSettings::record_path).
+// usage: RemoteTalkReplay log=path [mode=request|serve] [name=value ...]
+//  mode=request: re-issues the recorded requests against a server and compares timings.
+//    server, port: target server (127.0.0.1, 8180)
+//    speed: 1 keeps the recorded timing, 2 is twice as fast, 0 issues requests one by one without waiting (1)
+//    out: output file of the JSON report. stdout if not specified
+//  mode=serve: serves the recorded responses with the recorded timing, for benchmarking clients.
+//    port: listening port (8190)
+//    speed: same as above. 0 sends frames without waiting
+
+using namespace Poco::Net;
+using std::chrono::steady_clock;
+
+// shared memory transport can't be replayed through the raw HTTP stream. always receive via the response body.
+static std::string StripTransport(const std::string& uri)
+{
+    auto q = uri.find('?');
+    if (q == std::string::npos)
+        return uri;
+
+    std::string ret = uri.substr(0, q + 1);
+    std::istringstream ss(uri.substr(q + 1));
+    std::string item;
+    bool first = true;
+    while (std::getline(ss, item, '&')) {
+        if (item.compare(0, 10, "transport=") == 0)
+            continue;
+        if (!first)
+            ret += '&';
+        ret += item;
+        first = false;
+    }
+    return ret;
+}
+
+static float ToMS(uint64_t us)
+{
+    return (float)((double)us / 1000.0);
+}
+
+
+struct ReplayResult
+{
+    int status = 0;
+    uint64_t ttfa = 0;  // microseconds. 0 if no audio
+    uint64_t total = 0;
+    uint64_t bytes = 0;
+    int frames = 0;
+};
+
+static ReplayResult ReplaySession(const rt::TrafficLog::Session& session, const std::string& server, uint16_t port)
+{
+    ReplayResult ret;
+    auto begin = steady_clock::now();
+    auto elapsed = [&]() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(steady_clock::now() - begin).count();
+    };
+
+    try {
+        HTTPClientSession hs{ server, port };
+        hs.setTimeout(Poco::Timespan(60, 0));
+
+        HTTPRequest request{ HTTPRequest::HTTP_GET, StripTransport(session.uri) };
+        if (!session.body.empty()) {
+            request.setContentLength(session.body.size());
+            hs.sendRequest(request) << session.body;
+        }
+        else {
+            hs.sendRequest(request);
+        }
+
+        HTTPResponse response;
+        auto& rs = hs.receiveResponse(response);
+        ret.status = response.getStatus();
+        if (session.getPath() == "/talk" && ret.status == HTTPResponse::HTTP_OK) {
+            rt::AudioData ad;
+            for (;;) {
+                ad.deserialize(rs);
+                if (ad.data.empty() || !rs)
+                    break;
+                if (ret.frames++ == 0)
+                    ret.ttfa = elapsed();
+                ret.bytes += ad.data.size();
+            }
+        }
+        else {
+            std::string body(std::istreambuf_iterator<char>(rs), {});
+            ret.bytes = body.size();
+        }
+    }
+    catch (Poco::Exception& e) {
+        fprintf(stderr, "%s: %s\n", session.uri.c_str(), e.displayText().c_str());
+    }
+    ret.total = elapsed();
+    return ret;
+}
+
+static int RunRequestMode(rt::TrafficLog& log, const std::string& server, uint16_t port, float speed, const std::string& out)
+{
+    auto& sessions = log.getSessions();
+    std::vector<ReplayResult> results(sessions.size());
+
+    if (speed <= 0.0f) {
+        for (size_t i = 0; i < sessions.size(); ++i)
+            results[i] = ReplaySession(sessions[i], server, port);
+    }
+    else {
+        // keep the recorded intervals between requests. concurrent sessions are replayed concurrently.
+        std::vector<std::thread> threads;
+        auto begin = steady_clock::now();
+        uint64_t origin = sessions.empty() ? 0 : sessions.front().time_begin;
+        for (size_t i = 0; i < sessions.size(); ++i) {
+            auto offset = std::chrono::duration<double>((double)(sessions[i].time_begin - origin) / 1000000.0 / speed);
+            std::this_thread::sleep_until(begin + std::chrono::duration_cast<steady_clock::duration>(offset));
+            threads.emplace_back([&, i]() { results[i] = ReplaySession(sessions[i], server, port); });
+        }
+        for (auto& t : threads)
+            t.join();
+    }
+
+    using namespace picojson;
+    rt::Histogram ttfa_recorded, ttfa_replayed, total_recorded, total_replayed;
+    int mismatches = 0;
+    array items;
+    for (size_t i = 0; i < sessions.size(); ++i) {
+        auto& s = sessions[i];
+        auto& r = results[i];
+
+        uint64_t rec_ttfa = 0, rec_bytes = 0;
+        int rec_frames = 0;
+        for (auto& f : s.frames) {
+            if (f.size == 0)
+                continue;
+            if (rec_frames++ == 0)
+                rec_ttfa = f.time - s.time_begin;
+            rec_bytes += f.size;
+        }
+        uint64_t rec_total = s.time_end > s.time_begin ? s.time_end - s.time_begin : 0;
+
+        bool is_talk = s.getPath() == "/talk";
+        if (is_talk) {
+            if (rec_frames > 0) {
+                ttfa_recorded.record(rec_ttfa);
+                total_recorded.record(rec_total);
+            }
+            if (r.frames > 0) {
+                ttfa_replayed.record(r.ttfa);
+                total_replayed.record(r.total);
+            }
+            if (r.bytes != rec_bytes)
+                ++mismatches;
+        }
+
+        object recorded;
+        recorded["status"] = value((int64_t)s.status);
+        recorded["total_ms"] = value(ToMS(rec_total));
+        object replayed;
+        replayed["status"] = value((int64_t)r.status);
+        replayed["total_ms"] = value(ToMS(r.total));
+        if (is_talk) {
+            recorded["ttfa_ms"] = value(ToMS(rec_ttfa));
+            recorded["bytes"] = rt::to_json(rec_bytes);
+            recorded["frames"] = value((int64_t)rec_frames);
+            replayed["ttfa_ms"] = value(ToMS(r.ttfa));
+            replayed["bytes"] = rt::to_json(r.bytes);
+            replayed["frames"] = value((int64_t)r.frames);
+        }
+
+        object item;
+        item["uri"] = value(s.uri);
+        item["recorded"] = value(std::move(recorded));
+        item["replayed"] = value(std::move(replayed));
+        items.push_back(value(std::move(item)));
+    }
+
+    object ret;
+    ret["server"] = value(server);
+    ret["port"] = value((int64_t)port);
+    ret["speed"] = value(speed);
+    ret["sessions"] = value((int64_t)sessions.size());
+    ret["talk_size_mismatches"] = value((int64_t)mismatches);
+    ret["ttfa_recorded_us"] = rt::to_json(ttfa_recorded);
+    ret["ttfa_replayed_us"] = rt::to_json(ttfa_replayed);
+    ret["total_recorded_us"] = rt::to_json(total_recorded);
+    ret["total_replayed_us"] = rt::to_json(total_replayed);
+    ret["details"] = value(std::move(items));
+    auto json = value(std::move(ret)).serialize(true);
+
+    if (out.empty()) {
+        printf("%s\n", json.c_str());
+    }
+    else {
+        std::ofstream fo(out);
+        if (!fo) {
+            fprintf(stderr, "failed to open %s\n", out.c_str());
+            return 1;
+        }
+        fo << json;
+    }
+    return 0;
+}
+
+
+// serves recorded responses. talks are matched by cast and text, or served in recorded order if nothing matches.
+// recorded frames are fed by pushAudio() as if a host were playing them, so they go through the same path
+// (coalescing, single-flight, stop and metrics) as real talks.
+class ReplayServer : public rt::TalkServer
+{
+public:
+    ReplayServer(rt::TrafficLog& log, float speed);
+    ~ReplayServer() override;
+
+    bool isReady() override;
+    Status onStats(StatsMessage& mes) override;
+    Status onTalk(TalkMessage& mes) override;
+    Status onStop(StopMessage& mes) override;
+
+private:
+    static std::string getKey(int cast, const std::string& text);
+    void feed(const rt::TrafficLog::Session *session);
+    void stopFeeder();
+
+    float m_speed = 1.0f;
+    std::string m_stats;
+    std::vector<const rt::TrafficLog::Session*> m_talks;
+    std::multimap<std::string, const rt::TrafficLog::Session*> m_talk_table;
+    size_t m_next = 0;
+
+    std::thread m_feeder;
+    std::mutex m_feeder_mutex;
+    std::condition_variable m_feeder_cond;
+    bool m_stop_feeding = false;
+    std::atomic_bool m_feeding{ false };
+};
+
+ReplayServer::ReplayServer(rt::TrafficLog& log, float speed)
+    : m_speed(speed)
+{
+    for (auto& s : log.getSessions()) {
+        auto path = s.getPath();
+        if (path == "/stats" && !s.response.empty()) {
+            m_stats = s.response;
+        }
+        else if (path == "/talk" && !s.frames.empty()) {
+            // same parameter handling as TalkServerRequestHandler
+            Poco::URI uri(s.uri);
+            int cast = 0;
+            std::string text;
+            for (auto& nvp : uri.getQueryParameters()) {
+                if (nvp.first == "cast")
+                    cast = rt::from_string<int>(nvp.second);
+                else if (nvp.first == "text") {
+                    Poco::URI::decode(nvp.second, text, true);
+                    text = rt::ToANSI(text.c_str());
+                }
+            }
+            m_talks.push_back(&s);
+            m_talk_table.insert({ getKey(cast, text), &s });
+        }
+    }
+}
+
+ReplayServer::~ReplayServer()
+{
+    stop();
+    stopFeeder();
+}
+
+std::string ReplayServer::getKey(int cast, const std::string& text)
+{
+    return std::to_string(cast) + ":" + text;
+}
+
+bool ReplayServer::isReady()
+{
+    return true;
+}
+
+ReplayServer::Status ReplayServer::onStats(StatsMessage& mes)
+{
+    if (m_stats.empty() || !mes.from_json(m_stats)) {
+        mes.stats.host = "RemoteTalkReplay";
+        mes.stats.plugin_version = rtPluginVersion;
+        mes.stats.protocol_version = rtProtocolVersion;
+    }
+    return Status::Succeeded;
+}
+
+ReplayServer::Status ReplayServer::onTalk(TalkMessage& mes)
+{
+    if (m_talks.empty())
+        return Status::Failed;
+    // one talk at a time like real hosts. the previous one is done when streamAudio() has taken its terminator.
+    if (m_feeding)
+        return Status::Failed;
+    {
+        lock_t lock(m_data_mutex);
+        if (!m_data_queue.empty())
+            return Status::Failed;
+    }
+
+    const rt::TrafficLog::Session *session = nullptr;
+    auto it = m_talk_table.find(getKey(mes.params.cast, mes.text));
+    if (it != m_talk_table.end())
+        session = it->second;
+    else
+        session = m_talks[m_next++ % m_talks.size()];
+
+    stopFeeder(); // joins the previous one. it has finished.
+    clearAudioQueue();
+    m_feeding = true;
+    m_feeder = std::thread([this, session]() { feed(session); });
+
+    streamAudio(mes);
+    return Status::Succeeded;
+}
+
+ReplayServer::Status ReplayServer::onStop(StopMessage& /*mes*/)
+{
+    stopFeeder();
+    return Status::Succeeded;
+}
+
+// plays the recorded frames at the recorded pace (scaled by m_speed) and ends with the terminator
+void ReplayServer::feed(const rt::TrafficLog::Session *session)
+{
+    auto begin = steady_clock::now();
+    for (auto& f : session->frames) {
+        if (f.size == 0)
+            continue;
+        {
+            lock_t lock(m_feeder_mutex);
+            if (m_speed > 0.0f) {
+                auto offset = std::chrono::duration<double>((double)(f.time - session->time_begin) / 1000000.0 / m_speed);
+                m_feeder_cond.wait_until(lock, begin + std::chrono::duration_cast<steady_clock::duration>(offset),
+                    [this]() { return m_stop_feeding; });
+            }
+            if (m_stop_feeding)
+                break;
+        }
+        pushAudio(f.toAudioData());
+    }
+    pushAudio(std::make_shared<rt::AudioData>());
+    m_feeding = false;
+}
+
+void ReplayServer::stopFeeder()
+{
+    {
+        lock_t lock(m_feeder_mutex);
+        m_stop_feeding = true;
+    }
+    m_feeder_cond.notify_all();
+    if (m_feeder.joinable())
+        m_feeder.join();
+    m_stop_feeding = false;
+}
+
+static int RunServeMode(rt::TrafficLog& log, uint16_t port, float speed)
+{
+    ReplayServer server(log, speed);
+    auto settings = server.getSettings();
+    settings.port = port;
+    server.setSettings(settings);
+    if (!server.start()) {
+        printf("failed to start server on port %d\n", (int)port);
+        return 1;
+    }
+    printf("RemoteTalkReplay: serving %d sessions on port %d\n", (int)log.getSessions().size(), (int)port);
+
+    for (;;) {
+        server.processMessages();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    std::string log_path, mode = "request", server = "127.0.0.1", out;
+    int port = 0;
+    float speed = 1.0f;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto sep = arg.find('=');
+        if (sep == std::string::npos)
+            continue;
+        auto name = arg.substr(0, sep);
+        auto value = arg.substr(sep + 1);
+        if (name == "log")
+            log_path = value;
+        else if (name == "mode")
+            mode = value;
+        else if (name == "server")
+            server = value;
+        else if (name == "port")
+            port = std::atoi(value.c_str());
+        else if (name == "speed")
+            speed = (float)std::atof(value.c_str());
+        else if (name == "out")
+            out = value;
+    }
+
+    rt::TrafficLog log;
+    if (log_path.empty() || !log.load(log_path)) {
+        fprintf(stderr, "failed to load traffic log. specify log=path\n");
+        return 1;
+    }
+
+    if (mode == "serve")
+        return RunServeMode(log, (uint16_t)(port > 0 ? port : 8190), speed);
+    else
+        return RunRequestMode(log, server, (uint16_t)(port > 0 ? port : 8180), speed, out);
+}
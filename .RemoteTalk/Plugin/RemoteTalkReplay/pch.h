@@ -0,0 +1,29 @@
+#pragma once
+
+#ifdef _WIN32
+#pragma warning(disable:4996)
+#define NOMINMAX
+#include <winsock2.h>
+#include <windows.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <functional>
+
+#define POCO_STATIC
+#include "Poco/URI.h"
+#include "Poco/Net/HTTPClientSession.h"
+#include "Poco/Net/HTTPRequest.h"
+#include "Poco/Net/HTTPResponse.h"
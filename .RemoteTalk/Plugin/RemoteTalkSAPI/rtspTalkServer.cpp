@@ -101,6 +101,7 @@ TalkServer::Status TalkServer::onTalk(TalkMessage& mes)
         m_voice->SetRate((long)(mes.params[0] * 10.0f - 10.0f));
 
     auto text = rt::ToWCS(rt::ToUTF8(mes.text));
+    clearAudioQueue();
     m_playing = true;
     m_task_talk = std::async(std::launch::async, [this, text]() {
         m_voice->Speak(text.c_str(), 0, nullptr);
@@ -111,26 +112,7 @@ TalkServer::Status TalkServer::onTalk(TalkMessage& mes)
         m_playing = false;
     });
 
-    mes.task = std::async(std::launch::async, [this, &mes]() {
-        std::vector<rt::AudioDataPtr> tmp;
-        for (;;) {
-            {
-                std::unique_lock<std::mutex> lock(m_data_mutex);
-                tmp = m_data_queue;
-                m_data_queue.clear();
-            }
-
-            for (auto& ad : tmp) {
-                ad->serialize(*mes.respond_stream);
-            }
-
-            if (!tmp.empty() && tmp.back()->data.empty())
-                break;
-            else
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        }
-    });
-
+    streamAudio(mes);
     return Status::Succeeded;
 }
 
@@ -170,10 +152,7 @@ void TalkServer::onUpdateBuffer(const rt::AudioData& data)
     auto tmp = std::make_shared<rt::AudioData>(data);
     if (m_params.force_mono)
         tmp->convertToMono();
-    {
-        std::unique_lock<std::mutex> lock(m_data_mutex);
-        m_data_queue.push_back(tmp);
-    }
+    pushAudio(tmp);
 }
 
 } // namespace rtsp
@@ -35,9 +35,6 @@ private:
     rt::TalkParams m_params;
     std::atomic_bool m_playing{false};
 
-    std::mutex m_data_mutex;
-    std::vector<rt::AudioDataPtr> m_data_queue;
-
     rt::CastList m_casts;
     std::vector<CComPtr<ISpObjectToken>> m_voice_tokens;
     CComPtr<ISpVoice> m_voice;
@@ -0,0 +1,76 @@
+#include "pch.h"
+#include "rtsyTalkServer.h"
+
+// standalone server with a synthetic voice. stand-in of host apps for load tests and CI.
+// usage: RemoteTalkSynth [name=value ...]
+//  port: listening port (8180)
+//  speed: 1 is real-time, 0 is as fast as possible (1)
+//  chunk_ms: duration of captured chunks (10)
+//  jitter: random variation of chunk size and interval. 0.0 - 1.0 (0)
+//  chars_per_sec: length of audio per character (8)
+//  frequency, channels: output format (48000, 1)
+//  format: u8, s16, s24, s32, f32 (s16)
+//  seed: seed of noise and jitter (0)
+//  low_latency, frame_ms, max_wait_ms, trace: see rt::TalkServerSettings
+int main(int argc, char *argv[])
+{
+    rtsy::TalkServer server;
+    auto settings = server.getSettings();
+    rtsy::SynthSettings synth;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto sep = arg.find('=');
+        if (sep == std::string::npos)
+            continue;
+        auto name = arg.substr(0, sep);
+        auto value = arg.substr(sep + 1);
+        auto to_i = [&]() { return std::atoi(value.c_str()); };
+        auto to_f = [&]() { return (float)std::atof(value.c_str()); };
+
+        if (name == "port")
+            settings.port = (uint16_t)to_i();
+        else if (name == "low_latency")
+            settings.low_latency = to_i() != 0;
+        else if (name == "frame_ms")
+            settings.frame_ms = to_i();
+        else if (name == "max_wait_ms")
+            settings.max_wait_ms = to_i();
+        else if (name == "trace")
+            settings.trace = to_i() != 0;
+        else if (name == "speed")
+            synth.speed = to_f();
+        else if (name == "chunk_ms")
+            synth.chunk_ms = std::max(to_i(), 1);
+        else if (name == "jitter")
+            synth.jitter = to_f();
+        else if (name == "chars_per_sec")
+            synth.chars_per_sec = std::max(to_f(), 0.1f);
+        else if (name == "frequency")
+            synth.frequency = std::max(to_i(), 8000);
+        else if (name == "channels")
+            synth.channels = std::max(to_i(), 1);
+        else if (name == "seed")
+            synth.seed = (uint32_t)to_i();
+        else if (name == "format") {
+            if (value == "u8") synth.format = rt::AudioFormat::U8;
+            else if (value == "s16") synth.format = rt::AudioFormat::S16;
+            else if (value == "s24") synth.format = rt::AudioFormat::S24;
+            else if (value == "s32") synth.format = rt::AudioFormat::S32;
+            else if (value == "f32") synth.format = rt::AudioFormat::F32;
+        }
+    }
+    server.setSettings(settings);
+    server.getInterface().setSettings(synth);
+
+    if (!server.start()) {
+        printf("failed to start server on port %d\n", (int)settings.port);
+        return 1;
+    }
+    printf("%s: listening on port %d\n", rtsyHostName, (int)settings.port);
+
+    for (;;) {
+        server.processMessages();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "RemoteTalk/RemoteTalk.h"
+#include "RemoteTalk/RemoteTalkNet.h"
+
+#define rtsyHostName    "RemoteTalkSynth"
+#define rtsyDefaultPort 8180
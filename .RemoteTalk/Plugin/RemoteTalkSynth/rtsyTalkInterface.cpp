@@ -0,0 +1,200 @@
+#include "pch.h"
+#include "rtsyTalkInterface.h"
+
+namespace rtsy {
+
+static uint32_t Hash(const std::string& s, uint32_t seed)
+{
+    // FNV-1a. std::hash is not guaranteed to be the same between platforms.
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : s) {
+        h ^= (uint8_t)c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// white noise in [-1, 1] that only depends on the position
+static float WhiteNoise(uint32_t seed, uint64_t pos)
+{
+    uint64_t x = pos * 0x9E3779B97F4A7C15ull + seed;
+    x ^= x >> 33; x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return (float)((double)(x >> 11) / (double)(1ull << 52)) - 1.0f;
+}
+
+
+TalkInterface::TalkInterface()
+{
+    {
+        rt::CastInfo cast{ Tone, "Tone" };
+        cast.params.push_back({ "Volume", 1.0f, 0.0f, 1.0f });
+        cast.params.push_back({ "Pitch", 1.0f, 0.5f, 2.0f });
+        m_casts.push_back(std::move(cast));
+    }
+    {
+        rt::CastInfo cast{ Noise, "Noise" };
+        cast.params.push_back({ "Volume", 1.0f, 0.0f, 1.0f });
+        m_casts.push_back(std::move(cast));
+    }
+}
+
+TalkInterface::~TalkInterface()
+{
+    stop();
+    wait();
+}
+
+void TalkInterface::release() { /*do nothing*/ }
+const char* TalkInterface::getClientName() const { return rtsyHostName; }
+int TalkInterface::getPluginVersion() const { return rtPluginVersion; }
+int TalkInterface::getProtocolVersion() const { return rtProtocolVersion; }
+
+bool TalkInterface::getParams(rt::TalkParams& params) const
+{
+    params = m_params;
+    return true;
+}
+
+bool TalkInterface::setParams(const rt::TalkParams& params)
+{
+    if (params.cast < 0 || params.cast >= (int)m_casts.size())
+        return false;
+    m_params = params;
+    return true;
+}
+
+int TalkInterface::getNumCasts() const
+{
+    return (int)m_casts.size();
+}
+
+const rt::CastInfo* TalkInterface::getCastInfo(int i) const
+{
+    if (i >= 0 && i < (int)m_casts.size())
+        return &m_casts[i];
+    return nullptr;
+}
+
+bool TalkInterface::setText(const char *text)
+{
+    m_text = text;
+    return true;
+}
+
+bool TalkInterface::isReady() const
+{
+    return !m_playing;
+}
+
+bool TalkInterface::isPlaying() const
+{
+    return m_playing;
+}
+
+void TalkInterface::setSettings(const SynthSettings& v)
+{
+    m_settings = v;
+}
+
+const SynthSettings& TalkInterface::getSettings() const
+{
+    return m_settings;
+}
+
+void TalkInterface::wait()
+{
+    if (m_task.valid())
+        m_task.wait();
+}
+
+void TalkInterface::generate(rt::AudioData& dst, size_t pos, size_t num_samples)
+{
+    auto& s = m_settings;
+    auto& text = m_text;
+    float volume = (m_params.isSet(0) ? (float)m_params[0] : 1.0f) * 0.5f;
+    float pitch = m_params.isSet(1) ? (float)m_params[1] : 1.0f;
+    size_t samples_per_char = std::max<size_t>((size_t)(s.frequency / s.chars_per_sec), 1);
+    uint32_t seed = Hash(text, s.seed);
+
+    rt::AudioData tmp;
+    tmp.format = rt::AudioFormat::F32;
+    tmp.frequency = s.frequency;
+    tmp.channels = s.channels;
+    tmp.allocateSample(num_samples * s.channels);
+    auto *samples = tmp.get<float>();
+    for (size_t i = 0; i < num_samples; ++i) {
+        auto spos = pos + i;
+        size_t ci = std::min(spos / samples_per_char, text.size() - 1);
+        // a "syllable" per character: fade in and out
+        float t = float(spos % samples_per_char) / float(samples_per_char);
+        float envelope = std::sin(t * rt::PI);
+
+        float v;
+        if (m_params.cast == Noise) {
+            v = WhiteNoise(seed, spos);
+        }
+        else {
+            float freq = (150.0f + float((uint8_t)text[ci] % 64) * 5.0f) * pitch;
+            v = std::sin(2.0f * rt::PI * freq * float(double(spos) / s.frequency));
+        }
+        v *= volume * envelope;
+        for (int c = 0; c < s.channels; ++c)
+            *samples++ = v;
+    }
+
+    tmp.convertFormat(dst, s.format);
+}
+
+bool TalkInterface::play()
+{
+    if (m_playing || m_text.empty())
+        return false;
+    wait();
+
+    m_playing = true;
+    m_stop = false;
+    m_task = std::async(std::launch::async, [this]() {
+        using clock_t = std::chrono::steady_clock;
+        auto& s = m_settings;
+        size_t total = (size_t)(s.frequency * (m_text.size() / s.chars_per_sec));
+        size_t chunk = std::max<size_t>((size_t)s.frequency * s.chunk_ms / 1000, 1);
+        float jitter = std::min(std::max(s.jitter, 0.0f), 1.0f);
+        // separate generators so that chunking doesn't depend on speed
+        std::mt19937 rng_size(Hash(m_text, s.seed)), rng_time(rng_size());
+        std::uniform_real_distribution<float> dist(-jitter, jitter);
+
+        auto time_begin = clock_t::now();
+        rt::AudioData data;
+        for (size_t pos = 0; pos < total && !m_stop; ) {
+            auto n = std::min((size_t)(chunk * (1.0f + dist(rng_size))), total - pos);
+            n = std::max<size_t>(n, 1);
+            generate(data, pos, n);
+            pos += n;
+
+            if (s.speed > 0.0f) {
+                // schedule is based on the position so that jitter doesn't accumulate
+                double t = double(pos) / s.frequency / s.speed;
+                t += double(chunk) / s.frequency / s.speed * dist(rng_time);
+                std::this_thread::sleep_until(time_begin + std::chrono::duration_cast<clock_t::duration>(std::chrono::duration<double>(t)));
+            }
+            if (onUpdate)
+                onUpdate(data);
+        }
+        if (onUpdate)
+            onUpdate(rt::AudioData());
+        m_playing = false;
+    });
+    return true;
+}
+
+bool TalkInterface::stop()
+{
+    if (!m_playing)
+        return false;
+    m_stop = true;
+    return true;
+}
+
+} // namespace rtsy
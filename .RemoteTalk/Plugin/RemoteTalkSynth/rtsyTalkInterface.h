@@ -0,0 +1,70 @@
+#pragma once
+#include "rtsyCommon.h"
+
+namespace rtsy {
+
+struct SynthSettings
+{
+    int frequency = 48000;
+    int channels = 1;
+    rt::AudioFormat format = rt::AudioFormat::S16;
+    // length of the audio is text length / chars_per_sec
+    float chars_per_sec = 8.0f;
+    // 1: real-time, 2: twice as fast as real-time, 0: as fast as possible
+    float speed = 1.0f;
+    // audio is delivered in chunks of this duration, like hooks of real hosts do
+    int chunk_ms = 10;
+    // random variation of chunk duration and delivery interval. 0.0 - 1.0
+    float jitter = 0.0f;
+    uint32_t seed = 0;
+};
+
+// stand-in of a speech synthesizer. generates a tone per character (or noise) instead of speech.
+// output only depends on the text, params and settings so that results are reproducible.
+class TalkInterface : public rt::TalkInterface
+{
+public:
+    enum Cast
+    {
+        Tone,
+        Noise,
+    };
+
+    TalkInterface();
+    ~TalkInterface() override;
+    void release() override;
+    const char* getClientName() const override;
+    int getPluginVersion() const override;
+    int getProtocolVersion() const override;
+
+    bool getParams(rt::TalkParams& params) const override;
+    bool setParams(const rt::TalkParams& params) override;
+    int getNumCasts() const override;
+    const rt::CastInfo* getCastInfo(int i) const override;
+    bool setText(const char *text) override;
+
+    bool isReady() const override;
+    bool isPlaying() const override;
+    bool play() override;
+    bool stop() override;
+
+    void setSettings(const SynthSettings& v);
+    const SynthSettings& getSettings() const;
+    void wait();
+
+    // called on the synthesis thread. empty data is the end of a talk.
+    std::function<void(const rt::AudioData&)> onUpdate;
+
+private:
+    void generate(rt::AudioData& dst, size_t pos, size_t num_samples);
+
+    SynthSettings m_settings;
+    rt::CastList m_casts;
+    rt::TalkParams m_params;
+    std::string m_text;
+    std::atomic_bool m_playing{ false };
+    std::atomic_bool m_stop{ false };
+    std::future<void> m_task;
+};
+
+} // namespace rtsy
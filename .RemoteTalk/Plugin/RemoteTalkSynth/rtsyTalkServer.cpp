@@ -0,0 +1,72 @@
+#include "pch.h"
+#include "rtsyTalkServer.h"
+
+namespace rtsy {
+
+TalkServer::TalkServer()
+{
+    m_settings.port = rtsyDefaultPort;
+    m_talk.onUpdate = [this](const rt::AudioData& data) {
+        pushAudio(std::make_shared<rt::AudioData>(data));
+    };
+}
+
+TalkServer::~TalkServer()
+{
+    stop();
+    m_talk.stop();
+    m_talk.wait();
+}
+
+bool TalkServer::isReady()
+{
+    return true;
+}
+
+TalkServer::Status TalkServer::onStats(StatsMessage& mes)
+{
+    auto& stats = mes.stats;
+    m_talk.getParams(stats.params);
+    for (int i = 0; i < m_talk.getNumCasts(); ++i)
+        stats.casts.push_back(*m_talk.getCastInfo(i));
+    stats.host = m_talk.getClientName();
+    stats.plugin_version = m_talk.getPluginVersion();
+    stats.protocol_version = m_talk.getProtocolVersion();
+    return Status::Succeeded;
+}
+
+TalkServer::Status TalkServer::onTalk(TalkMessage& mes)
+{
+    // one talk at a time. fail if busy like real hosts, so that the queue doesn't stall behind this talk
+    // and an untargeted stop can still interrupt it.
+    // the previous talk is done when its terminator has been taken by streamAudio().
+    if (m_talk.isPlaying())
+        return Status::Failed;
+    {
+        lock_t lock(m_data_mutex);
+        if (!m_data_queue.empty())
+            return Status::Failed;
+    }
+
+    if (!m_talk.setParams(mes.params) || !m_talk.setText(mes.text.c_str()))
+        return Status::Failed;
+
+    clearAudioQueue();
+    if (!m_talk.play())
+        return Status::Failed;
+
+    streamAudio(mes);
+    return Status::Succeeded;
+}
+
+TalkServer::Status TalkServer::onStop(StopMessage& /*mes*/)
+{
+    return m_talk.stop() ? Status::Succeeded : Status::Failed;
+}
+
+TalkInterface& TalkServer::getInterface()
+{
+    return m_talk;
+}
+
+} // namespace rtsy
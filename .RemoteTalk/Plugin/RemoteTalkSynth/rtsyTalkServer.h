@@ -0,0 +1,24 @@
+#pragma once
+#include "rtsyTalkInterface.h"
+
+namespace rtsy {
+
+class TalkServer : public rt::TalkServer
+{
+using super = rt::TalkServer;
+public:
+    TalkServer();
+    ~TalkServer();
+
+    bool isReady() override;
+    Status onStats(StatsMessage& mes) override;
+    Status onTalk(TalkMessage& mes) override;
+    Status onStop(StopMessage& mes) override;
+
+    TalkInterface& getInterface();
+
+private:
+    TalkInterface m_talk;
+};
+
+} // namespace rtsy
@@ -38,7 +38,7 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
                     rtvr2::TalkServer::getInstance().onStop();
                     rtGetTalkInterface_()->onStop();
                 };
-                dsound.onUpdate = [](const rt::AudioData& ad) {
+                dsound.onUpdate = [](const rt::AudioDataPtr& ad) {
                     rtvr2::TalkServer::getInstance().onUpdateSample(ad);
                 };
             }
@@ -14,7 +14,7 @@ void DSoundHandler::clearCallbacks()
 
 void DSoundHandler::update(IDirectSoundBuffer *_this, bool apply_margin)
 {
-    if (m_buffer.empty()) {
+    if (m_buffer.capacity() == 0) {
         WAVEFORMATEX wf;
         DWORD written;
         _this->GetFormat(&wf, sizeof(wf), &written);
@@ -24,7 +24,6 @@ void DSoundHandler::update(IDirectSoundBuffer *_this, bool apply_margin)
         _this->GetCaps(&caps);
 
         m_buffer.resize(caps.dwBufferBytes);
-        m_data.data.resize(caps.dwBufferBytes);
         m_data.frequency = wf.nSamplesPerSec;
         m_data.channels = wf.nChannels;
         switch (wf.wBitsPerSample) {
@@ -38,22 +37,24 @@ void DSoundHandler::update(IDirectSoundBuffer *_this, bool apply_margin)
     DWORD pcur, wcur;
     _this->GetCurrentPosition(&pcur, &wcur);
     if (apply_margin) {
-        pcur = (pcur + margin) % m_buffer.size();
+        pcur = (pcur + margin) % m_buffer.capacity();
     }
 
     if (pcur == m_position)
         return;
 
-    if (pcur > m_position) {
-        m_data.data.assign(&m_buffer[m_position], &m_buffer[pcur]);
-    }
-    else {
-        m_data.data.assign(&m_buffer[m_position], m_buffer.end());
-        m_data.data.insert(m_data.data.end(), m_buffer.begin(), &m_buffer[pcur]);
-    }
+    // the range wraps around if the cursor has passed the end of the buffer. copy both parts at once.
+    // the chunk is recycled once the server has sent it. no allocation on the host's audio thread in most cases.
+    auto range = m_buffer.view(m_position, (pcur + m_buffer.capacity() - m_position) % m_buffer.capacity());
+    auto chunk = m_chunks.get();
+    chunk->format = m_data.format;
+    chunk->frequency = m_data.frequency;
+    chunk->channels = m_data.channels;
+    chunk->data.resize_discard(range.size());
+    range.copy_to(chunk->data.data());
     m_position = pcur;
     if (m_playing && onUpdate)
-        onUpdate(m_data);
+        onUpdate(chunk);
 }
 
 void DSoundHandler::onIDirectSoundBuffer_Lock(IDirectSoundBuffer *&_this, DWORD& dwWriteCursor, DWORD& dwWriteBytes, LPVOID *&ppvAudioPtr1, LPDWORD& pdwAudioBytes1, LPVOID *&ppvAudioPtr2, LPDWORD& pdwAudioBytes2, DWORD& dwFlags, HRESULT& ret)
@@ -69,9 +70,9 @@ void DSoundHandler::onIDirectSoundBuffer_Lock(IDirectSoundBuffer *&_this, DWORD&
 
     m_offset = dwWriteCursor;
     if (ppvAudioPtr1)
-        *ppvAudioPtr1 = &m_buffer[m_offset];
+        *ppvAudioPtr1 = m_buffer.data() + m_offset;
     if (ppvAudioPtr2)
-        *ppvAudioPtr2 = &m_buffer[0];
+        *ppvAudioPtr2 = m_buffer.data();
 }
 
 void DSoundHandler::onIDirectSoundBuffer_Unlock(IDirectSoundBuffer *&_this, LPVOID& pvAudioPtr1, DWORD& dwAudioBytes1, LPVOID& pvAudioPtr2, DWORD& dwAudioBytes2, HRESULT& ret)
@@ -84,9 +85,9 @@ void DSoundHandler::onIDirectSoundBuffer_Unlock(IDirectSoundBuffer *&_this, LPVO
     }
     else {
         if (m_lbuf1)
-            memcpy(m_lbuf1, &m_buffer[m_offset], m_lsize1);
+            memcpy(m_lbuf1, m_buffer.data() + m_offset, m_lsize1);
         if (m_lbuf2)
-            memcpy(m_lbuf2, &m_buffer[0], m_lsize2);
+            memcpy(m_lbuf2, m_buffer.data(), m_lsize2);
     }
 
     pvAudioPtr1 = m_lbuf1;
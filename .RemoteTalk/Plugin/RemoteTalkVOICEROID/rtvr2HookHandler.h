@@ -12,7 +12,7 @@ public:
     bool mute = false;
     int margin = 88200 / 10; // 1/10 sec
     std::function<void()> onPlay, onStop;
-    std::function<void(const rt::AudioData&)> onUpdate;
+    std::function<void(const rt::AudioDataPtr&)> onUpdate;
 
     void clearCallbacks();
     void update(IDirectSoundBuffer *_this, bool apply_margin = false);
@@ -25,8 +25,9 @@ protected:
     void onIDirectSoundBuffer_Unlock(IDirectSoundBuffer *&_this, LPVOID& pvAudioPtr1, DWORD& dwAudioBytes1, LPVOID& pvAudioPtr2, DWORD& dwAudioBytes2, HRESULT& ret) override;
 
 private:
-    rt::RawVector<char> m_buffer;
-    rt::AudioData m_data;
+    rt::RingBuffer<char> m_buffer;
+    rt::AudioData m_data; // format of the buffer. samples are sent in chunks of m_chunks
+    rt::AudioDataPool m_chunks;
 
     void *m_lbuf1, *m_lbuf2;
     uint32_t m_lsize1, m_lsize2;
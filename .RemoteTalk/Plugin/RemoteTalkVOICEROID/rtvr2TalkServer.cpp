@@ -68,39 +68,24 @@ TalkServer::Status TalkServer::onTalk(TalkMessage& mes)
     if (!ifs->isMainWindowVisible() || ifs->isPlaying())
         return Status::Failed;
 
-    if (!ifs->setCast(mes.params.cast) || !ifs->prepareUI())
-        return Status::Pending;
+    {
+        rt::TraceSpan span("host.prepareUI", mes.request_id);
+        if (!ifs->setCast(mes.params.cast) || !ifs->prepareUI())
+            return Status::Pending;
+    }
 
     ifs->setParams(mes.params);
     ifs->setText(mes.text.c_str());
 
     DSoundHandler::getInstance().mute = mes.params.mute;
+    clearAudioQueue();
     {
-        std::unique_lock<std::mutex> lock(m_data_mutex);
-        m_data_queue.clear();
+        rt::TraceSpan span("host.play", mes.request_id);
+        if (!ifs->play())
+            return Status::Failed;
     }
-    if (!ifs->play())
-        return Status::Failed;
 
-    mes.task = std::async(std::launch::async, [this, &mes]() {
-        std::vector<rt::AudioDataPtr> tmp;
-        for (;;) {
-            {
-                std::unique_lock<std::mutex> lock(m_data_mutex);
-                tmp = m_data_queue;
-                m_data_queue.clear();
-            }
-
-            for (auto& ad : tmp) {
-                ad->serialize(*mes.respond_stream);
-            }
-
-            if (!tmp.empty() && tmp.back()->data.empty())
-                break;
-            else
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        }
-        });
+    streamAudio(mes);
     return Status::Succeeded;
 }
 
@@ -122,16 +107,12 @@ TalkServer::Status TalkServer::onDebug(DebugMessage& mes)
 #endif
 
 
-void TalkServer::onUpdateSample(const rt::AudioData& data)
+void TalkServer::onUpdateSample(const rt::AudioDataPtr& data)
 {
     if (!rtGetTalkInterface_()->isPlaying())
         return;
 
-    auto tmp = std::make_shared<rt::AudioData>(data);
-    {
-        std::unique_lock<std::mutex> lock(m_data_mutex);
-        m_data_queue.push_back(tmp);
-    }
+    pushAudio(data);
 }
 
 void TalkServer::onStop()
@@ -139,11 +120,7 @@ void TalkServer::onStop()
     if (!rtGetTalkInterface_()->isPlaying())
         return;
 
-    auto terminator = std::make_shared<rt::AudioData>();
-    {
-        std::unique_lock<std::mutex> lock(m_data_mutex);
-        m_data_queue.push_back(terminator);
-    }
+    pushAudio(std::make_shared<rt::AudioData>());
 }
 
 } // namespace rtvr2
@@ -20,15 +20,12 @@ public:
     Status onDebug(DebugMessage& mes) override;
 #endif
 
-    void onUpdateSample(const rt::AudioData& data);
+    void onUpdateSample(const rt::AudioDataPtr& data);
     void onStop();
 
 private:
     int m_num_casts = 0;
     int m_current_cast = 0;
-
-    std::mutex m_data_mutex;
-    std::vector<rt::AudioDataPtr> m_data_queue;
 };
 
 } // namespace rtvr2
@@ -57,7 +57,7 @@ static bool SetTabIndex(HWND hwnd, int idx)
 }
 
 
-void TalkInterface::setAudioCallback(const std::function<void(const rt::AudioData&)>& callback)
+void TalkInterface::setAudioCallback(const std::function<void(const rt::AudioDataPtr&)>& callback)
 {
     m_callback = callback;
 }
@@ -268,12 +268,11 @@ void TalkInterface::onSoundStop()
 
     m_is_playing = false;
     if (m_callback) {
-        rt::AudioData terminator;
-        m_callback(terminator);
+        m_callback(std::make_shared<rt::AudioData>());
     }
 }
 
-void TalkInterface::onUpdateSample(const rt::AudioData& data)
+void TalkInterface::onUpdateSample(const rt::AudioDataPtr& data)
 {
     if (!m_is_playing)
         return;
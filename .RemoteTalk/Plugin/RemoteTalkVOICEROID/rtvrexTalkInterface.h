@@ -27,14 +27,14 @@ public:
 
 public:
     // impl
-    void setAudioCallback(const std::function<void(const rt::AudioData&)>& callback);
+    void setAudioCallback(const std::function<void(const rt::AudioDataPtr&)>& callback);
 
     bool isMainWindowVisible();
     bool prepareUI();
     void setupControls();
     void onSoundPlay();
     void onSoundStop();
-    void onUpdateSample(const rt::AudioData& data);
+    void onUpdateSample(const rt::AudioDataPtr& data);
 
 private:
     std::wstring m_whost;
@@ -53,7 +53,7 @@ private:
     rt::CastInfo m_cast;
     std::atomic_bool m_is_playing{ false };
 
-    std::function<void(const rt::AudioData&)> m_callback;
+    std::function<void(const rt::AudioDataPtr&)> m_callback;
 };
 
 } // namespace rtvrex
@@ -48,19 +48,15 @@ TalkServer::Status TalkServer::onTalk(TalkMessage& mes)
     auto& ifs = TalkInterface::getInstance();
     if (!ifs.isMainWindowVisible() || ifs.isPlaying())
         return Status::Failed;
-    if (!ifs.prepareUI())
-        return Status::Pending;
-
     {
-        std::unique_lock<std::mutex> lock(m_data_mutex);
-        m_data_queue.clear();
+        rt::TraceSpan span("host.prepareUI", mes.request_id);
+        if (!ifs.prepareUI())
+            return Status::Pending;
     }
-    ifs.setAudioCallback([this](const rt::AudioData& data) {
-        auto tmp = std::make_shared<rt::AudioData>(data);
-        {
-            std::unique_lock<std::mutex> lock(m_data_mutex);
-            m_data_queue.push_back(tmp);
-        }
+
+    clearAudioQueue();
+    ifs.setAudioCallback([this](const rt::AudioDataPtr& data) {
+        pushAudio(data);
     });
 
     DSoundHandler::getInstance().mute = mes.params.mute;
@@ -68,28 +64,13 @@ TalkServer::Status TalkServer::onTalk(TalkMessage& mes)
     ifs.setParams(mes.params);
     if (!ifs.setText(mes.text.c_str()))
         return Status::Failed;
-    if (!ifs.play())
-        return Status::Failed;
+    {
+        rt::TraceSpan span("host.play", mes.request_id);
+        if (!ifs.play())
+            return Status::Failed;
+    }
 
-    mes.task = std::async(std::launch::async, [this, &mes]() {
-        std::vector<rt::AudioDataPtr> tmp;
-        for (;;) {
-            {
-                std::unique_lock<std::mutex> lock(m_data_mutex);
-                tmp = m_data_queue;
-                m_data_queue.clear();
-            }
-
-            for (auto& ad : tmp) {
-                ad->serialize(*mes.respond_stream);
-            }
-
-            if (!tmp.empty() && tmp.back()->data.empty())
-                break;
-            else
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        }
-    });
+    streamAudio(mes);
     return Status::Succeeded;
 }
 
@@ -19,10 +19,6 @@ public:
 #ifdef rtDebug
     Status onDebug(DebugMessage& mes) override;
 #endif
-
-private:
-    std::mutex m_data_mutex;
-    std::vector<rt::AudioDataPtr> m_data_queue;
 };
 
 } // namespace rtvrex
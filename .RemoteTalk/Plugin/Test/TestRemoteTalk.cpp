@@ -27,14 +27,1112 @@ TestCase(RemoteTalkClient)
     std::string text = "hello voiceroid! this is a test of remote talk client.";
 
     rt::AudioData sequence;
+    nanosec begin = Now(), first = 0;
     client.play(params, text, [&](const rt::AudioData& ad) {
         if (ad.data.empty())
             return;
+        if (first == 0)
+            first = Now();
         sequence += ad;
     });
     if (!sequence.data.empty()) {
         rt::ExportWave(sequence, "hello_voiceroid.wav");
     }
+
+    // time-to-first-byte. server's value excludes connection and request parsing.
+    if (first != 0 && client.stats(stats))
+        Print("    ttfb: %.2fms (server: %.2fms)\n", NS2MS(first - begin), stats.ttfb);
+}
+
+// compare time-to-first-audio and stop latency of HTTP requests and "/channel".
+// stop latency is the time between issuing stop and receiving the end of stream.
+TestCase(RemoteTalkChannel)
+{
+    auto settings = GetClientSettings();
+    rt::TalkClient client(settings);
+    rt::TalkServerStats stats;
+    if (!client.stats(stats))
+        return;
+
+    rt::TalkChannel channel(settings);
+    if (!channel.connect())
+        return;
+
+    rt::TalkParams params = stats.params;
+    std::string text = "hello voiceroid! this is a test of remote talk channel. this sentence is long enough to be interrupted.";
+    const int num_try = 5;
+
+    auto measure = [&](const char *name, const auto& play, const auto& stop) {
+        float ttfa = 0.0f, stop_latency = 0.0f;
+        for (int i = 0; i < num_try; ++i) {
+            std::atomic<nanosec> first{ 0 }, end{ 0 };
+            auto begin = Now();
+            auto task = std::async(std::launch::async, [&]() {
+                play(params, text, [&](const rt::AudioData& ad) {
+                    if (ad.data.empty())
+                        end = Now();
+                    else if (first == 0)
+                        first = Now();
+                });
+            });
+            while (first == 0 && end == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+            auto stop_begin = Now();
+            stop();
+            task.wait();
+            if (first != 0)
+                ttfa += NS2MS(first - begin);
+            stop_latency += NS2MS(end - stop_begin);
+        }
+        Print("    %s: ttfa %.2fms, stop %.2fms\n", name, ttfa / num_try, stop_latency / num_try);
+    };
+
+    using Callback = std::function<void(const rt::AudioData&)>;
+    measure("HTTP",
+        [&](const rt::TalkParams& p, const std::string& t, const Callback& cb) { client.play(p, t, cb); },
+        [&]() { client.stop(); });
+    measure("channel",
+        [&](const rt::TalkParams& p, const std::string& t, const Callback& cb) { channel.play(p, t, cb); },
+        [&]() { channel.stop(); });
+}
+
+#ifdef rtEnableCoroutine
+// dozens of talks in flight, all driven by the calling thread.
+static rt::Task<> AsyncTalk(rt::AsyncTalkClient& client, rt::TalkParams params, std::string text, int& frames, int& succeeded)
+{
+    auto stream = client.play(params, text);
+    while (auto ad = co_await stream.next()) {
+        Expect(!ad->data.empty());
+        ++frames;
+    }
+    if (stream.succeeded())
+        ++succeeded;
+}
+
+static rt::Task<> AsyncTalks(rt::AsyncTalkClient& client, int num, int& frames, int& succeeded)
+{
+    auto stats = co_await client.stats();
+    if (!stats)
+        co_return;
+
+    rt::EventLoop& loop = client.getLoop();
+    for (int i = 0; i < num; ++i)
+        rt::Spawn(loop, AsyncTalk(client, stats->params, "talk " + std::to_string(i), frames, succeeded));
+}
+
+TestCase(AsyncTalkClient)
+{
+    rt::EventLoop loop;
+    rt::AsyncTalkClient client(loop, GetClientSettings());
+    if (!client.connect())
+        return;
+
+    const int num = 32;
+    int frames = 0, succeeded = 0;
+    auto begin = Now();
+    rt::Spawn(loop, AsyncTalks(client, num, frames, succeeded));
+    loop.run();
+    Print("    %d talks: %d succeeded, %d frames, %.2fms\n", num, succeeded, frames, NS2MS(Now() - begin));
+}
+#endif
+
+TestCase(rtSharedRing)
+{
+    // small ring so that records wrap around and the writer has to wait for the reader
+    const size_t RingSize = 4096;
+    rt::SharedRing server, client;
+    if (!server.create("RemoteTalk_Test", RingSize))
+        return;
+    Expect(client.open("RemoteTalk_Test", RingSize));
+
+    const int NumBlocks = 64;
+    std::atomic_int doorbell{ 0 };
+    auto writer = std::async(std::launch::async, [&]() {
+        rt::SharedRingWriter buf(server, [&]() { ++doorbell; }, 1000);
+        std::ostream os(&buf);
+        for (int i = 0; i < NumBlocks; ++i) {
+            rt::AudioData ad;
+            ad.format = rt::AudioFormat::S16;
+            ad.frequency = 48000;
+            ad.channels = 1;
+            auto *samples = (short*)ad.allocateSample(480 + i);
+            for (int si = 0; si < 480 + i; ++si)
+                samples[si] = (short)(i + si);
+            ad.serialize(os);
+            os.flush();
+        }
+        rt::AudioData().serialize(os);
+        os.flush();
+    });
+
+    rt::SharedRingReader buf(client, 1000);
+    std::istream is(&buf);
+    int num_blocks = 0;
+    bool ok = true;
+    for (;;) {
+        rt::AudioData ad;
+        ad.deserialize(is);
+        if (!is || ad.data.empty())
+            break;
+        auto *samples = (short*)ad.data.data();
+        ok = ok && ad.getSampleLength() == 480 + num_blocks && samples[ad.getSampleLength() - 1] == (short)(num_blocks + 479 + num_blocks);
+        ++num_blocks;
+    }
+    buf.available();
+    writer.wait();
+
+    Expect(ok);
+    Expect(num_blocks == NumBlocks);
+    Expect(doorbell > 0);
+    Expect(server.waitConsumed(0));
+
+    // cancelling ends the wait for data without waiting for the timeout
+    rt::CancelToken cancel;
+    rt::SharedRingReader idle(client, 60000, [&cancel]() { return cancel.isCancelled(); });
+    auto canceller = std::async(std::launch::async, [&cancel]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        cancel.cancel();
+    });
+    auto begin = std::chrono::steady_clock::now();
+    Expect(idle.sgetc() == std::char_traits<char>::eof());
+    Expect(std::chrono::steady_clock::now() - begin < std::chrono::seconds(5));
+}
+
+TestCase(TalkCache)
+{
+    auto make_audio = [](int samples, int seed) {
+        rt::AudioData ad;
+        ad.format = rt::AudioFormat::S16;
+        ad.frequency = 48000;
+        ad.channels = 1;
+        auto *p = (int16_t*)ad.allocateSample(samples);
+        for (int i = 0; i < samples; ++i)
+            p[i] = (int16_t)(i * seed);
+        return ad;
+    };
+
+    rt::TalkParams params;
+    params[0] = 1.2f;
+    auto key1 = rt::TalkCache::Fingerprint("host", "cast", params, "hello");
+    params.mute = true; // mute doesn't change the audio
+    Expect(rt::TalkCache::Fingerprint("host", "cast", params, "hello") == key1);
+    Expect(rt::TalkCache::Fingerprint("host", "cast", params, "hello!") != key1);
+    Expect(rt::TalkCache::Fingerprint("other host", "cast", params, "hello") != key1);
+    uint64_t key2 = key1 + 1, key3 = key1 + 2, key4 = key1 + 3;
+
+    const std::string dir = "talk_cache_test";
+    const uint64_t budget = 1024 * 1024;
+    {
+        rt::TalkCache cache;
+        Expect(cache.open(dir, budget, 16));
+        cache.clear();
+
+        // 3 x 300KB fit in the budget
+        auto a1 = make_audio(150000, 1);
+        Expect(cache.write(key1, a1));
+        Expect(cache.write(key2, make_audio(150000, 2)));
+        Expect(cache.write(key3, make_audio(150000, 3)));
+        Expect(cache.getEntryCount() == 3);
+
+        auto blob = cache.read(key1);
+        Expect(blob && blob->getSize() == a1.data.size());
+        if (blob) {
+            rt::AudioData dst;
+            blob->toAudioData(dst);
+            Expect(dst.data == a1.data && dst.frequency == 48000 && dst.format == rt::AudioFormat::S16);
+            // served from the mapping. dst keeps the blob alive and copies on write.
+            Expect(dst.data.cdata() == blob->getData() && dst.data.shared());
+            std::weak_ptr<rt::TalkCache::Blob> weak = blob;
+            blob.reset();
+            Expect(!weak.expired());
+            dst.get<int16_t>()[0] = 123;
+            Expect(weak.expired() && !dst.data.shared() && dst.data != a1.data);
+        }
+
+        // key1 was used recently. key2 is the least recently used and goes out.
+        Expect(cache.write(key4, make_audio(150000, 4)));
+        Expect(cache.contains(key1) && !cache.contains(key2) && cache.contains(key3) && cache.contains(key4));
+        Expect(cache.getUsage() <= budget);
+        Expect(!cache.write(key2, make_audio((int)budget, 2))); // larger than the budget
+    }
+    {
+        // the index survives reopening
+        rt::TalkCache cache;
+        Expect(cache.open(dir, budget, 16));
+        Expect(cache.getEntryCount() == 3);
+        Expect(cache.read(key1) && !cache.read(key2));
+
+        // more entries than the table can hold. every remaining one must still be found.
+        cache.clear();
+        for (uint64_t k = 1; k <= 40; ++k)
+            Expect(cache.write(k * 16, make_audio(100, (int)k))); // same home slot
+        Expect(cache.getEntryCount() == 12);
+        int found = 0;
+        for (uint64_t k = 1; k <= 40; ++k) {
+            if (auto b = cache.read(k * 16)) {
+                Expect(((const int16_t*)b->getData())[1] == (int16_t)k);
+                ++found;
+            }
+        }
+        Expect(found == 12);
+        cache.clear();
+        Expect(cache.getEntryCount() == 0 && cache.getUsage() == 0);
+    }
+    Expect(rt::TalkCache::RemoveAll(dir));
+}
+
+TestCase(PlaybackBuffer)
+{
+    rt::PlaybackBuffer buf;
+    std::vector<float> dst(960);
+    auto read = [&](double pos) {
+        std::fill(dst.begin(), dst.end(), 1.0f);
+        return buf.read(dst.data(), 48000, 2, (int)dst.size(), pos);
+    };
+
+    // nothing published yet
+    Expect(read(0.0) == 0.0);
+    Expect(buf.getUnderrunCount() == 1);
+
+    // the consumer follows the producer concurrently. every sample must arrive in order.
+    const int NumChunks = 200, ChunkSize = 441;
+    auto producer = std::async(std::launch::async, [&]() {
+        for (int i = 0; i < NumChunks; ++i) {
+            rt::AudioData chunk;
+            chunk.format = rt::AudioFormat::F32;
+            chunk.frequency = 48000;
+            chunk.channels = 1;
+            auto *samples = (float*)chunk.allocateSample(ChunkSize);
+            for (int si = 0; si < ChunkSize; ++si)
+                samples[si] = (float)((i * ChunkSize + si) % 1000) / 1000.0f;
+            buf.push(chunk);
+        }
+        buf.finish();
+    });
+
+    double pos = 0.0;
+    bool ok = true;
+    for (;;) {
+        bool finished = buf.isFinished();
+        double prev = pos;
+        pos = read(pos);
+        for (int i = 0; i < (int)(pos - prev); ++i) {
+            float expected = (float)(((int)prev + i) % 1000) / 1000.0f;
+            ok = ok && dst[i * 2] == expected && dst[i * 2 + 1] == expected;
+        }
+        if (finished && (int)pos == buf.getFrameLength())
+            break;
+    }
+    producer.wait();
+    Expect(ok);
+    Expect((int)pos == NumChunks * ChunkSize);
+
+    // format must not change in a stream. reset() begins a new one.
+    rt::AudioData stereo;
+    stereo.format = rt::AudioFormat::S16;
+    stereo.frequency = 48000;
+    stereo.channels = 2;
+    stereo.allocateSample(100);
+    Expect(!buf.push(stereo));
+    buf.reset();
+    Expect(buf.push(stereo) && buf.getFrameLength() == 50);
+    Print("    underruns: %d\n", buf.getUnderrunCount());
+}
+
+TestCase(SinkGraph)
+{
+    const int NumChunks = 50;
+    std::vector<rt::AudioDataPtr> chunks;
+    rt::AudioData whole;
+    for (int i = 0; i < NumChunks; ++i) {
+        auto chunk = std::make_shared<rt::AudioData>();
+        chunk->format = rt::AudioFormat::S16;
+        chunk->frequency = 48000;
+        chunk->channels = 1;
+        auto *samples = (int16_t*)chunk->allocateSample(480);
+        for (int si = 0; si < 480; ++si)
+            samples[si] = (int16_t)(i * 480 + si);
+        chunks.push_back(chunk);
+        whole += *chunk;
+    }
+
+    rt::ThreadPool pool(4);
+    rt::PlaybackBuffer playback;
+    std::vector<const rt::AudioData*> fast, slow;
+    std::ostringstream streamed;
+    rt::WaveWriter writer(streamed);
+    bool finished_ok = false;
+    // the slow sink doesn't go on until the fast one has finished. it would time out if it held the fast one back.
+    std::promise<void> fast_finished;
+    auto fast_done = fast_finished.get_future().share();
+    bool slow_waited = false;
+    {
+        rt::SinkGraph graph(pool);
+        graph.add(std::make_shared<rt::PlaybackSink>(playback));
+        graph.add(std::make_shared<rt::CallbackSink>(
+            [&](const rt::AudioData& ad) { fast.push_back(&ad); },
+            [&](bool ok) { finished_ok = ok; fast_finished.set_value(); return true; }));
+        graph.add(std::make_shared<rt::CallbackSink>(
+            [&](const rt::AudioData& ad) {
+                if (slow.empty())
+                    slow_waited = fast_done.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+                slow.push_back(&ad);
+                writer.write(ad);
+            },
+            [&](bool) { return writer.close(); }));
+
+        for (auto& c : chunks)
+            graph.push(c);
+        // playback is written by push() itself
+        Expect(playback.getFrameLength() == NumChunks * 480);
+        graph.finish(true);
+        Expect(playback.isFinished());
+        Expect(graph.wait());
+    }
+    // every sink gets the same chunks in order. they are shared, not copied.
+    Expect(fast.size() == NumChunks && fast == slow);
+    Expect(fast.front() == chunks.front().get());
+    Expect(finished_ok);
+    Expect(slow_waited);
+
+    // chunked wave is identical to the whole one
+    std::ostringstream exported;
+    Expect(rt::ExportWave(whole, exported));
+    Expect(streamed.str() == exported.str());
+
+    // a failed sink is reported by wait()
+    {
+        rt::SinkGraph graph(pool);
+        graph.add(std::make_shared<rt::CallbackSink>(nullptr, [](bool) { return false; }));
+        graph.push(chunks.front());
+        graph.finish(true);
+        Expect(!graph.wait());
+    }
+}
+
+TestCase(ThreadPool)
+{
+    using JobType = rt::ThreadPool::JobType;
+    rt::ThreadPool pool(2);
+
+    // long jobs leave one worker for short jobs
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::atomic_int running_long{ 0 };
+    auto long_job = [&]() { ++running_long; released.wait(); return 1; };
+    auto l1 = pool.submit(JobType::Long, long_job);
+    auto l2 = pool.submit(JobType::Long, long_job);
+    while (running_long == 0)
+        std::this_thread::yield();
+
+    std::atomic_int done{ 0 };
+    auto s1 = pool.submit(JobType::Short, []() { return 2; }, [&]() { ++done; });
+    Expect(s1.wait_for(std::chrono::seconds(5)) == std::future_status::ready && s1.get() == 2);
+    Expect(running_long == 1);
+
+    release.set_value();
+    Expect(l1.get() == 1 && l2.get() == 1);
+    // done is called after the future becomes ready
+    for (int i = 0; i < 1000 && done == 0; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    Expect(done == 1);
+
+    // many jobs on few threads
+    pool.setThreadCount(4);
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 100; ++i)
+        results.push_back(pool.submit(i % 2 ? JobType::Long : JobType::Short, [i]() { return i; }));
+    int sum = 0;
+    for (auto& r : results)
+        sum += r.get();
+    Expect(sum == 4950);
+    pool.setThreadCount(1);
+    Expect(pool.getThreadCount() == 2);
+
+    // shrink and grow repeatedly. workers that exited are joined when resizing, not kept until the end
+    for (int i = 0; i < 20; ++i) {
+        pool.setThreadCount(8);
+        Expect(pool.submit(JobType::Short, [i]() { return i; }).get() == i);
+        pool.setThreadCount(2);
+        Expect(pool.submit(JobType::Long, [i]() { return i; }).get() == i);
+    }
+}
+
+TestCase(rtAudioCoalescer)
+{
+    // 48kHz S16 mono. 20ms frame = 960 samples.
+    rt::AudioCoalescer coalescer(20, 1000);
+    rt::AudioData src, dst;
+    src.format = dst.format = rt::AudioFormat::S16;
+    src.frequency = dst.frequency = 48000;
+    src.channels = dst.channels = 1;
+
+    int num_chunks = 0;
+    for (int i = 0; i < 200; ++i) {
+        rt::AudioData chunk = src;
+        auto *samples = (short*)chunk.allocateSample(100 + i % 50);
+        for (size_t si = 0; si < chunk.getSampleLength(); ++si)
+            samples[si] = (short)(i * 7 + si);
+        src += chunk;
+        coalescer.push(chunk);
+        ++num_chunks;
+
+        while (auto frame = coalescer.pop()) {
+            Expect(frame->getSampleLength() == 960);
+            // 1920 bytes. small frames are copied, not sliced out of the pending buffer.
+            Expect(!frame->data.shared());
+            dst += *frame;
+        }
+    }
+    while (auto frame = coalescer.pop(true))
+        dst += *frame;
+
+    auto& stats = coalescer.getStats();
+    Expect(dst.data == src.data);
+    Expect(stats.chunks_in == num_chunks);
+    Expect(stats.frames_out < stats.chunks_in);
+    Print("    %d chunks -> %d frames, %.1f frames/sec, header overhead %.2f%%\n",
+        (int)stats.chunks_in, (int)stats.frames_out, stats.framesPerSecond(), stats.headerOverhead() * 100.0f);
+}
+
+class TestTalkServer : public rt::TalkServer
+{
+public:
+    using TalkServer::clearAudioQueue;
+    using TalkServer::pushAudio;
+    using TalkServer::releaseAudio;
+    using TalkServer::streamAudio;
+
+    bool isReady() override { return true; }
+    Status onStats(StatsMessage&) override { return Status::Succeeded; }
+    Status onTalk(TalkMessage&) override { return Status::Succeeded; }
+    Status onStop(StopMessage&) override { return Status::Succeeded; }
+
+    size_t getBufferSize() { return m_data_size; }
+    int getDegraded() { return m_data_degraded; }
+    std::vector<rt::AudioDataPtr> getQueue() { return m_data_queue; }
+    void setCharsPerSec(float v) { m_chars_per_sec = v; }
+};
+
+TestCase(TalkServer_Backpressure)
+{
+    auto make_chunk = []() {
+        auto ad = std::make_shared<rt::AudioData>();
+        ad->format = rt::AudioFormat::F32;
+        ad->frequency = 48000;
+        ad->channels = 2;
+        ad->allocateSample(19200);
+        ad->data.zeroclear();
+        return ad; // 76800 bytes
+    };
+
+    {
+        // degrade: buffer stays within the limit without blocking
+        TestTalkServer server;
+        auto settings = server.getSettings();
+        settings.max_buffer_size = 256 * 1024;
+        settings.buffer_policy = rt::BufferPolicy::Degrade;
+        server.setSettings(settings);
+        server.clearAudioQueue();
+
+        for (int i = 0; i < 10; ++i)
+            server.pushAudio(make_chunk());
+        Expect(server.getBufferSize() <= (size_t)settings.max_buffer_size);
+        Expect(server.getDegraded() > 0);
+
+        // degraded chunks must still be mergeable as clients do
+        rt::AudioData merged;
+        for (auto& ad : server.getQueue())
+            merged += *ad;
+        Expect(merged.channels == 2 && merged.getSampleLength() == 19200 * 10);
+    }
+    {
+        // block: capture waits until the stream releases space
+        TestTalkServer server;
+        auto settings = server.getSettings();
+        settings.max_buffer_size = 200 * 1024;
+        settings.buffer_policy = rt::BufferPolicy::Block;
+        server.setSettings(settings);
+        server.clearAudioQueue();
+
+        server.pushAudio(make_chunk());
+        server.pushAudio(make_chunk());
+        auto begin = Now();
+        auto release = std::async(std::launch::async, [&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            server.releaseAudio(76800);
+        });
+        server.pushAudio(make_chunk());
+        Expect(NS2MS(Now() - begin) >= 90.0f);
+        Expect(server.getBufferSize() <= (size_t)settings.max_buffer_size);
+    }
+}
+
+TestCase(TalkServer_Admission)
+{
+    TestTalkServer server;
+    rt::TalkServer::TalkMessage mes;
+    mes.text = std::string(100, 'a');
+    float wait;
+
+    // nothing measured yet: everything is admitted. admitted talks are queued.
+    Expect(server.admitTalk(mes, 1, wait));
+
+    // 100 chars queued + 100 chars of its own at 10 chars/sec = 20 sec
+    server.setCharsPerSec(10.0f);
+    Expect(!server.admitTalk(mes, 15000, wait));
+    Expect(wait > 19.9f && wait < 20.1f);
+    Expect(server.getEstimatedWait() < 10.1f); // rejected talks are not queued
+    Expect(server.admitTalk(mes, 25000, wait));
+    Expect(server.admitTalk(mes, 0, wait));
+    for (int i = 0; i < 3; ++i)
+        server.endTalk(mes);
+
+    // its own length counts on an empty queue
+    Expect(!server.admitTalk(mes, 5000, wait));
+    Expect(server.getEstimatedWait() == 0.0f);
+
+    // concurrent requests can't all pass. 3 talks fit in 35 sec.
+    std::vector<std::future<bool>> results;
+    for (int i = 0; i < 8; ++i)
+        results.push_back(std::async(std::launch::async, [&]() { float w; return server.admitTalk(mes, 35000, w); }));
+    int admitted = 0;
+    for (auto& r : results)
+        admitted += r.get() ? 1 : 0;
+    Expect(admitted == 3);
+}
+
+TestCase(TalkServer_SingleFlight)
+{
+    TestTalkServer server;
+    rt::TalkServer::TalkMessage mes1, mes2, mes3;
+    mes1.text = mes2.text = mes3.text = "hello";
+    mes2.params.mute = true; // mute doesn't change the audio
+    mes3.params[0] = 0.5f;
+    Expect(mes1.getFlightKey() == mes2.getFlightKey());
+    Expect(mes1.getFlightKey() != mes3.getFlightKey());
+
+    bool leader1, leader2;
+    float wait;
+    auto key = mes1.getFlightKey();
+    auto flight = server.beginFlight(mes1, 0, leader1, wait);
+    Expect(server.beginFlight(mes2, 0, leader2, wait) == flight);
+    Expect(leader1 && !leader2);
+
+    // identical requests at the same time: exactly one leads
+    {
+        std::vector<std::future<bool>> results;
+        for (int i = 0; i < 8; ++i)
+            results.push_back(std::async(std::launch::async, [&]() { bool l; float w; server.beginFlight(mes3, 0, l, w); return l; }));
+        int leaders = 0;
+        for (auto& r : results)
+            leaders += r.get() ? 1 : 0;
+        Expect(leaders == 1);
+    }
+
+    const int NumFrames = 10;
+    auto frame = std::make_shared<rt::AudioData>();
+    for (int i = 0; i < NumFrames / 2; ++i)
+        flight->append(frame);
+
+    // late joiner gets the frames already produced and then the rest
+    auto follower = std::async(std::launch::async, [&]() {
+        size_t pos = 0;
+        std::vector<rt::AudioDataPtr> frames;
+        while (flight->read(pos, frames)) {}
+        return frames;
+    });
+    for (int i = 0; i < NumFrames / 2; ++i)
+        flight->append(frame);
+    server.endFlight(key, flight, true);
+
+    auto frames = follower.get();
+    Expect(frames.size() == NumFrames);
+    Expect(frames.back() == frame); // shared, not copied
+    Expect(flight->isSucceeded());
+    Expect(!server.findFlight(key));
+}
+
+TestCase(TalkServer_TargetedStop)
+{
+    TestTalkServer server;
+    server.clearAudioQueue();
+
+    // a talk that hasn't started is removed from the queue
+    auto queued = std::make_shared<rt::TalkServer::TalkMessage>();
+    queued->request_id = 5;
+    server.addMessage(queued);
+    Expect(server.cancelQueuedTalk(5));
+    Expect(queued->handled && queued->status == rt::TalkServer::Status::Failed);
+    Expect(!server.cancelQueuedTalk(5));
+
+    // a talk being streamed is stopped only by its own id and only if no one follows it
+    std::ostringstream os;
+    rt::TalkServer::TalkMessage talk;
+    talk.request_id = 7;
+    talk.respond_stream = &os;
+    talk.flight = std::make_shared<rt::TalkServer::Flight>();
+    server.streamAudio(talk);
+
+    rt::TalkServer::StopMessage stop;
+    Expect(server.isStopNeeded(stop));
+    stop.target = 8;
+    Expect(!server.isStopNeeded(stop));
+    stop.target = 7;
+    Expect(server.isStopNeeded(stop));
+    talk.flight->addFollower(1);
+    Expect(!server.isStopNeeded(stop));
+    talk.flight->addFollower(-1);
+
+    server.pushAudio(std::make_shared<rt::AudioData>());
+    talk.task.wait();
+    Expect(!server.isStopNeeded(stop));
+
+    // "/channel" carries the request id in the talk payload so that its stops can target it
+    rt::TalkServer::TalkMessage sent, received;
+    sent.text = "hello";
+    sent.request_id = 0x8000000000000007;
+    Expect(received.from_json(sent.to_json()));
+    Expect(received.request_id == sent.request_id);
+}
+
+// "/stop" against a live server. the server replies "ok" and TalkClient::stop() must count it as a success.
+TestCase(TalkServer_Stop)
+{
+    const uint16_t port = 8190;
+    TestTalkServer server;
+    auto settings = server.getSettings();
+    settings.port = port;
+    server.setSettings(settings);
+    if (!server.start())
+        return;
+
+    std::atomic_bool running{ true };
+    std::thread processor([&]() {
+        while (running) {
+            server.processMessages();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    });
+
+    rt::TalkClientSettings cs;
+    cs.server = "127.0.0.1";
+    cs.port = port;
+    rt::TalkClient client(cs);
+    Expect(client.stop());
+    Expect(client.stop(12345)); // targeted stop of a talk that isn't queued
+
+    running = false;
+    processor.join();
+    server.stop();
+}
+
+TestCase(CancelToken)
+{
+    rt::CancelToken token;
+    int called = 0, removed_called = 0;
+    token.subscribe([&]() { ++called; });
+    auto id = token.subscribe([&]() { ++removed_called; });
+    token.unsubscribe(id);
+    Expect(!token.isCancelled());
+
+    Expect(token.cancel());
+    Expect(!token.cancel());
+    Expect(token.isCancelled());
+    Expect(called == 1 && removed_called == 0);
+
+    // subscribing to a cancelled token calls back right away
+    token.subscribe([&]() { ++called; });
+    Expect(called == 2);
+}
+
+TestCase(TalkReceiver_FanOut)
+{
+    rt::TalkReceiver hub(64, 16);
+    auto fast = hub.subscribe("fast");
+    auto slow = hub.subscribe("slow");
+
+    auto frame = std::make_shared<rt::AudioData>();
+    frame->format = rt::AudioFormat::S16;
+    frame->allocateSample(100);
+    auto latest = std::make_shared<rt::AudioData>(*frame);
+    std::vector<rt::AudioDataPtr> fast_frames, slow_frames;
+    for (int i = 0; i < 40; ++i) {
+        hub.publish(i == 39 ? latest : frame);
+        hub.read(*fast, fast_frames, 0);
+    }
+    // slow subscriber lags 40 frames > max_lag 16. it skips to the latest and the others are unaffected.
+    hub.read(*slow, slow_frames, 0);
+    Expect(fast_frames.size() == 40);
+    Expect(fast_frames.front() == frame); // shared, not copied
+    Expect(slow_frames.size() == 1 && slow_frames[0] == latest && slow->dropped == 39);
+
+    hub.publish(frame);
+    slow_frames.clear();
+    hub.read(*slow, slow_frames, 0);
+    Expect(slow_frames.size() == 1);
+
+    // ends of talks are delivered even if they are skipped and overwritten in the ring
+    for (int i = 0; i < 100; ++i)
+        hub.publish(i == 10 || i == 20 ? std::make_shared<rt::AudioData>() : frame);
+    slow_frames.clear();
+    hub.read(*slow, slow_frames, 0);
+    Expect(slow_frames.size() == 3 && slow_frames[0]->data.empty() && slow_frames[1]->data.empty() && !slow_frames[2]->data.empty());
+    Expect(slow->dropped == 39 + 97);
+
+    hub.unsubscribe(slow);
+    hub.stop();
+    Expect(!hub.read(*fast, fast_frames, 0));
+}
+
+
+TestCase(TalkProxy_Routing)
+{
+    auto make_stats = [](const char *host, std::vector<const char*> names) {
+        rt::TalkServerStats stats;
+        stats.host = host;
+        int id = 0;
+        for (auto name : names)
+            stats.casts.push_back({ id++, name });
+        return stats;
+    };
+
+    rt::TalkProxy proxy;
+    proxy.addBackend({ "127.0.0.1", 8100 });
+    proxy.addBackend({ "127.0.0.1", 8101 });
+    proxy.addBackend({ "127.0.0.1", 8140 });
+    auto backends = proxy.getBackends();
+
+    // two instances of VOICEROID2 and one CeVIO
+    auto vr2 = make_stats("VOICEROID2", { "Akari", "Yukari" });
+    auto cv = make_stats("CeVIO CS", { "Sato Sasara", "Akari" });
+    proxy.updateBackend(backends[0], &vr2);
+    proxy.updateBackend(backends[1], &vr2);
+    proxy.updateBackend(backends[2], &cv);
+
+    rt::TalkServer::StatsMessage mes;
+    proxy.onStats(mes);
+    Expect(mes.stats.casts.size() == 4);
+    Expect(mes.stats.casts[3].id == 3 && mes.stats.casts[3].name == "Akari");
+
+    // cast 1 (Yukari) is served by both VOICEROID2 instances. the idle one comes first.
+    backends[0]->talking = 1;
+    auto routes = proxy.getRoutes(1);
+    Expect(routes.size() == 2 && routes[0].backend == backends[1] && routes[0].cast == 1);
+    backends[0]->talking = 0;
+
+    // CeVIO's Akari is a different cast from VOICEROID2's
+    routes = proxy.getRoutes(3);
+    Expect(routes.size() == 1 && routes[0].backend == backends[2] && routes[0].cast == 1);
+
+    // backends that are down are excluded
+    proxy.updateBackend(backends[1], nullptr);
+    Expect(proxy.getRoutes(1).size() == 1);
+    proxy.updateBackend(backends[2], nullptr);
+    Expect(proxy.getRoutes(3).empty());
+
+    // identical talks are not merged by the proxy. each one is a leader of its own flight.
+    rt::TalkServer::TalkMessage talk;
+    talk.text = "hello";
+    bool leader1 = false, leader2 = false;
+    float wait;
+    auto flight1 = proxy.beginFlight(talk, 0, leader1, wait);
+    auto flight2 = proxy.beginFlight(talk, 0, leader2, wait);
+    Expect(flight1 && flight2 && flight1 != flight2 && leader1 && leader2);
+    Expect(!proxy.findFlight(talk.getFlightKey()));
+    proxy.endTalk(talk);
+    proxy.endTalk(talk);
+}
+
+
+class TestRenderQueue : public rt::RenderQueue
+{
+public:
+    std::atomic_int running[2] = {};
+    std::atomic_int max_running[2] = {};
+    std::atomic_int rendered[2] = {};
+    bool server0_fails = false;
+    bool block = false;
+
+protected:
+    bool render(int server, const rt::RenderJob& job, rt::AudioData& dst, const rt::CancelTokenPtr& cancel) override
+    {
+        int n = ++running[server];
+        int m = max_running[server];
+        while (n > m && !max_running[server].compare_exchange_weak(m, n)) {}
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        while (block && !cancel->isCancelled())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        --running[server];
+        if (server == 0 && server0_fails)
+            return false;
+        ++rendered[server];
+        return true;
+    }
+
+    bool save(const rt::RenderJob&, const rt::AudioData&) override { return true; }
+};
+
+TestCase(RenderQueue)
+{
+    {
+        // server 0 fails everything. jobs are retried on server 1 within its concurrency limit.
+        TestRenderQueue queue;
+        queue.server0_fails = true;
+        queue.addServer({ "127.0.0.1", 8100 }, 2);
+        queue.addServer({ "127.0.0.1", 8101 }, 1);
+        queue.setMaxRetries(1);
+        for (int i = 0; i < 10; ++i)
+            queue.addJob({ "", {}, "hello", "" });
+        Expect(queue.start());
+        Expect(queue.wait(5000));
+
+        auto progress = queue.getProgress();
+        Expect(progress.isFinished());
+        Expect(progress.total == 10 && progress.succeeded == 10 && progress.failed == 0);
+        Expect(progress.retries > 0);
+        Expect(queue.rendered[1] == 10);
+        Expect(queue.max_running[0] <= 2 && queue.max_running[1] == 1);
+    }
+    {
+        // with a single server the retry goes to the same one and then gives up
+        TestRenderQueue queue;
+        queue.server0_fails = true;
+        queue.addServer({ "127.0.0.1", 8100 }, 1);
+        queue.setMaxRetries(2);
+        int job = queue.addJob({ "", {}, "hello", "" });
+        queue.start();
+        Expect(queue.wait(5000));
+        Expect(queue.getJobState(job) == rt::RenderQueue::JobState::Failed);
+        Expect(queue.getProgress().retries == 2);
+    }
+    {
+        // cancel aborts jobs being rendered and drops queued ones
+        TestRenderQueue queue;
+        queue.block = true;
+        queue.addServer({ "127.0.0.1", 8100 }, 2);
+        for (int i = 0; i < 5; ++i)
+            queue.addJob({ "", {}, "hello", "" });
+        queue.start();
+        Expect(!queue.wait(50));
+        Expect(queue.getProgress().rendering == 2);
+        queue.cancel();
+        Expect(queue.wait(5000));
+        Expect(queue.getProgress().cancelled == 5);
+    }
+}
+
+
+TestCase(rtHistogram)
+{
+    rt::Histogram h1, h2;
+    for (uint64_t i = 1; i <= 100000; ++i)
+        (i % 2 ? h1 : h2).record(i);
+    Expect(h1.merge(h2));
+    Expect(h1.getCount() == 100000);
+    Expect(h1.getMin() == 1 && h1.getMax() == 100000);
+
+    // relative error is within 1 / 2^(significant_bits-1)
+    auto p50 = h1.getPercentile(50.0);
+    auto p99 = h1.getPercentile(99.0);
+    Expect(p50 >= 50000 && p50 <= 50000 + 50000 / 512);
+    Expect(p99 >= 99000 && p99 <= 99000 + 99000 / 512);
+    Expect(h1.getPercentile(100.0) == 100000);
+
+    rt::Histogram h3(10, 1000);
+    Expect(!h1.merge(h3));
+    h3.record(5000); // clamped
+    Expect(h3.getMax() == 1000);
+}
+
+
+TestCase(TrafficLog)
+{
+    const char *path = "TrafficLog.rttl";
+
+    rt::AudioData frame;
+    frame.format = rt::AudioFormat::S16;
+    frame.frequency = 48000;
+    frame.channels = 1;
+    frame.allocateSample(480);
+
+    {
+        rt::TrafficRecorder recorder;
+        Expect(recorder.open(path, false));
+        auto talk = recorder.beginSession("/talk?cast=1&text=hello", "");
+        auto stats = recorder.beginSession("/stats", "");
+        recorder.recordResponse(stats, "{}");
+        recorder.endSession(stats, 200);
+        recorder.recordFrame(talk, frame);
+        recorder.recordFrame(talk, frame);
+        recorder.recordFrame(talk, rt::AudioData());
+        recorder.endSession(talk, 200);
+    }
+
+    rt::TrafficLog log;
+    Expect(log.load(path));
+    auto& sessions = log.getSessions();
+    Expect(sessions.size() == 2);
+    if (sessions.size() == 2) {
+        auto& talk = sessions[0];
+        Expect(talk.getPath() == "/talk");
+        Expect(talk.status == 200);
+        Expect(talk.frames.size() == 3);
+        Expect(talk.frames[0].size == frame.data.size() && talk.frames[0].data.empty());
+        Expect(talk.frames[0].toAudioData()->data.size() == frame.data.size());
+        Expect(talk.time_end >= talk.frames.back().time);
+
+        auto& stats = sessions[1];
+        Expect(stats.getPath() == "/stats");
+        Expect(stats.response == "{}");
+    }
+
+    // samples are recorded. a record cut off at the end is dropped.
+    frame.get<int16_t>()[10] = 1234;
+    {
+        rt::TrafficRecorder recorder;
+        Expect(recorder.open(path, true));
+        auto talk = recorder.beginSession("/talk?cast=1&text=hello", "");
+        recorder.recordFrame(talk, frame);
+        recorder.recordFrame(talk, frame);
+        recorder.endSession(talk, 200);
+        recorder.close();
+        Expect(!recorder.isOpened());
+    }
+    {
+        std::string bytes;
+        {
+            std::ifstream is(path, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+        }
+        rt::TrafficLog complete;
+        Expect(complete.load(path) && complete.getSessions().size() == 1);
+        if (complete.getSessions().size() == 1) {
+            auto& frames = complete.getSessions()[0].frames;
+            Expect(frames.size() == 2 && frames[1].toAudioData()->data == frame.data);
+        }
+
+        // cut in the middle of the samples of the second frame
+        size_t end_record = 1 + 4 + 8 + 4;
+        std::ofstream(path, std::ios::binary).write(bytes.data(), bytes.size() - end_record - 100);
+        rt::TrafficLog cut;
+        Expect(cut.load(path) && cut.getSessions().size() == 1);
+        if (cut.getSessions().size() == 1)
+            Expect(cut.getSessions()[0].frames.size() == 1 && cut.getSessions()[0].status == 0);
+    }
+    std::remove(path);
+}
+
+
+TestCase(TalkServerMetrics)
+{
+    using Metrics = rt::TalkServerMetrics;
+    Metrics metrics;
+
+    // each thread has its own shard. shards of finished threads must be kept.
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&metrics]() {
+            for (int j = 0; j < 100; ++j) {
+                metrics.countRequest("/talk", 200);
+                metrics.countFrame(960);
+                metrics.recordTime(Metrics::Timer::TimeToFirstAudio, std::chrono::milliseconds(20));
+            }
+            metrics.addStreamsInFlight(1);
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    metrics.countRequest("/talk", 503);
+    metrics.countRequest("/foo", 404);
+    metrics.addStreamsInFlight(-1);
+
+    auto s = metrics.getSnapshot();
+    Expect(s.getRequests(Metrics::Path::Talk, 200) == 400);
+    Expect(s.getRequests(Metrics::Path::Talk, 503) == 1);
+    Expect(s.getRequests(Metrics::Path::Other, 404) == 1);
+    Expect(s.getStreamsInFlight() == 3);
+    Expect(s.getFramesStreamed() == 400 && s.getBytesStreamed() == 400 * 960);
+    Expect(s.getTimerCount(Metrics::Timer::TimeToFirstAudio) == 400);
+    Expect(s.getTimerBucket(Metrics::Timer::TimeToFirstAudio, 3) == 400); // (0.01, 0.025]
+
+    auto text = s.toPrometheus();
+    Expect(text.find("remotetalk_requests_total{path=\"/talk\",code=\"200\"} 400") != std::string::npos);
+    Expect(text.find("remotetalk_time_to_first_audio_seconds_bucket{le=\"+Inf\"} 400") != std::string::npos);
+
+    // folded shards are not counted twice
+    Expect(metrics.getSnapshot().getRequests(Metrics::Path::Talk, 200) == 400);
+}
+
+
+TestCase(Tracer)
+{
+    auto count_spans = [](const std::string& json) {
+        int n = 0;
+        for (size_t pos = 0; (pos = json.find("\"ph\":\"X\"", pos)) != std::string::npos; ++pos)
+            ++n;
+        return n;
+    };
+    // spans that are test.span of one of the writers and have all fields
+    auto count_valid_spans = [](const std::string& json) {
+        int n = 0;
+        std::istringstream is(json);
+        std::string line;
+        while (std::getline(is, line)) {
+            if (line.find("\"ph\":\"X\"") == std::string::npos)
+                continue;
+            bool valid = line.find("{\"name\":\"test.span\",\"cat\":\"rt\",\"ph\":\"X\",\"ts\":") == 0 &&
+                line.find("\"dur\":") != std::string::npos && line.find("\"tid\":") != std::string::npos;
+            bool known_id = false;
+            for (uint64_t i = 1; i <= 4; ++i)
+                known_id |= line.find("\"request_id\":\"" + rt::Tracer::ToString(i) + "\"}}") != std::string::npos;
+            if (valid && known_id)
+                ++n;
+        }
+        return n;
+    };
+    auto run_writers = [](rt::Tracer& tracer, int spans_per_thread) {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&tracer, i, spans_per_thread]() {
+                for (int j = 0; j < spans_per_thread; ++j) {
+                    auto begin = rt::Tracer::Now();
+                    tracer.record("test.span", (uint64_t)i + 1, begin, rt::Tracer::Now());
+                }
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+    };
+
+    // no wrap-around. every span is exported
+    rt::Tracer tracer(64);
+    Expect(!tracer.isEnabled()); // a diagnostic. off by default
+    tracer.setEnabled(true);
+    run_writers(tracer, 16);
+    auto json = tracer.exportChromeTrace("Test");
+    Expect(count_spans(json) == 64 && count_valid_spans(json) == 64);
+
+    // only the newest spans remain. a slot a slower writer finished after a newer span is skipped, so it can be less.
+    tracer.clear();
+    run_writers(tracer, 100);
+    json = tracer.exportChromeTrace("Test");
+    int n = count_spans(json);
+    Expect(n <= 64 && count_valid_spans(json) == n);
+    Expect(json.find("\"name\":\"test.span\"") != std::string::npos);
+    Expect(json.find("\"process_name\"") != std::string::npos);
+
+    tracer.clear();
+    Expect(count_spans(tracer.exportChromeTrace("Test")) == 0);
+    tracer.setEnabled(false);
+    tracer.record("test.span", 1, 0, 1);
+    Expect(count_spans(tracer.exportChromeTrace("Test")) == 0);
+
+    auto id = rt::Tracer::NewRequestId();
+    Expect(id != 0 && rt::Tracer::ParseRequestId(rt::Tracer::ToString(id)) == id);
+    Expect(rt::Tracer::ParseRequestId("xyz") == 0);
 }
 
 
@@ -145,6 +1243,207 @@ TestCase(rtAudioData_Convert)
     Expect(data3.data == data.data);
 }
 
+TestCase(rtAudioData_CopyOnWrite)
+{
+    rt::AudioData a;
+    a.format = rt::AudioFormat::S16;
+    a.frequency = 48000;
+    a.channels = 1;
+    auto *samples = (int16_t*)a.allocateSample(100);
+    for (int i = 0; i < 100; ++i)
+        samples[i] = (int16_t)i;
+
+    // copies and slices share the samples
+    const rt::AudioData b = a;
+    auto s = a.slice(10, 20);
+    Expect(b.data.cdata() == a.data.cdata());
+    Expect(s.getSampleLength() == 20 && s.data.cdata() == b.data.cdata() + 20);
+    Expect(a.data.shared());
+
+    // modification makes a private copy. the others are not affected.
+    a.get<int16_t>()[10] = -1;
+    Expect(a.data.cdata() != b.data.cdata());
+    Expect(b.get<int16_t>()[10] == 10 && s.get<int16_t>()[0] == 10);
+    s += b;
+    Expect(s.getSampleLength() == 120 && b.getSampleLength() == 100);
+    Expect(s.get<int16_t>()[20] == 0 && b.get<int16_t>()[0] == 0);
+
+    // nothing else refers the storage now. no copy.
+    auto *p = a.data.cdata();
+    a.get<int16_t>()[0] = 1;
+    Expect(!a.data.shared() && a.data.cdata() == p);
+
+    // serialization round trip of a slice
+    std::stringstream ss;
+    auto s2 = b.slice(90, 100);
+    s2.serialize(ss);
+    rt::AudioData c;
+    c.deserialize(ss);
+    Expect(c.getSampleLength() == 10 && c.get<int16_t>()[0] == 90);
+}
+
+TestCase(rtAudioDataPool)
+{
+    rt::AudioDataPool pool(2);
+
+    // a released chunk is reused with its storage
+    auto a = pool.get();
+    a->data.resize_discard(1024);
+    auto *p = a->data.cdata();
+    auto *ptr = a.get();
+    a.reset();
+    a = pool.get();
+    Expect(a.get() == ptr);
+    a->data.resize_discard(512);
+    Expect(a->data.cdata() == p);
+
+    // chunks still referenced (or whose samples are) are not handed out
+    rt::AudioData copy = *a;
+    auto b = pool.get();
+    Expect(b != a);
+    copy.clear();
+    a.reset();
+    Expect(pool.get().get() == ptr);
+
+    // all chunks in use. a new one is returned and not pooled
+    a = pool.get();
+    auto c = pool.get();
+    Expect(c != a && c != b);
+    c.reset();
+    Expect(pool.get() != a);
+}
+
+TestCase(RawVector_Allocator)
+{
+    // alignment is kept through growth
+    {
+        rt::RawVector<float, rt::Aligned32Allocator> a32;
+        rt::RawVector<float, rt::Aligned64Allocator> a64;
+        for (int i = 0; i < 10000; ++i) {
+            a32.push_back((float)i);
+            a64.push_back((float)i);
+            Expect((size_t)a32.data() % 32 == 0 && (size_t)a64.data() % 64 == 0);
+        }
+        Expect(a32[9999] == 9999.0f && a64[1234] == 1234.0f);
+    }
+
+    // freed blocks are reused
+    {
+        rt::PoolAllocator::trim();
+        const void *p;
+        {
+            rt::RawVector<char, rt::PoolAllocator> v(4000);
+            p = v.data();
+        }
+        Expect(rt::PoolAllocator::getCachedBytes() == 4096);
+        rt::RawVector<char, rt::PoolAllocator> v(3000);
+        Expect(v.data() == p && rt::PoolAllocator::getCachedBytes() == 0);
+        v.resize(2500);
+        v.shrink_to_fit(); // same size class. no copy.
+        Expect(v.data() == p && v.capacity() == 2500);
+    }
+
+    // arena
+    {
+        rt::RawVector<int, rt::ArenaAllocator> heap;
+        heap.resize(100);
+        {
+            rt::Arena arena(64 * 1024);
+            Expect(rt::Arena::getCurrent() == &arena);
+            rt::RawVector<int, rt::ArenaAllocator> v;
+            v.resize(100);
+            Expect(arena.contains(v.data()) && !arena.contains(heap.data()));
+            // the last allocation grows in place
+            auto *p = v.data();
+            v.resize(1000);
+            Expect(v.data() == p);
+            for (int i = 0; i < 1000; ++i)
+                v[i] = i;
+            // heap blocks are still freed to the heap
+            heap.resize(10000);
+            Expect(!arena.contains(heap.data()));
+            // too large for the page. takes a new one.
+            v.resize(100000);
+            Expect(arena.contains(v.data()) && v[999] == 999);
+        }
+        Expect(rt::Arena::getCurrent() == nullptr);
+    }
+
+    // large growth by realloc() keeps the contents
+    {
+        rt::RawVector<int> v;
+        for (int i = 0; i < 4 * 1024 * 1024; ++i)
+            v.push_back(i);
+        bool ok = true;
+        for (int i = 0; i < 4 * 1024 * 1024; ++i)
+            ok = ok && v[i] == i;
+        Expect(ok);
+        v.resize(10);
+        v.shrink_to_fit();
+        Expect(v.capacity() == 10 && v[9] == 9);
+    }
+}
+
+TestCase(RingBuffer)
+{
+    {
+        rt::RingBuffer<int> ring(10);
+        int src[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+        int dst[8] = {};
+        Expect(ring.write(src, 8) == 8 && ring.size() == 8 && ring.space() == 2);
+        Expect(ring.write(src, 8) == 2 && ring.full());
+        Expect(ring.read(dst, 6) == 6 && dst[5] == 5);
+        int more[2] = { 100, 101 };
+        Expect(ring.write(more, 2) == 2);
+
+        // [6, 10) then [0, 2)
+        auto spans = ring.read_spans();
+        Expect(spans.first.size == 4 && spans.second.size == 2 && spans.second.data == ring.data());
+        rt::RawVector<int, rt::PoolAllocator> chunk;
+        Expect(ring.read_chunk(chunk) == 6 && ring.empty());
+        Expect(chunk[0] == 6 && chunk[3] == 1 && chunk[5] == 101);
+
+        // views don't move the positions
+        auto v = ring.view(8, 5);
+        Expect(v.first.size == 2 && v.second.size == 3 && ring.empty());
+        Expect(ring.view(3, 100).size() == 10);
+    }
+
+    // one producer and one consumer without locks
+    {
+        const int N = 1000000;
+        rt::RingBuffer<int> ring(1000);
+        std::thread producer([&]() {
+            int buf[64];
+            for (int i = 0; i < N;) {
+                int n = std::min(N - i, 1 + i % 64);
+                for (int j = 0; j < n; ++j)
+                    buf[j] = i + j;
+                int pos = 0;
+                while (pos < n) {
+                    int w = (int)ring.write(buf + pos, n - pos);
+                    if (w == 0)
+                        std::this_thread::yield();
+                    pos += w;
+                }
+                i += n;
+            }
+        });
+
+        bool ok = true;
+        int expected = 0;
+        rt::RawVector<int> chunk;
+        while (expected < N) {
+            if (ring.read_chunk(chunk, 300) == 0)
+                std::this_thread::yield();
+            for (int v : chunk)
+                ok = ok && v == expected++;
+        }
+        producer.join();
+        Expect(ok && ring.empty());
+    }
+}
+
 #ifdef _WIN32
 class TestFileIOHandler : public rt::FileIOHandlerBase
 {
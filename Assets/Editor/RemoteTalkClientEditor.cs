@@ -196,6 +196,7 @@ namespace IST.RemoteTalkEditor
                 EditorGUILayout.PropertyField(so.FindProperty("m_useExportedClips"));
                 EditorGUILayout.Space();
                 EditorGUILayout.PropertyField(so.FindProperty("m_sampleGranularity"));
+                EditorGUILayout.PropertyField(so.FindProperty("m_lockFreePlayback"));
                 EditorGUILayout.PropertyField(so.FindProperty("m_logging"));
                 EditorGUI.indentLevel--;
             }
@@ -75,6 +75,18 @@ namespace IST.RemoteTalk
     {
         #region internal
         [DllImport("RemoteTalkClient")] static extern IntPtr rtGetVersion();
+        [DllImport("RemoteTalkClient")] static extern void rtTraceSetEnabled(byte v);
+        [DllImport("RemoteTalkClient")] static extern byte rtTraceIsEnabled();
+        [DllImport("RemoteTalkClient")] static extern byte rtTraceExport(string path);
+        [DllImport("RemoteTalkClient")] static extern void rtSetWorkerThreadCount(int v);
+        [DllImport("RemoteTalkClient")] static extern int rtGetWorkerThreadCount();
+        [DllImport("RemoteTalkClient")] static extern byte rtCacheOpen(string dir, ulong budget);
+        [DllImport("RemoteTalkClient")] static extern void rtCacheClose();
+        [DllImport("RemoteTalkClient")] static extern byte rtCacheIsOpened();
+        [DllImport("RemoteTalkClient")] static extern void rtCacheClear();
+        [DllImport("RemoteTalkClient")] static extern void rtCacheSetBudget(ulong v);
+        [DllImport("RemoteTalkClient")] static extern ulong rtCacheGetUsage();
+        [DllImport("RemoteTalkClient")] static extern int rtCacheGetEntryCount();
         #endregion
 
         public static string version
@@ -82,6 +94,53 @@ namespace IST.RemoteTalk
             get { return Misc.S(rtGetVersion()); }
         }
 
+        // trace, worker threads, cache, sinks, rtRenderQueue and ReadSamples() need plugin binaries built from the
+        // current source. older binaries throw EntryPointNotFoundException. nothing calls them unless asked to.
+
+        // client side spans of talks in Chrome trace event JSON. server side spans are at http://server:port/trace
+        public static bool traceEnabled
+        {
+            get { return rtTraceIsEnabled() != 0; }
+            set { rtTraceSetEnabled((byte)(value ? 1 : 0)); }
+        }
+
+        public static bool ExportTrace(string path)
+        {
+            return rtTraceExport(path) != 0;
+        }
+
+        // all clients share this number of worker threads (at least 2)
+        public static int workerThreadCount
+        {
+            get { return rtGetWorkerThreadCount(); }
+            set { rtSetWorkerThreadCount(value); }
+        }
+
+        // rendered talks are cached in dir and played again without contacting the server.
+        // least recently used talks are removed to keep the total size within budget (in bytes).
+        public static bool OpenCache(string dir, ulong budget)
+        {
+            return rtCacheOpen(dir, budget) != 0;
+        }
+        public static void CloseCache() { rtCacheClose(); }
+        public static void ClearCache() { rtCacheClear(); }
+        public static bool cacheOpened
+        {
+            get { return rtCacheIsOpened() != 0; }
+        }
+        public static ulong cacheBudget
+        {
+            set { rtCacheSetBudget(value); }
+        }
+        public static ulong cacheUsage
+        {
+            get { return rtCacheGetUsage(); }
+        }
+        public static int cacheEntryCount
+        {
+            get { return rtCacheGetEntryCount(); }
+        }
+
         public static int LaunchVOICEROID2(string path = null)
         {
 #if UNITY_EDITOR_WIN || UNITY_STANDALONE_WIN
@@ -307,8 +366,19 @@ namespace IST.RemoteTalk
         [DllImport("RemoteTalkClient")] static extern byte rtAsyncIsFinished(IntPtr self);
         [DllImport("RemoteTalkClient")] static extern byte rtAsyncWait(IntPtr self, int timeout_ms);
         [DllImport("RemoteTalkClient")] static extern byte rtAsyncGetBool(IntPtr self, ref byte dst);
+        [DllImport("RemoteTalkClient")] static extern int rtAsyncDrainCompleted(IntPtr[] dst, int max);
         #endregion
 
+        // operations finished since the last call. call once per frame instead of polling each rtAsync.
+        public static int DrainCompleted(rtAsync[] dst)
+        {
+            var tmp = new IntPtr[dst.Length];
+            int n = rtAsyncDrainCompleted(tmp, tmp.Length);
+            for (int i = 0; i < n; ++i)
+                dst[i] = new rtAsync { self = tmp[i] };
+            return n;
+        }
+
         public static implicit operator bool(rtAsync v) { return rtAsyncIsValid(v.self) != 0; }
         public void Release() { self = IntPtr.Zero; }
 
@@ -349,6 +419,12 @@ namespace IST.RemoteTalk
         [DllImport("RemoteTalkClient")] static extern rtAsync rtHTTPClientStop(IntPtr self);
         [DllImport("RemoteTalkClient")] static extern rtAudioData rtHTTPClientSyncBuffers(IntPtr self);
         [DllImport("RemoteTalkClient")] static extern rtAudioData rtHTTPClientGetBuffer(IntPtr self);
+        [DllImport("RemoteTalkClient")] static extern double rtHTTPClientReadSamples(IntPtr self, float[] dst, int frequency, int channels, int length, double pos);
+        [DllImport("RemoteTalkClient")] static extern int rtHTTPClientGetPlaybackLength(IntPtr self);
+        [DllImport("RemoteTalkClient")] static extern byte rtHTTPClientIsPlaybackFinished(IntPtr self);
+        [DllImport("RemoteTalkClient")] static extern int rtHTTPClientGetUnderrunCount(IntPtr self);
+        [DllImport("RemoteTalkClient")] static extern void rtHTTPClientAddWaveSink(IntPtr self, string path);
+        [DllImport("RemoteTalkClient")] static extern void rtHTTPClientAddOggSink(IntPtr self, string path, ref rtOggSettings settings);
         [DllImport("RemoteTalkClient")] static extern rtAsync rtHTTPClientExportWave(IntPtr self, string path);
         [DllImport("RemoteTalkClient")] static extern rtAsync rtHTTPClientExportOgg(IntPtr self, string path, ref rtOggSettings settings);
         #endregion
@@ -408,6 +484,19 @@ namespace IST.RemoteTalk
         {
             get { return rtHTTPClientGetBuffer(self); }
         }
+        // playback* and ReadSamples() don't lock. safe to use in OnAudioFilterRead().
+        public int playbackLength
+        {
+            get { return rtHTTPClientGetPlaybackLength(self); }
+        }
+        public bool isPlaybackFinished
+        {
+            get { return rtHTTPClientIsPlaybackFinished(self) != 0; }
+        }
+        public int underrunCount
+        {
+            get { return rtHTTPClientGetUnderrunCount(self); }
+        }
 
         public static rtHTTPClient Create() { return rtHTTPClientCreate(); }
         public void Release() { rtHTTPClientRelease(self); self = IntPtr.Zero; }
@@ -417,11 +506,90 @@ namespace IST.RemoteTalk
         public rtAsync Talk(ref rtTalkParams para, string text) { return rtHTTPClientTalk(self, ref para, text); }
         public rtAsync Stop() { return rtHTTPClientStop(self); }
         public rtAudioData SyncBuffers() { return rtHTTPClientSyncBuffers(self); }
+        public double ReadSamples(float[] dst, int frequency, int channels, int length, double pos) { return rtHTTPClientReadSamples(self, dst, frequency, channels, length, pos); }
+        // the next Talk() is written to the file while it is received. the file is complete when the talk finishes.
+        public void AddWaveSink(string path) { rtHTTPClientAddWaveSink(self, path); }
+        public void AddOggSink(string path, ref rtOggSettings s) { rtHTTPClientAddOggSink(self, path, ref s); }
         public rtAsync ExportWave(string path) { return rtHTTPClientExportWave(self, path); }
         public rtAsync ExportOgg(string path, ref rtOggSettings s) { return rtHTTPClientExportOgg(self, path, ref s); }
     }
 
 
+    public enum rtRenderJobState
+    {
+        Queued,
+        Rendering,
+        Succeeded,
+        Failed,
+        Cancelled,
+    }
+
+    public struct rtRenderProgress
+    {
+        public int total;
+        public int queued;
+        public int rendering;
+        public int succeeded;
+        public int failed;
+        public int cancelled;
+        public int retries;
+
+        public bool isFinished { get { return queued == 0 && rendering == 0; } }
+    }
+
+    // renders many talks to files on multiple servers. poll progress instead of waiting for each talk.
+    public struct rtRenderQueue
+    {
+        #region internal
+        public IntPtr self;
+        [DllImport("RemoteTalkClient")] static extern rtRenderQueue rtRenderQueueCreate();
+        [DllImport("RemoteTalkClient")] static extern void rtRenderQueueRelease(IntPtr self);
+        [DllImport("RemoteTalkClient")] static extern void rtRenderQueueAddServer(IntPtr self, string server, int port, int maxConcurrency);
+        [DllImport("RemoteTalkClient")] static extern void rtRenderQueueSetMaxRetries(IntPtr self, int v);
+        [DllImport("RemoteTalkClient")] static extern void rtRenderQueueSetOggSettings(IntPtr self, ref rtOggSettings settings);
+        [DllImport("RemoteTalkClient")] static extern int rtRenderQueueAddJob(IntPtr self, string cast, ref rtTalkParams p, string text, string path);
+        [DllImport("RemoteTalkClient")] static extern byte rtRenderQueueStart(IntPtr self);
+        [DllImport("RemoteTalkClient")] static extern void rtRenderQueueCancel(IntPtr self);
+        [DllImport("RemoteTalkClient")] static extern byte rtRenderQueueWait(IntPtr self, int timeout_ms);
+        [DllImport("RemoteTalkClient")] static extern byte rtRenderQueueIsFinished(IntPtr self);
+        [DllImport("RemoteTalkClient")] static extern void rtRenderQueueGetProgress(IntPtr self, ref rtRenderProgress dst);
+        [DllImport("RemoteTalkClient")] static extern int rtRenderQueueGetJobState(IntPtr self, int i);
+        #endregion
+
+        public static implicit operator bool(rtRenderQueue v) { return v.self != IntPtr.Zero; }
+
+        public bool isFinished
+        {
+            get { return rtRenderQueueIsFinished(self) != 0; }
+        }
+        public rtRenderProgress progress
+        {
+            get
+            {
+                var ret = default(rtRenderProgress);
+                rtRenderQueueGetProgress(self, ref ret);
+                return ret;
+            }
+        }
+        public int maxRetries
+        {
+            set { rtRenderQueueSetMaxRetries(self, value); }
+        }
+
+        public static rtRenderQueue Create() { return rtRenderQueueCreate(); }
+        // cancels jobs in progress
+        public void Release() { rtRenderQueueRelease(self); self = IntPtr.Zero; }
+        public void AddServer(string server, int port, int maxConcurrency = 1) { rtRenderQueueAddServer(self, server, port, maxConcurrency); }
+        public void SetOggSettings(ref rtOggSettings s) { rtRenderQueueSetOggSettings(self, ref s); }
+        // castName is resolved on each server. null uses the cast id in para.
+        public int AddJob(string castName, ref rtTalkParams para, string text, string path) { return rtRenderQueueAddJob(self, castName, ref para, text, path); }
+        public bool Start() { return rtRenderQueueStart(self) != 0; }
+        public void Cancel() { rtRenderQueueCancel(self); }
+        public bool Wait(int timeoutMS = 0) { return rtRenderQueueWait(self, timeoutMS) != 0; }
+        public rtRenderJobState GetJobState(int i) { return (rtRenderJobState)rtRenderQueueGetJobState(self, i); }
+    }
+
+
     public struct rtspTalkServer
     {
         #region internal
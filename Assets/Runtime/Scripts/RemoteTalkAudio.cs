@@ -16,6 +16,7 @@ namespace IST.RemoteTalk
         AudioSource m_audioSource;
         AudioClip m_dummyClip;
         rtAudioData m_data;
+        rtHTTPClient m_client;
 
         bool m_isPlaying;
         bool m_isFinished;
@@ -36,9 +37,25 @@ namespace IST.RemoteTalk
         {
             m_data = data;
             m_syncBuffers = cb;
+            m_client = default(rtHTTPClient);
             if (!m_data || m_audioSource == null)
                 return;
+            BeginPlay();
+        }
+
+        // streams audio the client is receiving. the audio thread reads it without locks.
+        public void Play(rtHTTPClient client)
+        {
+            m_data = default(rtAudioData);
+            m_syncBuffers = null;
+            m_client = client;
+            if (!m_client || m_audioSource == null)
+                return;
+            BeginPlay();
+        }
 
+        void BeginPlay()
+        {
             if (m_dummyClip == null)
             {
                 const int SampleRate = 44000;
@@ -76,6 +93,7 @@ namespace IST.RemoteTalk
             m_audioSource.loop = false;
             m_audioSource.clip = null;
             m_data.Release();
+            m_client = default(rtHTTPClient);
         }
 
 
@@ -106,7 +124,22 @@ namespace IST.RemoteTalk
 
         void OnAudioFilterRead(float[] dst, int channels)
         {
-            if (!m_isPlaying || !m_data)
+            if (!m_isPlaying)
+                return;
+
+            if (m_client)
+            {
+                // isPlaybackFinished must be checked before reading. samples may arrive right before it.
+                bool finished = m_client.isPlaybackFinished;
+                m_samplePos = m_client.ReadSamples(dst, m_sampleRate, channels, dst.Length, m_samplePos);
+                if (finished && (int)m_samplePos == m_client.playbackLength)
+                {
+                    m_isPlaying = false;
+                    m_isFinished = true;
+                }
+                return;
+            }
+            if (!m_data)
                 return;
 
             bool eos = m_syncBuffers();
@@ -35,6 +35,9 @@ namespace IST.RemoteTalk
         [SerializeField] rtOggSettings m_oggSettings = rtOggSettings.defaultValue;
         [SerializeField] bool m_useExportedClips = true;
         [SerializeField] [Range(1024, 65536)] int m_sampleGranularity = 8192;
+        // read samples on the audio thread without locks (rtHTTPClient.ReadSamples()).
+        // the plugin binaries must be rebuilt from the current source to use it.
+        [SerializeField] bool m_lockFreePlayback = false;
 
         rtHTTPClient m_client;
         rtAsync m_asyncStats;
@@ -116,6 +119,11 @@ namespace IST.RemoteTalk
             get { return m_talkText; }
             set { m_talkText = value; }
         }
+        public bool lockFreePlayback
+        {
+            get { return m_lockFreePlayback; }
+            set { m_lockFreePlayback = value; }
+        }
 
         public bool isServerReady
         {
@@ -321,7 +329,10 @@ namespace IST.RemoteTalk
                     if (buf.sampleLength > m_sampleGranularity ||
                         (buf.sampleLength > 0 && m_asyncTalk.isFinished && m_asyncTalk.boolValue))
                     {
-                        UseOutput(audio => { audio.Play(buf, SyncBuffers); });
+                        if (m_lockFreePlayback)
+                            UseOutput(audio => { audio.Play(m_client); });
+                        else
+                            UseOutput(audio => { audio.Play(buf, SyncBuffers); });
                         FireOnTalkStart(m_currentTalk);
                     }
                 }